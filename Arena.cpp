@@ -0,0 +1,110 @@
+// Arena class function definitions
+// Computer Science, MVNU
+
+#include "Arena.h"
+#include <algorithm>
+#include <cstring>
+using namespace std;
+
+const size_t Arena::defaultBlockSize;
+
+// Smallest space an ArenaStream starts writing into.
+static const size_t minimumStreamSpace = 256;
+
+Arena::Arena(size_t blockSize) : offset(0), used(0), blockSize(std::max<size_t>(blockSize, 1)) {
+	blocks.push_back(Block{new char[this->blockSize], this->blockSize});
+}
+
+Arena::~Arena() {
+	for(Block &block : blocks) {
+		delete[] block.data;
+	}
+}
+
+void *Arena::allocate(size_t size, size_t alignment) {
+	Block *block = &blocks.back();
+	size_t start = (offset + alignment - 1) & ~(alignment - 1);
+	if(start + size > block->size) {
+		// A new block, at least twice the last, so a growing request needs few of them.
+		size_t newSize = std::max(block->size * 2, size + alignment);
+		used += offset;
+		blocks.push_back(Block{new char[newSize], newSize});
+		block = &blocks.back();
+		start = 0;
+	}
+	offset = start + size;
+	return block->data + start;
+}
+
+std::string_view Arena::copy(std::string_view text) {
+	char *data = (char *)allocate(text.size(), 1);
+	memcpy(data, text.data(), text.size());
+	return std::string_view(data, text.size());
+}
+
+void Arena::reset() {
+	// A request that needed several blocks gets them as one from now on.
+	if(blocks.size() > 1) {
+		size_t total = 0;
+		for(Block &block : blocks) {
+			total += block.size;
+			delete[] block.data;
+		}
+		blocks.clear();
+		blocks.push_back(Block{new char[total], total});
+	}
+	offset = 0;
+	used = 0;
+}
+
+size_t Arena::getUsed() {
+	return used + offset;
+}
+
+size_t Arena::getCapacity() {
+	size_t total = 0;
+	for(Block &block : blocks) {
+		total += block.size;
+	}
+	return total;
+}
+
+ArenaStream::ArenaStream(Arena &arena) : std::ostream(NULL), buffer(arena) {
+	rdbuf(&buffer);
+}
+
+std::string_view ArenaStream::view() {
+	return buffer.view();
+}
+
+void ArenaStream::Buffer::grow(size_t more) {
+	size_t length = pptr() - pbase();
+	size_t size = std::max({minimumStreamSpace, (size_t)(epptr() - pbase()) * 2, length + more});
+	char *space = (char *)arena.allocate(size, 1);
+	if(length > 0) {
+		memcpy(space, pbase(), length);
+	}
+	setp(space, space + size);
+	pbump(length);
+}
+
+ArenaStream::Buffer::int_type ArenaStream::Buffer::overflow(int_type c) {
+	if(traits_type::eq_int_type(c, traits_type::eof())) {
+		return traits_type::not_eof(c);
+	}
+	if(pptr() == epptr()) {
+		grow(1);
+	}
+	*pptr() = traits_type::to_char_type(c);
+	pbump(1);
+	return c;
+}
+
+std::streamsize ArenaStream::Buffer::xsputn(const char *text, std::streamsize count) {
+	if(epptr() - pptr() < count) {
+		grow(count);
+	}
+	memcpy(pptr(), text, count);
+	pbump(count);
+	return count;
+}
@@ -0,0 +1,85 @@
+// Class Arena
+// Computer Science, MVNU
+//
+// An Arena hands out memory for the temporaries of one request by bumping a
+// pointer through a block, and frees all of it at once with reset() when the
+// reply has gone. The memory is kept for the next request: once the blocks
+// have grown to hold the largest request seen (reset joins them into one),
+// requests take no memory from the heap at all. Nothing in an arena has its
+// destructor run, so it holds plain bytes: text, and views of it.
+//
+// An ArenaStream is an output stream writing into an arena, for building a
+// reply with << as a stringstream would, without allocating.
+
+#ifndef Arena_H
+#define Arena_H
+
+#include <cstddef>
+#include <ostream>
+#include <streambuf>
+#include <string_view>
+#include <vector>
+
+class Arena {
+ public:
+   // Default size of the first block.
+   static const size_t defaultBlockSize = 64 * 1024;
+
+   Arena(size_t blockSize = defaultBlockSize);
+   ~Arena();
+   Arena(const Arena &) = delete;
+   Arena &operator=(const Arena &) = delete;
+
+   // Get size bytes, aligned to alignment (a power of two), valid until the next reset.
+   void *allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+
+   // Copy text into the arena.
+   std::string_view copy(std::string_view text);
+
+   // Free everything allocated, keeping the memory for reuse.
+   void reset();
+
+   // Bytes allocated since the last reset, and bytes held.
+   size_t getUsed();
+   size_t getCapacity();
+
+ private:
+   struct Block {
+      char *data;
+      size_t size;
+   };
+
+   std::vector<Block> blocks;	// The last block is the one being filled.
+   size_t offset;				// Bytes used in the last block.
+   size_t used;				// Bytes used in the full blocks before it.
+   size_t blockSize;
+};
+
+class ArenaStream : public std::ostream {
+ public:
+   ArenaStream(Arena &arena);
+
+   // What has been written, valid until the arena is reset.
+   std::string_view view();
+
+ private:
+   class Buffer : public std::streambuf {
+    public:
+      Buffer(Arena &arena) : arena(arena) {}
+      std::string_view view() { return std::string_view(pbase(), pptr() - pbase()); }
+
+    protected:
+      int_type overflow(int_type c);
+      std::streamsize xsputn(const char *text, std::streamsize count);
+
+    private:
+      Arena &arena;
+
+      // Move what has been written to a larger space in the arena, with room for at least more bytes.
+      void grow(size_t more);
+   };
+
+   Buffer buffer;
+};
+
+#endif //Arena_H
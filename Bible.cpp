@@ -4,38 +4,161 @@
 #include "Ref.h"
 #include "Verse.h"
 #include "Bible.h"
+#include "Canon.h"
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <algorithm>
 #include <map>
+#include <set>
+#include <cstring>
+#include <thread>
+#include <atomic>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/stat.h>
 using namespace std;
 
+const size_t Bible::readAheadBytes;
+
+// Environment variable naming a version manifest to use instead of the built-in versions.
+static const char *manifestVariable = "BIBLE_MANIFEST";
+
+// Threads one Bible operation may use (see Bible::setThreads), 0 for one per core.
+static std::atomic<unsigned> operationThreads(0);
+
+// Versions whose references do not follow the standard canon (see Canon.h).
+static std::set<std::string> &noncanonicalVersions() {
+	static std::set<std::string> versions;
+	return versions;
+}
+
+// Read a manifest file into a map of version identifiers to file paths.
+// Each non-empty line not starting with # is "<version> <path>", or
+// "%noncanonical [version...]" to mark versions (by default all of them) as not following the canon.
+// Relative paths are taken relative to the directory containing the manifest.
+static bool readManifest(const std::string &path, std::map<std::string, std::string> &versions, std::set<std::string> &noncanonical) {
+	ifstream manifest(path);
+	if(!manifest) {
+		return false;
+	}
+
+	// Directory of the manifest, including the trailing slash.
+	std::string::size_type slash = path.find_last_of('/');
+	std::string directory = (slash == std::string::npos) ? "" : path.substr(0, slash + 1);
+
+	std::string line;
+	while(getline(manifest, line)) {
+		std::string version = GetNextToken(line, " \t");
+		if(version.empty() || version[0] == '#') {
+			continue;
+		}
+		if(version == "%noncanonical") {
+			std::string marked;
+			bool all = true;
+			while(!(marked = GetNextToken(line, " \t\r")).empty()) {
+				noncanonical.insert(marked);
+				all = false;
+			}
+			if(all) {
+				noncanonical.insert("*");
+			}
+			continue;
+		}
+
+		// The rest of the line (minus surrounding whitespace) is the path.
+		std::string::size_type start = line.find_first_not_of(" \t");
+		std::string::size_type end = line.find_last_not_of(" \t\r");
+		if(start == std::string::npos) {
+			return false;
+		}
+		std::string file = line.substr(start, end - start + 1);
+		versions[version] = (file[0] == '/') ? file : directory + file;
+	}
+
+	// A bare directive covers every version.
+	if(noncanonical.erase("*")) {
+		for(const auto &entry : versions) {
+			noncanonical.insert(entry.first);
+		}
+	}
+	return !versions.empty();
+}
+
 // Map of Bible version short names to files.
-static std::map<std::string, std::string> bibleVersions = {
-	{"kjv", "/home/class/csc3004/Bibles/kjv-complete"},
-	{"web", "/home/class/csc3004/Bibles/web-complete"},
-	{"dby", "/home/class/csc3004/Bibles/dby-complete"},
-	{"webster", "/home/class/csc3004/Bibles/webster-complete"},
-	{"ylt", "/home/class/csc3004/Bibles/ylt-complete"},
-};
+// Uses the manifest named by BIBLE_MANIFEST if set, otherwise the class Bibles.
+static std::map<std::string, std::string> &bibleVersions() {
+	static std::map<std::string, std::string> versions = {
+		{"kjv", "/home/class/csc3004/Bibles/kjv-complete"},
+		{"web", "/home/class/csc3004/Bibles/web-complete"},
+		{"dby", "/home/class/csc3004/Bibles/dby-complete"},
+		{"webster", "/home/class/csc3004/Bibles/webster-complete"},
+		{"ylt", "/home/class/csc3004/Bibles/ylt-complete"},
+	};
+	static bool checkedEnvironment = false;
+
+	if(!checkedEnvironment) {
+		checkedEnvironment = true;
+		const char *manifest = getenv(manifestVariable);
+		if(manifest && *manifest) {
+			std::map<std::string, std::string> loaded;
+			std::set<std::string> noncanonical;
+			if(readManifest(manifest, loaded, noncanonical)) {
+				versions = loaded;
+				noncanonicalVersions() = noncanonical;
+			}
+			else {
+				cerr << "Could not read Bible manifest: " << manifest << endl;
+			}
+		}
+	}
+
+	return versions;
+}
+
+bool Bible::loadManifest(const std::string &path) {
+	std::map<std::string, std::string> loaded;
+	std::set<std::string> noncanonical;
+	if(!readManifest(path, loaded, noncanonical)) {
+		return false;
+	}
+	bibleVersions() = loaded;
+	noncanonicalVersions() = noncanonical;
+	return true;
+}
 
 std::string Bible::getDefaultVersion() {
-	return "web";
+	// Prefer web, but a manifest may not provide it.
+	if(versionExists("web") || bibleVersions().empty()) {
+		return "web";
+	}
+	return bibleVersions().begin()->first;
+}
+
+void Bible::setThreads(unsigned threads) {
+	operationThreads = threads;
+}
+
+unsigned Bible::getThreads() {
+	return operationThreads;
+}
+
+bool Bible::versionFollowsCanon(const std::string &version) {
+	bibleVersions();
+	return versionExists(version) && noncanonicalVersions().count(version) == 0;
 }
 
 bool Bible::versionExists(std::string version) {
-	return bibleVersions.count(version) > 0;
+	return bibleVersions().count(version) > 0;
 }
 
 std::string Bible::getVersionFile(std::string version) {
-	return versionExists(version) ? bibleVersions.at(version) : "";
+	return versionExists(version) ? bibleVersions().at(version) : "";
 }
 
 std::list<std::string> Bible::getVersionList() {
 	std::list<std::string> result;
-	for(auto const &pair : bibleVersions) {
+	for(auto const &pair : bibleVersions()) {
 		result.push_back(pair.first);
 	}
 	return result;
@@ -45,12 +168,37 @@ std::list<std::string> Bible::getVersionList() {
 Bible::Bible() : Bible(getVersionFile(getDefaultVersion())) {}
 
 // Constructor – pass bible filename
-Bible::Bible(const string s) : infile(s), isValid(false) {
-	// Open the file and build the index if possible.
-	instream.open(infile, ios::in);
-	if(instream) {
-		isValid = true;
-		buildIndex();
+Bible::Bible(const string s, StorageMode mode, IndexMode indexing) : infile(s), isValid(false), textIndexReady(false), similarityIndexReady(false),
+		fullIndexReady(false), lazyBytes(0), outsideCanon(0), missingCanon(0) {
+	// Taken first, so a file changed while it is read is never stamped as the new contents.
+	stamp = fileStamp(infile);
+
+	// Set up the verse text storage, then index the text it holds.
+	if(mode == STORAGE_COMPRESSED) {
+		instream.open(infile, ios::in);
+		if(!instream) {
+			return;
+		}
+		CompressedVerseStore *compressed = new CompressedVerseStore(instream);
+		store.reset(compressed);
+		isValid = compressed->valid();
+		instream.close();
+	}
+	else {
+		FileVerseStore *file = new FileVerseStore(infile);
+		store.reset(file);
+		isValid = file->valid();
+	}
+	if(!isValid) {
+		return;
+	}
+
+	// A lazy index starts from the book at the start of each chunk, unless the text is not in book order.
+	if(indexing == INDEX_LAZY && findChunkBooks()) {
+		books.reset(new BookIndex[Ref::MAX_BOOK_ID + 1]);
+	}
+	else {
+		buildFullIndex();
 	}
 }
 
@@ -58,26 +206,319 @@ bool Bible::valid() {
 	return isValid;
 }
 
+std::string Bible::fileStamp(const std::string &file) {
+	struct stat info;
+	if(stat(file.c_str(), &info) != 0) {
+		return "";
+	}
+	return std::to_string(info.st_size) + "." + std::to_string(info.st_mtim.tv_sec) + "." + std::to_string(info.st_mtim.tv_nsec);
+}
+
+const uint64_t Bible::noOffset;
+
+// Parse the Ref of every non-empty line of a chunk, adding it and the line's offset to found.
+static void chunkLineRefs(const VerseStore::Chunk &chunk, std::vector<std::pair<Ref, uint64_t>> &found) {
+	const char *line = chunk.text, *end = chunk.text + chunk.length;
+	while(line < end) {
+		const char *newline = (const char *)memchr(line, '\n', end - line);
+		const char *lineEnd = newline ? newline : end;
+		// If there's something here with a Ref in range, add it to the index (no request can name any other).
+		if(lineEnd > line) {
+			std::string_view text(line, lineEnd - line);
+			Ref ref;
+			if(Ref::parse(text, ref)) {
+				found.push_back(std::make_pair(ref, chunk.offset + (line - chunk.text)));
+			}
+		}
+		line = lineEnd + 1;
+	}
+}
+
+// Sort (Ref, offset) entries by Ref, keeping only the last line for any repeated Ref. Files are usually in order already.
+static void uniqueRefs(std::vector<std::pair<Ref, uint64_t>> &entries, std::vector<Ref> &refs, std::vector<uint64_t> &positions) {
+	auto byRef = [](const std::pair<Ref, uint64_t> &a, const std::pair<Ref, uint64_t> &b) {
+		return a.first < b.first;
+	};
+	if(!std::is_sorted(entries.begin(), entries.end(), byRef)) {
+		std::stable_sort(entries.begin(), entries.end(), byRef);
+	}
+	for(size_t i = 0; i < entries.size(); i++) {
+		if(i + 1 < entries.size() && entries[i + 1].first == entries[i].first) {
+			continue;
+		}
+		refs.push_back(entries[i].first);
+		positions.push_back(entries[i].second);
+	}
+}
+
+std::vector<std::pair<Ref, uint64_t>> Bible::lineRefs(VerseStore &store, unsigned threads) {
+	// Each chunk's lines are parsed by whichever thread takes it, into the chunk's own list.
+	size_t chunks = store.chunkCount();
+	std::vector<std::vector<std::pair<Ref, uint64_t>>> found(chunks);
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		std::string buffer;
+		for(size_t c; (c = next++) < chunks;) {
+			chunkLineRefs(store.getChunk(c, buffer), found[c]);
+		}
+	};
+
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::max<size_t>(1, std::min<size_t>(threads, chunks));
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+
+	// Join the chunks back together in file order.
+	size_t total = 0;
+	for(const std::vector<std::pair<Ref, uint64_t>> &lines : found) {
+		total += lines.size();
+	}
+	std::vector<std::pair<Ref, uint64_t>> entries;
+	entries.reserve(total);
+	for(const std::vector<std::pair<Ref, uint64_t>> &lines : found) {
+		entries.insert(entries.end(), lines.begin(), lines.end());
+	}
+	return entries;
+}
+
 void Bible::buildIndex() {
+	std::vector<std::pair<Ref, uint64_t>> entries = lineRefs(*store, operationThreads);
+
+	std::vector<Ref> refs;
+	std::vector<uint64_t> positions;
+	uniqueRefs(entries, refs, positions);
+
+	// Compare with the canon; refs are unique, so the canon refs present are counted once each.
+	outsideCanon = 0;
+	for(const Ref &ref : refs) {
+		if(!Canon::contains(ref)) {
+			outsideCanon++;
+		}
+	}
+	missingCanon = Canon::totalVerses - (refs.size() - outsideCanon);
+
+	buildChapters(refs);
+
+	// Use the shared table, recording offsets for what it has and keeping the rest as extras.
+	versification = Versification::share(refs);
+	offsets.assign(versification->size(), noOffset);
+	for(size_t i = 0; i < refs.size(); i++) {
+		size_t ordinal = versification->find(refs[i]);
+		if(ordinal != Versification::npos) {
+			offsets[ordinal] = positions[i];
+		}
+		else {
+			extras.push_back(std::make_pair(refs[i], positions[i]));
+		}
+	}
+}
+
+void Bible::buildFullIndex() {
+	std::call_once(fullIndexOnce, [this]() {
+		buildIndex();
+		fullIndexReady = true;
+	});
+}
+
+// A book id a lazy index (or the book completer) can hold.
+static bool indexableBook(Ref::book_id book) {
+	return book >= Ref::MIN_BOOK_ID && book <= Ref::MAX_BOOK_ID;
+}
+
+bool Bible::findChunkBooks() {
 	std::string buffer;
+	std::vector<std::pair<Ref, uint64_t>> lines;
+	for(size_t c = 0; c < store->chunkCount(); c++) {
+		// Only the first non-empty line matters; a chunk without one belongs with the chunk before it.
+		VerseStore::Chunk chunk = store->getChunk(c, buffer);
+		size_t skip = 0;
+		while(skip < chunk.length && chunk.text[skip] == '\n') {
+			skip++;
+		}
+		const char *newline = (const char *)memchr(chunk.text + skip, '\n', chunk.length - skip);
+		VerseStore::Chunk first = {chunk.offset + skip, chunk.text + skip, newline ? newline - (chunk.text + skip) : chunk.length - skip};
+		lines.clear();
+		chunkLineRefs(first, lines);
 
-	// Start counting at beginning of file.
-	std::streampos position = instream.tellg();
+		Ref::book_id book = lines.empty() ? (chunkBooks.empty() ? Ref::MIN_BOOK_ID : chunkBooks.back()) : lines.front().first.getBook();
+		if(!indexableBook(book) || (!chunkBooks.empty() && book < chunkBooks.back())) {
+			chunkBooks.clear();
+			return false;
+		}
+		chunkBooks.push_back(book);
+	}
+	return true;
+}
+
+const Bible::BookIndex *Bible::bookIndex(Ref::book_id book) {
+	if(!books || fullIndexReady) {
+		return NULL;
+	}
+	if(!indexableBook(book)) {
+		// Never built, so always empty.
+		return &books[0];
+	}
 
-	while(getline(instream, buffer)) {
-		// If there's something here, parse the Ref and add it to the index.
-		if(!buffer.empty()) {
-			Ref ref(buffer);
-			index[ref] = position;
+	BookIndex &index = books[book];
+	std::call_once(index.once, [this, book, &index]() {
+		// The book's lines are in the chunks from the last starting before it through the last starting in it.
+		size_t first = std::lower_bound(chunkBooks.begin(), chunkBooks.end(), book) - chunkBooks.begin();
+		size_t end = std::upper_bound(chunkBooks.begin(), chunkBooks.end(), book) - chunkBooks.begin();
+		first = first > 0 ? first - 1 : 0;
+
+		std::string buffer;
+		std::vector<std::pair<Ref, uint64_t>> lines, entries;
+		for(size_t c = first; c < end; c++) {
+			chunkLineRefs(store->getChunk(c, buffer), lines);
+		}
+		for(size_t i = 0; i < lines.size(); i++) {
+			// Out of book order after all: give up on the lazy index.
+			if(!indexableBook(lines[i].first.getBook()) || (i > 0 && lines[i].first.getBook() < lines[i - 1].first.getBook())) {
+				buildFullIndex();
+				return;
+			}
+			if(lines[i].first.getBook() == book) {
+				entries.push_back(lines[i]);
+			}
 		}
+		uniqueRefs(entries, index.refs, index.offsets);
+		lazyBytes += index.refs.capacity() * sizeof(Ref) + index.offsets.capacity() * sizeof(uint64_t);
+	});
+
+	// The full index may have taken over while this book was being read.
+	return fullIndexReady ? NULL : &index;
+}
 
-		// Record position for the next loop.
-		position = instream.tellg();
+bool Bible::lazyNeighbor(const Ref &ref, bool forward, Ref &neighbor, LookupResult &status) {
+	const BookIndex *index = bookIndex(ref.getBook());
+	if(!index) {
+		return false;
 	}
+
+	// Later or earlier in the same book.
+	std::vector<Ref>::const_iterator it = forward ? std::upper_bound(index->refs.begin(), index->refs.end(), ref)
+		: std::lower_bound(index->refs.begin(), index->refs.end(), ref);
+	if(forward ? it != index->refs.end() : it != index->refs.begin()) {
+		neighbor = forward ? *it : *(it - 1);
+		status = SUCCESS;
+		return true;
+	}
+
+	// Otherwise the first or last of the nearest book present in that direction.
+	int step = forward ? 1 : -1;
+	for(int book = ref.getBook() + step; indexableBook(book); book += step) {
+		if(!(index = bookIndex(book))) {
+			return false;
+		}
+		if(!index->refs.empty()) {
+			neighbor = forward ? index->refs.front() : index->refs.back();
+			status = SUCCESS;
+			return true;
+		}
+	}
+	neighbor = Ref();
+	status = NO_BOOK;
+	return true;
+}
+
+void Bible::buildChapters(const std::vector<Ref> &refs) {
+	chapters.clear();
+	chapterSlots.assign(Ref::MAX_BOOK_ID * Ref::MAX_CHAPTER_ID, 0);
+	for(const Ref &ref : refs) {
+		// Refs outside the limits cannot be navigated to.
+		if(ref.getBook() < Ref::MIN_BOOK_ID || ref.getBook() > Ref::MAX_BOOK_ID
+				|| ref.getChapter() < Ref::MIN_CHAPTER_ID || ref.getChapter() > Ref::MAX_CHAPTER_ID) {
+			continue;
+		}
+		if(chapters.empty() || chapters.back().first.getBook() != ref.getBook() || chapters.back().first.getChapter() != ref.getChapter()) {
+			chapters.push_back(Chapter{ref, ref, 0});
+			chapterSlots[(ref.getBook() - 1) * Ref::MAX_CHAPTER_ID + ref.getChapter() - 1] = chapters.size();
+		}
+		chapters.back().last = ref;
+		chapters.back().verses++;
+	}
+
+	// Each book starts at its first chapter, or where the next book present does.
+	bookChapters.assign(Ref::MAX_BOOK_ID + 2, chapters.size());
+	for(size_t i = chapters.size(); i-- > 0;) {
+		bookChapters[chapters[i].first.getBook()] = i;
+	}
+	for(int book = Ref::MAX_BOOK_ID; book >= 0; book--) {
+		bookChapters[book] = std::min(bookChapters[book], bookChapters[book + 1]);
+	}
+}
+
+size_t Bible::findChapter(const Ref &ref, LookupResult &status) {
+	buildFullIndex();
+	Ref::book_id book = ref.getBook();
+	Ref::chapter_id chapter = ref.getChapter();
+	if(book < Ref::MIN_BOOK_ID || book > Ref::MAX_BOOK_ID || bookChapters.empty() || bookChapters[book] == bookChapters[book + 1]) {
+		status = NO_BOOK;
+		return 0;
+	}
+	if(chapter < Ref::MIN_CHAPTER_ID || chapter > Ref::MAX_CHAPTER_ID || chapterSlots[(book - 1) * Ref::MAX_CHAPTER_ID + chapter - 1] == 0) {
+		status = NO_CHAPTER;
+		return 0;
+	}
+	status = SUCCESS;
+	return chapterSlots[(book - 1) * Ref::MAX_CHAPTER_ID + chapter - 1] - 1;
+}
+
+bool Bible::canonMismatches(size_t &outside, size_t &missing) {
+	buildFullIndex();
+	outside = outsideCanon;
+	missing = missingCanon;
+	return outside != 0 || missing != 0;
+}
+
+// Compare an extra to a Ref, for searching the sorted extras.
+static bool extraBefore(const std::pair<Ref, uint64_t> &extra, const Ref &ref) {
+	return extra.first < ref;
+}
+
+bool Bible::findOffset(const Ref &ref, uint64_t &offset) {
+	if(const BookIndex *index = bookIndex(ref.getBook())) {
+		std::vector<Ref>::const_iterator it = std::lower_bound(index->refs.begin(), index->refs.end(), ref);
+		if(it != index->refs.end() && *it == ref) {
+			offset = index->offsets[it - index->refs.begin()];
+			return true;
+		}
+		return false;
+	}
+
+	if(!versification) {
+		return false;
+	}
+
+	size_t ordinal = versification->find(ref);
+	if(ordinal != Versification::npos) {
+		offset = offsets[ordinal];
+		return offset != noOffset;
+	}
+
+	std::vector<std::pair<Ref, uint64_t>>::iterator it = std::lower_bound(extras.begin(), extras.end(), ref, extraBefore);
+	if(it != extras.end() && it->first == ref) {
+		offset = it->second;
+		return true;
+	}
+	return false;
+}
+
+bool Bible::hasRef(const Ref &ref) {
+	uint64_t offset;
+	return findOffset(ref, offset);
 }
 
 LookupResult Bible::getRefLookupStatus(Ref ref) {
-	if(index.count(ref)) {
+	if(hasRef(ref)) {
 		// Ref exists.
 		return SUCCESS;
 	}
@@ -90,9 +531,9 @@ LookupResult Bible::getRefLookupStatus(Ref ref) {
 		 * and if they both exist then it's the verse that doesn't exist.
 		 */
 		Ref bookTest(ref.getBook(), Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID);
-		if(index.count(bookTest)) {
+		if(hasRef(bookTest)) {
 			Ref chapterTest(ref.getBook(), ref.getChapter(), Ref::MIN_VERSE_ID);
-			if(index.count(chapterTest)) {
+			if(hasRef(chapterTest)) {
 				return NO_VERSE;
 			}
 			else {
@@ -105,17 +546,14 @@ LookupResult Bible::getRefLookupStatus(Ref ref) {
 	}
 }
 
-const Verse Bible::lookup(Ref ref, LookupResult& status) {
+Verse Bible::lookup(Ref ref, LookupResult& status) {
 	// Check that the ref exists in the index.
+	uint64_t offset;
 	status = getRefLookupStatus(ref);
-	if(status == SUCCESS) {
-		// Reset and seek to the Ref's position in the file according to the index.
-		instream.clear();
-		instream.seekg(index[ref]);
-
-		// Get the verse line.
+	if(status == SUCCESS && findOffset(ref, offset)) {
+		// Get the verse line at the Ref's position in the file according to the index.
 		std::string buffer;
-		getline(instream, buffer);
+		store->readLine(offset, buffer);
 
 		// If we couldn't get anything, set failure status.
 		if(buffer.empty()) {
@@ -131,49 +569,398 @@ const Verse Bible::lookup(Ref ref, LookupResult& status) {
 	}
 }
 
+std::string_view Bible::lookupText(Ref ref, Arena &arena, LookupResult& status) {
+	uint64_t offset;
+	std::string_view line;
+	status = getRefLookupStatus(ref);
+	if(status != SUCCESS || !findOffset(ref, offset)) {
+		return std::string_view();
+	}
+	if(!store->readLine(offset, arena, line) || line.empty()) {
+		status = OTHER;
+	}
+	return Verse::textOf(line);
+}
+
+// Read ahead the text after the given ref
+void Bible::readAhead(const Ref &ref) {
+	// Text follows reference order within a book, so the bytes after a verse are the verses after it.
+	uint64_t offset;
+	if(isValid && findOffset(ref, offset)) {
+		store->prefetch(offset, readAheadBytes);
+	}
+}
+
 // Return the reference after the given ref
-const Ref Bible::next(Ref ref, LookupResult& status) {
+Ref Bible::next(Ref ref, LookupResult& status) {
 	// Ensure the initial Ref exists.
 	status = getRefLookupStatus(ref);
 	if(status != SUCCESS)
 		return Ref();
 
-	// Get an iterator to the Ref, increment it, and if that works, return the next key Ref.
-	std::map<Ref, std::streampos>::iterator it = index.find(ref);
-	if(++it != index.end()) {
+	Ref neighbor;
+	if(lazyNeighbor(ref, true, neighbor, status)) {
+		return neighbor;
+	}
+
+	// The next Ref is the earlier of the next shared Ref this version has and the next extra.
+	size_t ordinal = versification->upperBound(ref);
+	while(ordinal < offsets.size() && offsets[ordinal] == noOffset) {
+		ordinal++;
+	}
+	std::vector<std::pair<Ref, uint64_t>>::iterator extra = std::upper_bound(extras.begin(), extras.end(), ref,
+		[](const Ref &r, const std::pair<Ref, uint64_t> &e) { return r < e.first; });
+
+	if(ordinal < offsets.size() && (extra == extras.end() || versification->at(ordinal) < extra->first)) {
 		status = SUCCESS;
-		return it->first;
+		return versification->at(ordinal);
+	}
+	else if(extra != extras.end()) {
+		status = SUCCESS;
+		return extra->first;
 	}
 	else {
-		// No next iterator, no next book.
+		// No next Ref, no next book.
 		status = NO_BOOK;
 		return Ref();
 	}
 }
 
 // Return the reference before the given ref
-const Ref Bible::prev(Ref ref, LookupResult& status) {
+Ref Bible::prev(Ref ref, LookupResult& status) {
 	// Ensure the initial Ref exists.
 	status = getRefLookupStatus(ref);
 	if(status != SUCCESS)
 		return Ref();
 
-	// Get an iterator to the Ref, check if it is not the first, and if so, return the prev key Ref.
-	std::map<Ref, std::streampos>::iterator it = index.find(ref);
-	if(it != index.begin()) {
-		--it;
+	Ref neighbor;
+	if(lazyNeighbor(ref, false, neighbor, status)) {
+		return neighbor;
+	}
+
+	// The previous Ref is the later of the previous shared Ref this version has and the previous extra.
+	size_t ordinal = versification->lowerBound(ref);
+	while(ordinal > 0 && offsets[ordinal - 1] == noOffset) {
+		ordinal--;
+	}
+	std::vector<std::pair<Ref, uint64_t>>::iterator extra = std::lower_bound(extras.begin(), extras.end(), ref, extraBefore);
+
+	bool haveShared = ordinal > 0, haveExtra = extra != extras.begin();
+	if(haveShared && (!haveExtra || (extra - 1)->first < versification->at(ordinal - 1))) {
 		status = SUCCESS;
-		return it->first;
+		return versification->at(ordinal - 1);
+	}
+	else if(haveExtra) {
+		status = SUCCESS;
+		return (extra - 1)->first;
 	}
 	else {
-		// No previous iterator, no previous book.
+		// No previous Ref, no previous book.
+		status = NO_BOOK;
+		return Ref();
+	}
+}
+
+std::vector<Verse> Bible::lookupRange(Ref first, Ref last, size_t limit, LookupResult& status) {
+	std::vector<Verse> verses;
+	if(isValid) {
+		buildFullIndex();
+	}
+	if(!versification) {
+		status = OTHER;
+		return verses;
+	}
+
+	// Merge the shared references this version has in the range with its extras in the range.
+	size_t ordinal = versification->lowerBound(first), end = versification->upperBound(last);
+	std::vector<std::pair<Ref, uint64_t>>::iterator extra = std::lower_bound(extras.begin(), extras.end(), first, extraBefore);
+	std::string buffer;
+	while(verses.size() < limit) {
+		while(ordinal < end && offsets[ordinal] == noOffset) {
+			ordinal++;
+		}
+		bool haveShared = ordinal < end, haveExtra = extra != extras.end() && !(last < extra->first);
+		if(!haveShared && !haveExtra) {
+			break;
+		}
+
+		uint64_t offset;
+		if(haveShared && (!haveExtra || versification->at(ordinal) < extra->first)) {
+			offset = offsets[ordinal++];
+		}
+		else {
+			offset = (extra++)->second;
+		}
+		store->readLine(offset, buffer);
+		verses.push_back(Verse(buffer));
+	}
+
+	status = verses.empty() ? getRefLookupStatus(first) : SUCCESS;
+	if(verses.empty() && status == SUCCESS) {
+		status = OTHER;
+	}
+	return verses;
+}
+
+Ref Bible::nextChapter(Ref ref, LookupResult& status) {
+	size_t chapter = findChapter(ref, status);
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	if(chapter + 1 >= chapters.size()) {
+		status = NO_BOOK;
+		return Ref();
+	}
+	return chapters[chapter + 1].first;
+}
+
+Ref Bible::prevChapter(Ref ref, LookupResult& status) {
+	size_t chapter = findChapter(ref, status);
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	if(chapter == 0) {
+		status = NO_BOOK;
+		return Ref();
+	}
+	return chapters[chapter - 1].first;
+}
+
+Ref Bible::nextBook(Ref ref, LookupResult& status) {
+	findChapter(ref, status);
+	if(status == NO_CHAPTER) {
+		// Only the book needs to exist.
+		status = SUCCESS;
+	}
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	size_t chapter = bookChapters[ref.getBook() + 1];
+	if(chapter >= chapters.size()) {
+		status = NO_BOOK;
+		return Ref();
+	}
+	return chapters[chapter].first;
+}
+
+Ref Bible::prevBook(Ref ref, LookupResult& status) {
+	findChapter(ref, status);
+	if(status == NO_CHAPTER) {
+		status = SUCCESS;
+	}
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	// The chapter before this book's first is the last of the previous book present.
+	size_t chapter = bookChapters[ref.getBook()];
+	if(chapter == 0) {
 		status = NO_BOOK;
 		return Ref();
 	}
+	return chapters[bookChapters[chapters[chapter - 1].first.getBook()]].first;
+}
+
+size_t Bible::chapterBounds(Ref ref, Ref &first, Ref &last, LookupResult& status) {
+	size_t chapter = findChapter(ref, status);
+	if(status != SUCCESS) {
+		first = last = Ref();
+		return 0;
+	}
+	first = chapters[chapter].first;
+	last = chapters[chapter].last;
+	return chapters[chapter].verses;
+}
+
+void Bible::forEachVerse(const std::function<void(const Ref &, const std::string &)> &visit) {
+	if(!isValid) {
+		return;
+	}
+	buildFullIndex();
+
+	// Merge the shared references this version has with its extras, in reference order.
+	std::string buffer;
+	size_t ordinal = 0, extra = 0;
+	for(;;) {
+		while(ordinal < offsets.size() && offsets[ordinal] == noOffset) {
+			ordinal++;
+		}
+		bool haveShared = ordinal < offsets.size(), haveExtra = extra < extras.size();
+		if(!haveShared && !haveExtra) {
+			break;
+		}
+
+		uint64_t offset;
+		if(haveShared && (!haveExtra || versification->at(ordinal) < extras[extra].first)) {
+			offset = offsets[ordinal++];
+		}
+		else {
+			offset = extras[extra++].second;
+		}
+
+		if(store->readLine(offset, buffer)) {
+			Verse verse(buffer);
+			visit(verse.getRef(), verse.getVerse());
+		}
+	}
+}
+
+void Bible::buildTextIndex() {
+	std::call_once(textIndexOnce, [this]() {
+		TextIndex *index = new TextIndex();
+		forEachVerse([index](const Ref &ref, const std::string &text) {
+			index->addVerse(ref, text);
+		});
+		index->finish(operationThreads);
+		textIndex.reset(index);
+		textIndexReady = true;
+	});
+}
+
+void Bible::buildSimilarityIndex() {
+	std::call_once(similarityIndexOnce, [this]() {
+		SimilarityIndex *index = new SimilarityIndex();
+		forEachVerse([index](const Ref &ref, const std::string &text) {
+			index->addVerse(ref, text);
+		});
+		index->finish();
+		similarityIndex.reset(index);
+		similarityIndexReady = true;
+	});
+}
+
+std::vector<SimilarityIndex::Match> Bible::similar(const std::string &text, const Ref &exclude, size_t limit, LookupResult& status) {
+	if(!isValid) {
+		status = OTHER;
+		return std::vector<SimilarityIndex::Match>();
+	}
+
+	buildSimilarityIndex();
+	status = SUCCESS;
+	return similarityIndex->similar(text, limit, exclude, operationThreads);
+}
+
+std::vector<Ref> Bible::search(const std::string &query, size_t limit, LookupResult& status) {
+	if(!isValid) {
+		status = OTHER;
+		return std::vector<Ref>();
+	}
+
+	buildTextIndex();
+	status = SUCCESS;
+	return textIndex->search(query, limit);
+}
+
+std::vector<Ref> Bible::searchPhrase(const std::string &phrase, size_t limit, LookupResult& status) {
+	if(!isValid) {
+		status = OTHER;
+		return std::vector<Ref>();
+	}
+
+	buildTextIndex();
+	status = SUCCESS;
+	return textIndex->phrase(phrase, limit);
+}
+
+std::vector<Ref> Bible::searchNear(const std::string &query, unsigned distance, size_t limit, LookupResult& status) {
+	if(!isValid) {
+		status = OTHER;
+		return std::vector<Ref>();
+	}
+
+	buildTextIndex();
+	status = SUCCESS;
+	return textIndex->near(query, distance, limit);
+}
+
+std::vector<std::string> Bible::completeWord(const std::string &prefix, size_t limit, LookupResult& status) {
+	if(!isValid) {
+		status = OTHER;
+		return std::vector<std::string>();
+	}
+
+	buildTextIndex();
+	status = SUCCESS;
+	return textIndex->complete(prefix, limit);
+}
+
+std::vector<Ref::book_id> Bible::completeBook(const std::string &prefix, size_t limit, LookupResult& status) {
+	std::vector<Ref::book_id> books;
+	if(!isValid) {
+		status = OTHER;
+		return books;
+	}
+
+	std::call_once(bookCompleterOnce, [this]() {
+		buildFullIndex();
+		std::vector<uint32_t> verses(Ref::MAX_BOOK_ID + 1, 0);
+		for(size_t ordinal = 0; ordinal < offsets.size(); ordinal++) {
+			if(offsets[ordinal] != noOffset && indexableBook(versification->at(ordinal).getBook())) {
+				verses[versification->at(ordinal).getBook()]++;
+			}
+		}
+		for(const std::pair<Ref, uint64_t> &extra : extras) {
+			if(indexableBook(extra.first.getBook())) {
+				verses[extra.first.getBook()]++;
+			}
+		}
+
+		std::vector<std::pair<std::string, uint32_t>> names;
+		std::vector<uint32_t> weights;
+		for(Ref::book_id book = Ref::MIN_BOOK_ID; book <= Ref::MAX_BOOK_ID; book++) {
+			if(verses[book] > 0) {
+				std::string name = Ref(book, Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID).getBookName();
+				std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+				names.push_back(std::make_pair(name, book));
+				weights.push_back(verses[book]);
+			}
+		}
+		bookCompleter = Completer(names, weights);
+	});
+
+	std::string lowered = prefix;
+	std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+	for(const Completer::Completion &completion : bookCompleter.complete(lowered, limit)) {
+		books.push_back(completion.id);
+	}
+	status = SUCCESS;
+	return books;
+}
+
+size_t Bible::textChunkCount() {
+	return isValid ? store->chunkCount() : 0;
+}
+
+void Bible::scanTextChunk(size_t chunk, const TextMatcher &matcher, std::vector<Ref> &found) {
+	std::call_once(offsetRefsOnce, [this]() {
+		buildFullIndex();
+		for(size_t ordinal = 0; ordinal < offsets.size(); ordinal++) {
+			if(offsets[ordinal] != noOffset) {
+				offsetRefs.push_back(std::make_pair(offsets[ordinal], versification->at(ordinal)));
+			}
+		}
+		for(const std::pair<Ref, uint64_t> &extra : extras) {
+			offsetRefs.push_back(std::make_pair(extra.second, extra.first));
+		}
+		std::sort(offsetRefs.begin(), offsetRefs.end());
+	});
+
+	std::string buffer;
+	VerseStore::Chunk text = store->getChunk(chunk, buffer);
+	std::vector<size_t> lineStarts;
+	matcher.matchLines(text.text, text.length, lineStarts);
+
+	// Map each matching line back to its Ref by offset (lines superseded by a repeated Ref are not indexed).
+	for(size_t lineStart : lineStarts) {
+		uint64_t offset = text.offset + lineStart;
+		std::vector<std::pair<uint64_t, Ref>>::iterator it = std::lower_bound(offsetRefs.begin(), offsetRefs.end(), std::make_pair(offset, Ref()));
+		if(it != offsetRefs.end() && it->first == offset) {
+			found.push_back(it->second);
+		}
+	}
 }
 
 // Return an error message string to describe status
-const string Bible::error(LookupResult status) {
+string Bible::error(LookupResult status) {
 	switch(status) {
 		case SUCCESS:
 			return "success";
@@ -183,6 +970,10 @@ const string Bible::error(LookupResult status) {
 			return "no such chapter";
 		case NO_VERSE:
 			return "no such verse";
+		case UNAVAILABLE:
+			return "lookup server unavailable";
+		case BUSY:
+			return "lookup server busy";
 		case OTHER:
 		default:
 			return "other error";
@@ -192,3 +983,16 @@ const string Bible::error(LookupResult status) {
 void Bible::display() {
 	cout << "Bible file: " << infile << endl;
 }
+
+size_t Bible::memoryUsage() {
+	// A lazy index counts only the books read so far.
+	size_t index = (books ? (Ref::MAX_BOOK_ID + 1) * sizeof(BookIndex) + chunkBooks.capacity() * sizeof(Ref::book_id) : 0) + lazyBytes;
+	if(fullIndexReady) {
+		// The shared table's memory is split between the versions using it.
+		index += versification->memoryUsage() / versification.use_count()
+			+ offsets.capacity() * sizeof(uint64_t) + extras.capacity() * sizeof(std::pair<Ref, uint64_t>)
+			+ chapters.capacity() * sizeof(Chapter) + (chapterSlots.capacity() + bookChapters.capacity()) * sizeof(uint16_t);
+	}
+	return sizeof(Bible) + infile.capacity() + index + (store ? store->memoryUsage() : 0)
+		+ (textIndexReady ? textIndex->memoryUsage() : 0) + (similarityIndexReady ? similarityIndex->memoryUsage() : 0) + offsetRefs.capacity() * sizeof(std::pair<uint64_t, Ref>) + bookCompleter.memoryUsage();
+}
@@ -8,9 +8,21 @@
 #ifndef Bible_H
 #define Bible_H
 
+#include "Arena.h"
 #include "Ref.h"
 #include "Verse.h"
+#include "Versification.h"
+#include "VerseStore.h"
+#include "TextIndex.h"
+#include "TextScan.h"
+#include "Similarity.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <cstdint>
 #include <map>
+#include <memory>
+#include <vector>
 #include <list>
 #include <iostream>
 #include <fstream>
@@ -20,48 +32,241 @@
 using namespace std;
 
 // status codes to be returned when looking up a reference
-enum LookupResult { SUCCESS, NO_BOOK, NO_CHAPTER, NO_VERSE, OTHER };
+// (UNAVAILABLE: a client could not reach the lookup server in time; BUSY: the server's queue was full)
+enum LookupResult { SUCCESS, NO_BOOK, NO_CHAPTER, NO_VERSE, OTHER, UNAVAILABLE, BUSY };
+
+// How a Bible keeps its verse text:
+// read from the file on each lookup, or held in memory compressed in blocks.
+enum StorageMode { STORAGE_FILE, STORAGE_COMPRESSED };
+
+// When a Bible indexes its verses: all at once when it is constructed, or each book on first access.
+// Lazy indexing expects text grouped by book in order, as version files are. It falls back to the full
+// index when it finds otherwise, but until then may miss lines of a book that sit among another book's.
+enum IndexMode { INDEX_FULL, INDEX_LAZY };
 
 class Bible {	// A class to represent a version of the bible
  private:
    string infile;		// file path name
-   ifstream instream;	// input stream, used when file is open
+   string stamp;		// fileStamp of the file, taken before reading it
+   ifstream instream;	// input stream, used while reading the text into a compressed store
    bool isValid;
 
+   // The verse text, read back by file offset.
+   std::unique_ptr<VerseStore> store;
+
+   // Full-text index, built on request.
+   std::unique_ptr<TextIndex> textIndex;
+   std::once_flag textIndexOnce;
+   std::atomic<bool> textIndexReady;
+
+   // TF-IDF vectors for finding similar verses, built on request.
+   std::unique_ptr<SimilarityIndex> similarityIndex;
+   std::once_flag similarityIndexOnce;
+   std::atomic<bool> similarityIndexReady;
+
+   // Every verse's file offset and Ref, sorted by offset, for mapping scan matches back to Refs.
+   std::vector<std::pair<uint64_t, Ref>> offsetRefs;
+   std::once_flag offsetRefsOnce;
+
+   // Prefix tree over the (lowercase) names of the books in this version, weighted by verse count.
+   Completer bookCompleter;
+   std::once_flag bookCompleterOnce;
+
    // The Ref -> position in file index.
-   std::map<Ref, std::streampos> index;
+   // References come from a Versification shared with other versions; offsets holds this
+   // version's file position for each of its ordinals (or noOffset if this version lacks it),
+   // and extras holds (sorted) the references this version has that the shared table does not.
+   std::shared_ptr<const Versification> versification;
+   std::vector<uint64_t> offsets;
+   std::vector<std::pair<Ref, uint64_t>> extras;
+   static const uint64_t noOffset = UINT64_MAX;
+
+   // Chapter directory, for chapter and book navigation in constant time: every chapter this version
+   // has in reference order, the position in it of each (book, chapter) plus one (0 if absent), and the
+   // position of each book's first chapter (or of the next book's, if the book is absent).
+   struct Chapter {
+      Ref first;
+      Ref last;
+      uint32_t verses;
+   };
+   std::vector<Chapter> chapters;
+   std::vector<uint16_t> chapterSlots;
+   std::vector<uint16_t> bookChapters;
+
+   // The full index is built once, at construction unless indexing lazily, and then used by everything.
+   std::once_flag fullIndexOnce;
+   std::atomic<bool> fullIndexReady;
+
+   // Lazy index: the book of the first line of each store chunk, which bounds the chunks holding each book,
+   // and each book's sorted, unique refs and their offsets, read from its chunks on first access.
+   // Whatever needs more than one book's verses (ranges, chapters, search, scans) builds the full index.
+   struct BookIndex {
+      std::once_flag once;
+      std::vector<Ref> refs;
+      std::vector<uint64_t> offsets;
+   };
+   std::vector<Ref::book_id> chunkBooks;
+   std::unique_ptr<BookIndex[]> books;	// By book id; null unless indexing lazily.
+   std::atomic<size_t> lazyBytes;
+
+   // Build the full index, if it has not been built yet.
+   void buildFullIndex();
+
+   // Find the book at the start of each chunk. Returns false if the chunks are not in book order.
+   bool findChunkBooks();
 
-   // Construct the index from an open input stream.
+   // Get a book's lazy index, reading it if needed. Returns NULL if the full index is in use.
+   const BookIndex *bookIndex(Ref::book_id book);
+
+   // Find the Ref after (or before) ref with the lazy index, setting status to SUCCESS or NO_BOOK if there is none.
+   // Returns false if the full index is in use.
+   bool lazyNeighbor(const Ref &ref, bool forward, Ref &neighbor, LookupResult &status);
+
+   // Build the chapter directory from this version's sorted, unique refs.
+   void buildChapters(const std::vector<Ref> &refs);
+
+   // Find the position of a ref's chapter in the directory, setting status to NO_BOOK or NO_CHAPTER if it is missing.
+   size_t findChapter(const Ref &ref, LookupResult &status);
+
+   // How this version differs from the standard canon: refs it has that the canon lacks, and canon refs it lacks.
+   size_t outsideCanon;
+   size_t missingCanon;
+
+   // Construct the index from the text in the store.
    void buildIndex();
 
+   // Find the file position of a Ref. Returns false if the Ref is not in this version.
+   bool findOffset(const Ref &ref, uint64_t &offset);
+
+   // Check if a Ref is in this version.
+   bool hasRef(const Ref &ref);
+
    // Get the lookup status of a particular Ref in the index.
    LookupResult getRefLookupStatus(Ref ref);
 
  public:
    Bible();	// Default constructor
-   Bible(const string s); // Constructor – pass name of bible file
+   Bible(const string s, StorageMode mode = STORAGE_FILE, IndexMode indexing = INDEX_FULL); // Constructor – pass name of bible file
 
    // Check if the Bible is valid after construction. Lookups can only be done if this is true.
    bool valid();
 
+   // The fileStamp of the Bible's file as it was read (a file changed since has another).
+   std::string getFileStamp() { return stamp; }
+
+   // Identify the current contents of a file by its size and modification time, or "" if it cannot be read.
+   static std::string fileStamp(const std::string &file);
+
+   // Check if the full index has been built (always, unless indexing lazily).
+   bool hasFullIndex() { return fullIndexReady; }
+
+   // Parse the Ref at the start of every non-empty line of a version's text, paired with the line's offset, in file order.
+   // The store's chunks are split at newlines with memchr and parsed on up to threads threads (0 for one per core).
+   static std::vector<std::pair<Ref, uint64_t>> lineRefs(VerseStore &store, unsigned threads = 0);
+
    // Look up a verse by ref in the Bible.
    // Sets status according to the result of the search, returns a dummy verse if the lookup was unsuccessful.
-   const Verse lookup(Ref ref, LookupResult& status);
+   Verse lookup(Ref ref, LookupResult& status);
+   // Look up just a verse's text (without its reference), as a view valid until arena is reset.
+   // Nothing is allocated beyond the arena, so a request handled this way costs no heap allocations.
+   std::string_view lookupText(Ref ref, Arena &arena, LookupResult& status);
    // Return the reference after the given ref
-   const Ref next(Ref ref, LookupResult& status);
+   Ref next(Ref ref, LookupResult& status);
    // Return the reference before the given ref
-   const Ref prev(Ref ref, LookupResult& status);
+   Ref prev(Ref ref, LookupResult& status);
+
+   // Bytes of text after a verse read ahead for a reader moving through it in order:
+   // the rest of a chapter and those after it (a chapter averages under 4 KB).
+   static const size_t readAheadBytes = 32 * 1024;
+
+   // Ready the text after ref ahead of need (see VerseStore::prefetch), for a reader moving through it in order.
+   void readAhead(const Ref &ref);
+
+   // Look up the verses from first through last that this version has, in reference order, at most limit of them.
+   // Sets status to SUCCESS if any were found, or to the lookup status of first otherwise.
+   std::vector<Verse> lookupRange(Ref first, Ref last, size_t limit, LookupResult& status);
+
+   // Chapter and book navigation. The ref names a chapter (its verse is ignored); status is NO_BOOK or
+   // NO_CHAPTER if this version lacks it, or NO_BOOK if there is no chapter or book to move to.
+   // Return the first reference of the next chapter (continuing into the next book).
+   Ref nextChapter(Ref ref, LookupResult& status);
+   // Return the first reference of the previous chapter (continuing into the previous book).
+   Ref prevChapter(Ref ref, LookupResult& status);
+   // Return the first reference of the next book.
+   Ref nextBook(Ref ref, LookupResult& status);
+   // Return the first reference of the previous book.
+   Ref prevBook(Ref ref, LookupResult& status);
+   // Get the first and last references of a chapter and return the number of verses in it.
+   size_t chapterBounds(Ref ref, Ref &first, Ref &last, LookupResult& status);
+
+   // Call visit with the reference and text of every verse, in reference order.
+   void forEachVerse(const std::function<void(const Ref &, const std::string &)> &visit);
+
+   // Build the full-text index used by search, if it has not been built yet.
+   void buildTextIndex();
+
+   // Check if the full-text index has been built.
+   bool hasTextIndex() { return textIndexReady; }
+
+   // Find verses containing every word of a query, best matches first, at most limit of them.
+   // Builds the full-text index on first use.
+   std::vector<Ref> search(const std::string &query, size_t limit, LookupResult& status);
+
+   // Find verses containing the words of a phrase consecutively, in reference order, at most limit of them.
+   std::vector<Ref> searchPhrase(const std::string &phrase, size_t limit, LookupResult& status);
+
+   // Find verses containing every word of a query within a span of distance words, in reference order.
+   std::vector<Ref> searchNear(const std::string &query, unsigned distance, size_t limit, LookupResult& status);
+
+   // Build the TF-IDF vectors used to find similar verses, if they have not been built yet.
+   void buildSimilarityIndex();
+
+   // Check if the similarity vectors have been built.
+   bool hasSimilarityIndex() { return similarityIndexReady; }
+
+   // Find up to limit verses of this version most similar to a text (such as another verse), best first,
+   // leaving out the verse exclude. Builds the similarity vectors on first use.
+   std::vector<SimilarityIndex::Match> similar(const std::string &text, const Ref &exclude, size_t limit, LookupResult& status);
+
+   // Complete a partial word to up to limit indexed words, those in the most verses first.
+   // Builds the full-text index on first use.
+   std::vector<std::string> completeWord(const std::string &prefix, size_t limit, LookupResult& status);
+
+   // Complete a partial book name (case-insensitive) to up to limit books of this version, those with the most verses first.
+   std::vector<Ref::book_id> completeBook(const std::string &prefix, size_t limit, LookupResult& status);
+
+   // Count the refs this version has outside the standard canon (Canon.h) and the canon refs it lacks.
+   // Returns true if there are any.
+   bool canonMismatches(size_t &outside, size_t &missing);
+
+   // Number of chunks of raw text that can be scanned independently.
+   size_t textChunkCount();
+
+   // Scan a chunk of raw text, appending the Refs of matching verses to found (in file order).
+   void scanTextChunk(size_t chunk, const TextMatcher &matcher, std::vector<Ref> &found);
 
    // Information functions
    // Return an error message string to describe status
-   static const string error(LookupResult status);
+   static string error(LookupResult status);
 
    // Show the name of the bible file on cout
    void display();
 
+   // Estimate the memory used by this Bible, in bytes.
+   size_t memoryUsage();
+
    // Get the default Bible version.
    static std::string getDefaultVersion();
 
+   // Limit the threads any one Bible operation (index builds, similar verses) may use; 0 (the default)
+   // for one per core. A server running several requests at once shares the cores among them.
+   static void setThreads(unsigned threads);
+   static unsigned getThreads();
+
+   // Does a version's text follow the standard canon (Canon.h), so refs can be checked against it locally?
+   // True for the class Bibles; a manifest can mark versions "%noncanonical".
+   static bool versionFollowsCanon(const std::string &version);
+
    // Does a version identifier (kjv, web, etc.) exist?
    static bool versionExists(std::string version);
 
@@ -70,5 +275,11 @@ class Bible {	// A class to represent a version of the bible
 
    // Get a list of all available Bible version identifiers.
    static std::list<std::string> getVersionList();
+
+   // Replace the available versions with those listed in a manifest file.
+   // Each line is "<version> <path>"; relative paths are relative to the manifest.
+   // The BIBLE_MANIFEST environment variable names a manifest to use by default.
+   // Returns false (leaving the versions unchanged) if the manifest could not be read.
+   static bool loadManifest(const std::string &path);
 };
 #endif //Bible_H
@@ -0,0 +1,313 @@
+// BibleCache class function definitions
+// Computer Science, MVNU
+
+#include "BibleCache.h"
+#include "VerseSegment.h"
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+using namespace std;
+
+// How long a file must stay unchanged before its version is reloaded, so a file being written is read once, whole.
+static const std::chrono::milliseconds reloadQuiet(250);
+
+BibleCache::BibleCache(size_t budgetBytes, StorageMode storage, bool indexText, IndexMode indexing) : storage(storage), indexText(indexText), indexing(indexing), stats(), publishing(false), notify(-1), stopping(false) {
+	stats.budgetBytes = budgetBytes;
+
+	// Segments left by an earlier server may be out of date.
+	for(const std::string &version : Bible::getVersionList()) {
+		VerseSegment::remove(version);
+	}
+}
+
+BibleCache::~BibleCache() {
+	stopping = true;
+	if(watcher.joinable()) {
+		watcher.join();
+	}
+	if(notify >= 0) {
+		close(notify);
+	}
+}
+
+std::shared_ptr<Bible> BibleCache::load(const std::string &version, const std::string &file, bool textIndex, bool similarityIndex) {
+	std::shared_ptr<Bible> bible = std::make_shared<Bible>(file, storage, indexing);
+	if(!bible->valid()) {
+		return bible;
+	}
+	if(textIndex) {
+		bible->buildTextIndex();
+	}
+	if(similarityIndex) {
+		bible->buildSimilarityIndex();
+	}
+	// Checking a lazily indexed version against the canon would read all of it, so only full indexes are checked.
+	size_t outside, missing;
+	if(Bible::versionFollowsCanon(version) && bible->hasFullIndex() && bible->canonMismatches(outside, missing)) {
+		cout << "Warning: Bible version " << version << " does not match the canon: "
+			<< outside << " verses outside it, " << missing << " missing" << endl;
+	}
+	return bible;
+}
+
+void BibleCache::publishSegments() {
+	publishing = true;
+}
+
+void BibleCache::publish(const std::string &version, const std::shared_ptr<Bible> &bible) {
+	// Publishing reads the whole version, so only the version's own publishing waits for it.
+	std::unique_lock<std::mutex> lock(mutex);
+	std::unique_lock<std::mutex> serial(publishLocks[version], std::defer_lock);
+	lock.unlock();
+	serial.lock();
+
+	// A Bible replaced while this waited has its successor published after it, so is skipped.
+	auto current = [&]() {
+		std::lock_guard<std::mutex> relock(mutex);
+		std::map<std::string, Entry>::iterator it = entries.find(version);
+		return it != entries.end() && it->second.bible == bible;
+	};
+	if(!current()) {
+		return;
+	}
+	if(!VerseSegment::publish(version, *bible)) {
+		cout << "Could not publish Bible version in shared memory: " << version << endl;
+	}
+
+	// Evicted or replaced while publishing: the segment must not outlive the Bible (a successor publishes after this).
+	if(!current()) {
+		VerseSegment::remove(version);
+	}
+}
+
+std::shared_ptr<Bible> BibleCache::get(const std::string &version) {
+	std::unique_lock<std::mutex> lock(mutex);
+
+	std::map<std::string, Entry>::iterator it = entries.find(version);
+	if(it != entries.end()) {
+		// Loaded or loading: wait for any load in progress to finish.
+		if(!it->second.bible) {
+			stats.misses++;
+			std::shared_ptr<bool> failed = it->second.failed;
+			loadFinished.wait(lock, [&]() {
+				it = entries.find(version);
+				return *failed || it == entries.end() || it->second.bible;
+			});
+			// A failed load is not repeated by each waiter: they all share its failure.
+			if(*failed) {
+				return nullptr;
+			}
+			// The version was already evicted again, so load it for ourselves.
+			if(it == entries.end()) {
+				lock.unlock();
+				return get(version);
+			}
+		}
+		else {
+			stats.hits++;
+		}
+
+		// Mark as most recently used.
+		recent.splice(recent.begin(), recent, it->second.position);
+		return it->second.bible;
+	}
+
+	if(!Bible::versionExists(version)) {
+		return nullptr;
+	}
+
+	// Not loaded, so this request does the load while others wait on the placeholder.
+	stats.misses++;
+	Entry &placeholder = entries[version] = Entry();
+	placeholder.failed = std::make_shared<bool>(false);
+	std::string file = Bible::getVersionFile(version);
+	lock.unlock();
+
+	cout << "Loading and indexing Bible version: " << version << endl;
+	std::shared_ptr<Bible> bible = load(version, file, indexText, false);
+
+	lock.lock();
+	it = entries.find(version);
+	if(!bible->valid()) {
+		cout << "Could not open Bible version: " << version << endl;
+		stats.failures++;
+		*it->second.failed = true;
+		entries.erase(it);
+		loadFinished.notify_all();
+		return nullptr;
+	}
+
+	it->second.bible = bible;
+	it->second.bytes = bible->memoryUsage();
+	it->second.position = recent.insert(recent.begin(), version);
+	stats.loads++;
+	stats.residentBytes += it->second.bytes;
+	stats.residentVersions++;
+	evict(version);
+
+	loadFinished.notify_all();
+	lock.unlock();
+	if(publishing) {
+		publish(version, bible);
+	}
+	return bible;
+}
+
+void BibleCache::evict(const std::string &keep) {
+	while(stats.budgetBytes && stats.residentBytes > stats.budgetBytes && recent.size() > 1) {
+		std::string version = recent.back();
+		// Never evict the version just loaded, even if it alone exceeds the budget.
+		if(version == keep) {
+			break;
+		}
+
+		cout << "Evicting Bible version: " << version << endl;
+		std::map<std::string, Entry>::iterator it = entries.find(version);
+		stats.residentBytes -= it->second.bytes;
+		stats.residentVersions--;
+		stats.evictions++;
+		recent.pop_back();
+		entries.erase(it);
+		if(publishing) {
+			VerseSegment::remove(version);
+		}
+	}
+}
+
+void BibleCache::refresh(const std::string &version) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<std::string, Entry>::iterator it = entries.find(version);
+	if(it == entries.end() || !it->second.bible) {
+		return;
+	}
+
+	size_t bytes = it->second.bible->memoryUsage();
+	stats.residentBytes += bytes - it->second.bytes;
+	it->second.bytes = bytes;
+	evict(version);
+}
+
+bool BibleCache::watchFiles() {
+	notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(notify < 0) {
+		return false;
+	}
+
+	// Watch the directories holding version files, so files replaced by rename are seen too.
+	std::map<std::string, int> watched;
+	std::map<int, std::string> directories;
+	for(const std::string &version : Bible::getVersionList()) {
+		std::string file = Bible::getVersionFile(version);
+		std::string::size_type slash = file.rfind('/');
+		std::string directory = (slash == std::string::npos) ? "." : file.substr(0, slash);
+		if(slash == std::string::npos) {
+			file = "./" + file;
+		}
+		if(!watched.count(directory)) {
+			int descriptor = inotify_add_watch(notify, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if(descriptor < 0) {
+				cout << "Could not watch directory: " << directory << endl;
+				continue;
+			}
+			watched[directory] = descriptor;
+			directories[descriptor] = directory;
+		}
+		watchedFiles[file].push_back(version);
+	}
+
+	watcher = std::thread(&BibleCache::watchLoop, this, directories);
+	return true;
+}
+
+void BibleCache::watchLoop(std::map<int, std::string> directories) {
+	// Versions with changed files, and when each last changed.
+	std::map<std::string, std::chrono::steady_clock::time_point> changed;
+	alignas(struct inotify_event) char buffer[4096];
+
+	while(!stopping) {
+		struct pollfd poller = {notify, POLLIN, 0};
+		poll(&poller, 1, 100);
+
+		ssize_t length;
+		while((length = read(notify, buffer, sizeof(buffer))) > 0) {
+			for(char *p = buffer; p < buffer + length;) {
+				const struct inotify_event *event = (const struct inotify_event *)p;
+				p += sizeof(struct inotify_event) + event->len;
+				if(event->len == 0 || !directories.count(event->wd)) {
+					continue;
+				}
+				std::map<std::string, std::list<std::string>>::iterator file = watchedFiles.find(directories[event->wd] + "/" + event->name);
+				if(file != watchedFiles.end()) {
+					for(const std::string &version : file->second) {
+						changed[version] = std::chrono::steady_clock::now();
+					}
+				}
+			}
+		}
+
+		// Reload versions whose files have settled.
+		for(std::map<std::string, std::chrono::steady_clock::time_point>::iterator it = changed.begin(); it != changed.end();) {
+			if(std::chrono::steady_clock::now() - it->second < reloadQuiet) {
+				++it;
+				continue;
+			}
+			reload(it->first);
+			it = changed.erase(it);
+		}
+	}
+}
+
+void BibleCache::reload(const std::string &version) {
+	std::unique_lock<std::mutex> lock(mutex);
+	std::map<std::string, Entry>::iterator it = entries.find(version);
+	if(it == entries.end() || !it->second.bible) {
+		// Not loaded (or still loading): the next load reads the new file.
+		return;
+	}
+	std::shared_ptr<Bible> old = it->second.bible;
+	std::string file = Bible::getVersionFile(version);
+	lock.unlock();
+
+	// Build the replacement with the indexes the old one had, so the first requests after the swap do not wait for them.
+	cout << "Reloading Bible version: " << version << endl;
+	std::shared_ptr<Bible> bible = load(version, file, indexText || old->hasTextIndex(), old->hasSimilarityIndex());
+	if(!bible->valid()) {
+		cout << "Could not reload Bible version, keeping the old one: " << version << endl;
+		return;
+	}
+
+	// Swap it in, unless the version was evicted or replaced meanwhile. Holders of the old Bible keep it until they finish.
+	lock.lock();
+	it = entries.find(version);
+	if(it == entries.end() || it->second.bible != old) {
+		return;
+	}
+	it->second.bible = bible;
+	size_t bytes = bible->memoryUsage();
+	stats.residentBytes += bytes - it->second.bytes;
+	it->second.bytes = bytes;
+	stats.reloads++;
+	evict(version);
+
+	// The old segment serves the old text until the new one replaces it.
+	lock.unlock();
+	if(publishing) {
+		publish(version, bible);
+	}
+}
+
+BibleCache::Stats BibleCache::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+std::string BibleCache::formatStats(const Stats &stats) {
+	std::stringstream ss;
+	ss << stats.hits << " " << stats.misses << " " << stats.loads << " " << stats.failures << " " << stats.evictions
+		<< " " << stats.residentBytes << " " << stats.residentVersions << " " << stats.budgetBytes << " " << stats.reloads;
+	return ss.str();
+}
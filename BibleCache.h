@@ -0,0 +1,119 @@
+// Class BibleCache
+// Computer Science, MVNU
+//
+// A BibleCache loads Bible versions on first request and keeps them in
+// least-recently-used order, evicting cold versions once the memory used
+// by loaded versions exceeds a budget.
+// Concurrent first requests for a version wait for a single load, and share its failure.
+// With watchFiles, a loaded version whose file changes is rebuilt in the
+// background and swapped in; requests holding the old Bible finish on it.
+// Segments left in shared memory by an earlier server are removed on construction.
+
+#ifndef BibleCache_H
+#define BibleCache_H
+
+#include "Bible.h"
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class BibleCache {
+ public:
+   // Counters describing cache behavior since construction.
+   struct Stats {
+      unsigned long hits;		// Requests for an already loaded version.
+      unsigned long misses;		// Requests that had to wait for a load.
+      unsigned long loads;		// Versions successfully loaded.
+      unsigned long failures;	// Versions that could not be loaded.
+      unsigned long evictions;	// Versions evicted to stay within the budget.
+      size_t residentBytes;		// Estimated memory used by loaded versions.
+      size_t residentVersions;	// Number of loaded versions.
+      size_t budgetBytes;		// The memory budget.
+      unsigned long reloads;	// Loaded versions rebuilt because their files changed.
+   };
+
+   // Construct a cache with a memory budget in bytes (0 for no limit),
+   // loading versions with the given text storage and index modes, and building
+   // their full-text indexes at load time if indexText is set.
+   BibleCache(size_t budgetBytes, StorageMode storage = STORAGE_FILE, bool indexText = false, IndexMode indexing = INDEX_FULL);
+
+   // Stop watching files, if watching.
+   ~BibleCache();
+
+   // Watch the files of every version with inotify, on a background thread. When a loaded version's
+   // file is rewritten or replaced, the version is rebuilt on that thread (with the same indexes as
+   // before) and swapped in, so no request waits for it. Returns false if the files cannot be watched.
+   bool watchFiles();
+
+   // Publish each version in shared memory (see VerseSegment) when it loads, replace its segment when it
+   // reloads, and remove it when it is evicted, so clients can read verses without asking the server.
+   // Publishing reads the whole version, so a lazily indexed version builds its full index on load.
+   void publishSegments();
+
+   // Get the Bible for a version identifier, loading it if needed.
+   // Returns a null pointer if the version does not exist or could not be loaded.
+   // The returned Bible stays usable even if it is evicted while still held.
+   std::shared_ptr<Bible> get(const std::string &version);
+
+   // Re-estimate the memory used by a loaded version after it has grown (such as by
+   // building its full-text index on first search), evicting others if needed.
+   void refresh(const std::string &version);
+
+   // Get a snapshot of the cache counters.
+   Stats getStats();
+
+   // Format the counters as "hits misses loads failures evictions residentBytes residentVersions budgetBytes reloads".
+   static std::string formatStats(const Stats &stats);
+
+ private:
+   // A version that is loaded or being loaded.
+   struct Entry {
+      std::shared_ptr<Bible> bible;	// Null while loading.
+      std::shared_ptr<bool> failed;	// Set if the load in progress fails, for the requests waiting on it.
+      size_t bytes;
+      std::list<std::string>::iterator position;	// Position in the LRU list, once loaded.
+   };
+
+   StorageMode storage;
+   bool indexText;
+   IndexMode indexing;
+   std::mutex mutex;
+   std::condition_variable loadFinished;
+   std::map<std::string, Entry> entries;
+   std::list<std::string> recent;	// Loaded versions, most recently used first.
+   Stats stats;
+
+   // Whether loaded versions are published in shared memory, and a lock per version keeping its
+   // segments published one at a time, in order (held without the cache mutex, which publishing would stall).
+   bool publishing;
+   std::map<std::string, std::mutex> publishLocks;
+
+   // File watching: the inotify descriptor, the versions of each watched file path, and the watching thread.
+   int notify;
+   std::map<std::string, std::list<std::string>> watchedFiles;
+   std::thread watcher;
+   std::atomic<bool> stopping;
+
+   // Load a version's file, building the indexes asked for. The result may not be valid.
+   std::shared_ptr<Bible> load(const std::string &version, const std::string &file, bool textIndex, bool similarityIndex);
+
+   // Wait for file changes and reload the changed versions, until stopping.
+   void watchLoop(std::map<int, std::string> directories);
+
+   // Rebuild a loaded version from its file and swap it in. Does nothing if the version is not loaded.
+   void reload(const std::string &version);
+
+   // Publish a version's segment from bible, reporting failure, unless bible is no longer the loaded one.
+   // A segment published for a version evicted meanwhile is removed again. Must not hold the mutex.
+   void publish(const std::string &version, const std::shared_ptr<Bible> &bible);
+
+   // Evict least recently used versions (other than keep) until within budget. Must hold the mutex.
+   void evict(const std::string &keep);
+};
+
+#endif //BibleCache_H
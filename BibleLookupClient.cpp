@@ -1,39 +1,108 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
 #include <sstream>
 
 #include "BibleLookupClient.h"
+#include "Protocol.h"
 #include "Ref.h"
 
-BibleLookupClient::BibleLookupClient(std::string pipe_request_id, std::string pipe_reply_id, std::string bibleVersion) : pipe_request(pipe_request_id), pipe_reply(pipe_reply_id), bibleVersion(bibleVersion) {}
+const int BibleLookupClient::defaultConnectTimeout;
+const int BibleLookupClient::defaultReplyTimeout;
+
+/* Clients made so far by this process, to name their reply pipes apart. */
+static std::atomic<unsigned> clientCount(0);
+
+BibleLookupClient::BibleLookupClient(std::string pipe_request_id, std::string pipe_reply_id, std::string bibleVersion) : pipe_request(pipe_request_id),
+		replyPipeId(pipe_reply_id + "." + std::to_string(getpid()) + "." + std::to_string(clientCount++)), pipe_reply(replyPipeId), bibleVersion(bibleVersion),
+		connectTimeout(defaultConnectTimeout), replyTimeout(defaultReplyTimeout), serial(0) {
+	/* A server going away mid-request must fail the request, not kill the client. */
+	signal(SIGPIPE, SIG_IGN);
+}
+
+BibleLookupClient::~BibleLookupClient() {
+	pipe_reply.remove();
+}
+
+void BibleLookupClient::setTimeouts(int connect, int reply) {
+	connectTimeout = connect;
+	replyTimeout = reply;
+}
 
 BibleLookupClient::ServerReply BibleLookupClient::request(std::string action, const Ref &ref) {
+	return request(action, ref.toString());
+}
+
+BibleLookupClient::ServerReply BibleLookupClient::request(std::string action, const std::string &arguments) {
+	return request(bibleVersion, action, arguments);
+}
+
+BibleLookupClient::ServerReply BibleLookupClient::request(const std::string &version, std::string action, const std::string &arguments) {
 	ServerReply reply;
 
-	/* Construct the request and send it. */
-	pipe_request.openwrite();
+	/* Listen for the reply first, so the server never waits to open the reply pipe. */
+	if(!pipe_reply.openreadnowait()) {
+		reply.result = UNAVAILABLE;
+		return reply;
+	}
+
+	/* Construct the request and send it, if the server is reading requests. */
 	std::stringstream out;
-	out << bibleVersion << " " << action << " " << ref.toString();
-	pipe_request.send(out.str());
-	pipe_request.fifoclose();
+	serial++;
+	out << "@d=" << deadlineAfter(replyTimeout) << ",r=" << replyPipeId << ",n=" << serial << " " << version << " " << action << " " << arguments;
+	/* A request must go in one atomic write on the shared request pipe, so longer ones are not sent. */
+	if(out.str().length() + 1 > MaxRequest) {
+		pipe_reply.fifoclose();
+		reply.result = OTHER;
+		return reply;
+	}
+	bool sent = pipe_request.openwrite(connectTimeout);
+	if(sent) {
+		sent = pipe_request.send(out.str(), replyTimeout);
+		pipe_request.fifoclose();
+	}
 
-	/* Receive the server's reply. */
-	pipe_reply.openread();
-	std::string replyText = pipe_reply.recv();
+	/*
+	 * Receive the server's reply. A reply to an earlier request the client stopped waiting for
+	 * may come first, so replies are taken until the one numbered for this request.
+	 */
+	std::string replyText;
+	Reply parsed;
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(replyTimeout);
+	bool received = sent;
+	while(received) {
+		int left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+		received = left > 0 && pipe_reply.recv(replyText, left);
+		if(received) {
+			parseReply(replyText, parsed);
+			if(parsed.serial == serial) {
+				break;
+			}
+		}
+	}
 	pipe_reply.fifoclose();
+	if(!received) {
+		reply.result = UNAVAILABLE;
+		return reply;
+	}
 
-	/* Split the reply. */
-	std::string statusText = GetNextToken(replyText, " ");
-	std::string verseText = replyText; // The rest of the reply is the verse line (including ref and text).
+	/* The rest of the reply is the verse line (including ref and text). */
+	std::string_view refText = parsed.body;
 
 	/* Convert the reply. */
-	reply.result = static_cast<LookupResult>(atoi(statusText.c_str()));
-	reply.ref = Ref(verseText);
-	reply.verseText = verseText;
+	reply.result = parsed.status;
+	Ref::parse(refText, reply.ref);
+	reply.verseText = std::string(parsed.body);
 
 	return reply;
 }
 
-/* Request wrapper functions for lookup, next, and prev. */
+/* Request wrapper functions for lookup, next, and prev, which use the shared-memory segment when there is one. */
 Verse BibleLookupClient::lookup(const Ref &ref, LookupResult &result) {
+	if(segment.attach(bibleVersion)) {
+		return segment.lookup(ref, result);
+	}
 	ServerReply reply = request("lookup", ref);
 
 	result = reply.result;
@@ -41,6 +110,9 @@ Verse BibleLookupClient::lookup(const Ref &ref, LookupResult &result) {
 }
 
 Ref BibleLookupClient::next(const Ref &ref, LookupResult &result) {
+	if(segment.attach(bibleVersion)) {
+		return segment.next(ref, result);
+	}
 	ServerReply reply = request("next", ref);
 
 	result = reply.result;
@@ -48,8 +120,242 @@ Ref BibleLookupClient::next(const Ref &ref, LookupResult &result) {
 }
 
 Ref BibleLookupClient::prev(const Ref &ref, LookupResult &result) {
+	if(segment.attach(bibleVersion)) {
+		return segment.prev(ref, result);
+	}
 	ServerReply reply = request("prev", ref);
 
 	result = reply.result;
 	return reply.ref;
 }
+
+/* Chapter and book navigation replies are the ref moved to, like next and prev. */
+Ref BibleLookupClient::nextChapter(const Ref &ref, LookupResult &result) {
+	ServerReply reply = request("nextchapter", ref);
+
+	result = reply.result;
+	return reply.ref;
+}
+
+Ref BibleLookupClient::prevChapter(const Ref &ref, LookupResult &result) {
+	ServerReply reply = request("prevchapter", ref);
+
+	result = reply.result;
+	return reply.ref;
+}
+
+Ref BibleLookupClient::nextBook(const Ref &ref, LookupResult &result) {
+	ServerReply reply = request("nextbook", ref);
+
+	result = reply.result;
+	return reply.ref;
+}
+
+Ref BibleLookupClient::prevBook(const Ref &ref, LookupResult &result) {
+	ServerReply reply = request("prevbook", ref);
+
+	result = reply.result;
+	return reply.ref;
+}
+
+size_t BibleLookupClient::chapterBounds(const Ref &ref, Ref &first, Ref &last, LookupResult &result) {
+	ServerReply reply = request("chapter", ref);
+
+	/* The reply is "<first> <last> <verse count>". */
+	result = reply.result;
+	std::string_view body = reply.verseText;
+	size_t verses = 0;
+	std::string_view firstText = nextToken(body), lastText = nextToken(body);
+	if(result != SUCCESS || !Ref::parse(firstText, first) || !Ref::parse(lastText, last) || !parseNumber(nextToken(body), verses)) {
+		first = last = Ref();
+		return 0;
+	}
+	return verses;
+}
+
+std::vector<BibleLookupClient::ParallelRow> BibleLookupClient::parallel(const std::vector<std::string> &versions, const Ref &first, const Ref &last, LookupResult &result) {
+	std::string list;
+	for(const std::string &version : versions) {
+		list += (list.empty() ? "" : ",") + version;
+	}
+	ServerReply reply = request(list, "parallel", first.toString() + " " + last.toString());
+
+	/* The reply is tab-separated fields, a ref and then one text per version for each row. */
+	std::vector<ParallelRow> rows;
+	result = reply.result;
+	if(result != SUCCESS) {
+		return rows;
+	}
+	std::string::size_type start = 0;
+	while(start < reply.verseText.size()) {
+		ParallelRow row;
+		for(size_t field = 0; field <= versions.size(); field++) {
+			std::string::size_type end = reply.verseText.find('\t', start);
+			if(end == std::string::npos) {
+				end = reply.verseText.size();
+			}
+			if(field == 0) {
+				std::string_view refText(reply.verseText.data() + start, end - start);
+				Ref::parse(refText, row.ref);
+			}
+			else {
+				row.texts.push_back(reply.verseText.substr(start, end - start));
+			}
+			start = end + 1;
+		}
+		rows.push_back(row);
+	}
+	return rows;
+}
+
+std::vector<BibleLookupClient::DiffRow> BibleLookupClient::diff(const std::string &fromVersion, const std::string &toVersion, const Ref &first, const Ref &last, LookupResult &result) {
+	ServerReply reply = request(fromVersion + "," + toVersion, "diff", first.toString() + " " + last.toString());
+
+	/* The reply is tab-separated fields: a ref starts each row, and each span starts with its op symbol. */
+	std::vector<DiffRow> rows;
+	result = reply.result;
+	if(result != SUCCESS) {
+		return rows;
+	}
+	std::string_view body = reply.verseText;
+	while(!body.empty()) {
+		std::string_view::size_type end = std::min(body.find('\t'), body.size());
+		std::string_view field = body.substr(0, end);
+		body.remove_prefix(std::min(end + 1, body.size()));
+
+		DiffOp op;
+		if(!field.empty() && WordDiff::symbolOp(field[0], op)) {
+			if(!rows.empty()) {
+				rows.back().spans.push_back(DiffSpan{op, std::string(field.substr(1))});
+			}
+		}
+		else {
+			rows.push_back(DiffRow());
+			Ref::parse(field, rows.back().ref);
+		}
+	}
+	return rows;
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::parseMatches(ServerReply &reply) {
+	std::vector<Match> matches;
+	if(reply.result != SUCCESS) {
+		return matches;
+	}
+
+	/* The reply is a list of refs, each prefixed with "<version>/" when querying every version. */
+	std::string_view body = reply.verseText, refText;
+	while(!(refText = nextToken(body)).empty()) {
+		Match match;
+		std::string_view::size_type slash = refText.find('/');
+		if(slash == std::string_view::npos) {
+			match.version = bibleVersion;
+		}
+		else {
+			match.version = std::string(refText.substr(0, slash));
+			refText.remove_prefix(slash + 1);
+		}
+		Ref::parse(refText, match.ref);
+		matches.push_back(match);
+	}
+	return matches;
+}
+
+std::vector<Ref> BibleLookupClient::search(const std::string &query, size_t limit, LookupResult &result) {
+	ServerReply reply = request("search", std::to_string(limit) + " " + query);
+
+	std::vector<Ref> refs;
+	result = reply.result;
+	for(const Match &match : parseMatches(reply)) {
+		refs.push_back(match.ref);
+	}
+	return refs;
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::phrase(const std::string &phrase, size_t limit, LookupResult &result) {
+	ServerReply reply = request("phrase", std::to_string(limit) + " " + phrase);
+
+	result = reply.result;
+	return parseMatches(reply);
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::near(const std::string &query, unsigned distance, size_t limit, LookupResult &result) {
+	ServerReply reply = request("near", std::to_string(limit) + " " + std::to_string(distance) + " " + query);
+
+	result = reply.result;
+	return parseMatches(reply);
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::scan(const std::string &text, size_t limit, LookupResult &result) {
+	ServerReply reply = request("scan", std::to_string(limit) + " " + text);
+
+	result = reply.result;
+	return parseMatches(reply);
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::similar(const Ref &ref, const std::string &target, size_t limit, LookupResult &result) {
+	ServerReply reply = request("similar", std::to_string(limit) + " " + ref.toString() + " " + target);
+
+	result = reply.result;
+	std::vector<Match> matches = parseMatches(reply);
+	/* Matches from one other version come back without a version prefix. */
+	if(!target.empty() && target.find('*') == std::string::npos) {
+		for(Match &match : matches) {
+			match.version = target;
+		}
+	}
+	return matches;
+}
+
+std::vector<BibleLookupClient::Match> BibleLookupClient::regex(const std::string &pattern, size_t limit, LookupResult &result) {
+	ServerReply reply = request("regex", std::to_string(limit) + " " + pattern);
+
+	result = reply.result;
+	return parseMatches(reply);
+}
+
+std::vector<std::string> BibleLookupClient::completeWord(const std::string &prefix, size_t limit, LookupResult &result) {
+	ServerReply reply = request("complete", std::to_string(limit) + " word " + prefix);
+
+	result = reply.result;
+	std::vector<std::string> words;
+	std::string_view body = reply.verseText, word;
+	while(result == SUCCESS && !(word = nextToken(body)).empty()) {
+		words.push_back(std::string(word));
+	}
+	return words;
+}
+
+std::vector<std::string> BibleLookupClient::completeBook(const std::string &prefix, size_t limit, LookupResult &result) {
+	ServerReply reply = request("complete", std::to_string(limit) + " book " + prefix);
+
+	/* Books come back by number. */
+	result = reply.result;
+	std::vector<std::string> names;
+	std::string_view body = reply.verseText, bookText;
+	Ref::book_id book;
+	while(result == SUCCESS && !(bookText = nextToken(body)).empty()) {
+		if(parseNumber(bookText, book)) {
+			names.push_back(Ref(book, Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID).getBookName());
+		}
+	}
+	return names;
+}
+
+std::string BibleLookupClient::stats(LookupResult &result) {
+	ServerReply reply = request("stats", Ref());
+
+	result = reply.result;
+	return reply.verseText;
+}
+
+std::string BibleLookupClient::stamp(LookupResult &result) {
+	if(segment.attach(bibleVersion)) {
+		result = SUCCESS;
+		return segment.stamp();
+	}
+	ServerReply reply = request("stamp", Ref());
+
+	result = reply.result;
+	return reply.verseText;
+}
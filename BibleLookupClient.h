@@ -2,20 +2,36 @@
 #define BIBLELOOKUPCLIENT_H
 
 #include <string>
+#include <vector>
 #include "fifo.h"
 #include "Bible.h"
 #include "Verse.h"
 #include "Ref.h"
+#include "WordDiff.h"
+#include "VerseSegment.h"
 
 /*
  * A client to a running bible lookup server for a specific Bible.
- * Communicates by pipe, relaying requests and replies.
+ * Communicates by pipe, relaying requests and replies, and never waits past its timeouts.
+ * Each client has its own reply pipe (named after the reply pipe ID, the process and a count),
+ * and tells the server its deadline, so the server can drop requests the client stopped waiting for.
+ * Lookup, next and prev are answered from the version's shared-memory segment
+ * instead when the server has published a current one (biblelookupserver -s).
  */
 class BibleLookupClient {
 private:
 	Fifo pipe_request;
+	std::string replyPipeId;
 	Fifo pipe_reply;
 	std::string bibleVersion;
+	VerseSegment segment;
+
+	// How long to wait for the server to be reading requests, and for a reply, in milliseconds.
+	int connectTimeout;
+	int replyTimeout;
+
+	// Number of the last request sent. The server echoes it, so a late reply to an earlier request is passed over.
+	uint64_t serial;
 
 	// Structure holding the generic server reply.
 	struct ServerReply {
@@ -30,10 +46,52 @@ private:
 	// Send a request to the server for an action {lookup, next, prev} on the specified ref.
 	// Will get back the server's processed reply.
 	ServerReply request(std::string action, const Ref &ref);
+
+	// Send a request to the server for an action with arguments in place of a ref.
+	ServerReply request(std::string action, const std::string &arguments);
+
+	// Send a request for a different version (or list of versions) than the client's.
+	ServerReply request(const std::string &version, std::string action, const std::string &arguments);
+public:
+	// A verse found by a text query, and the version it was found in.
+	struct Match {
+		std::string version;
+		Ref ref;
+	};
+
+	// A verse of a passage looked up in several versions, with its text in each (empty where a version lacks it).
+	struct ParallelRow {
+		Ref ref;
+		std::vector<std::string> texts;
+	};
+
+	// The word-level differences of one verse between two versions.
+	struct DiffRow {
+		Ref ref;
+		std::vector<DiffSpan> spans;
+	};
+private:
+	// Split a text query reply into its matches.
+	std::vector<Match> parseMatches(ServerReply &reply);
 public:
 	// Connect to a Bible lookup server identified by the request and reply pipe IDs for the specified Bible version.
+	// Text queries (search, phrase, near, scan, regex) cover every version if the version is "*".
 	BibleLookupClient(std::string pipe_request_id, std::string pipe_reply_id, std::string bibleVersion);
 
+	// Remove the client's reply pipe. A client owns its pipe, so cannot be copied.
+	~BibleLookupClient();
+	BibleLookupClient(const BibleLookupClient &) = delete;
+	BibleLookupClient &operator=(const BibleLookupClient &) = delete;
+
+	// Default timeouts. The server holds its request pipe open, so a request pipe without a
+	// reader means the server is down; a client gives up on it at once rather than waiting.
+	static const int defaultConnectTimeout = 50;
+	static const int defaultReplyTimeout = 5000;
+
+	// Change how long to wait for the server to take a request (connect) and to reply, in milliseconds.
+	// A request that times out (or finds no server) gets UNAVAILABLE.
+	void setTimeouts(int connect, int reply);
+
 	// Try to get the verse identified by Ref. Record status of lookup in result.
 	Verse lookup(const Ref &ref, LookupResult &result);
 
@@ -42,6 +100,68 @@ public:
 
 	// Try to get the ref before the specified ref. Record status of lookup in result.
 	Ref prev(const Ref &ref, LookupResult &result);
+
+	// Try to get the first ref of the chapter after the specified ref's chapter. Record status of lookup in result.
+	Ref nextChapter(const Ref &ref, LookupResult &result);
+
+	// Try to get the first ref of the chapter before the specified ref's chapter. Record status of lookup in result.
+	Ref prevChapter(const Ref &ref, LookupResult &result);
+
+	// Try to get the first ref of the book after the specified ref's book. Record status of lookup in result.
+	Ref nextBook(const Ref &ref, LookupResult &result);
+
+	// Try to get the first ref of the book before the specified ref's book. Record status of lookup in result.
+	Ref prevBook(const Ref &ref, LookupResult &result);
+
+	// Try to get the first and last refs of the specified ref's chapter, returning its number of verses.
+	// Record status of lookup in result.
+	size_t chapterBounds(const Ref &ref, Ref &first, Ref &last, LookupResult &result);
+
+	// Look up the verses from first through last in several versions at once, aligned by ref,
+	// with the texts of each row in the order of versions. A long passage may come back cut short;
+	// continue it from the ref after the last row. Record status of lookup in result.
+	std::vector<ParallelRow> parallel(const std::vector<std::string> &versions, const Ref &first, const Ref &last, LookupResult &result);
+
+	// Diff the verses from first through last between two versions word by word, verse by verse.
+	// Verses only one version has are a single deleted or inserted span. A long passage may come back
+	// cut short; continue it from the ref after the last row. Record status of the diff in result.
+	std::vector<DiffRow> diff(const std::string &fromVersion, const std::string &toVersion, const Ref &first, const Ref &last, LookupResult &result);
+
+	// Find verses containing every word of a query, best matches first, at most limit of them.
+	// Record status of the search in result.
+	std::vector<Ref> search(const std::string &query, size_t limit, LookupResult &result);
+
+	// Find verses containing the words of a phrase consecutively, in reference order, at most limit of them.
+	std::vector<Match> phrase(const std::string &phrase, size_t limit, LookupResult &result);
+
+	// Find verses containing every word of a query within a span of distance words, in reference order.
+	std::vector<Match> near(const std::string &query, unsigned distance, size_t limit, LookupResult &result);
+
+	// Find verses whose text contains a substring exactly (case-sensitive), in file order.
+	// Scans the raw text, so needs no index.
+	std::vector<Match> scan(const std::string &text, size_t limit, LookupResult &result);
+
+	// Find verses whose text matches a case-insensitive ECMAScript regular expression, in file order.
+	// An invalid expression gives OTHER.
+	std::vector<Match> regex(const std::string &pattern, size_t limit, LookupResult &result);
+
+	// Find up to limit verses most like the verse at ref (by TF-IDF cosine similarity), best first,
+	// in the version target, every version if target is "*", or this client's version if target is empty.
+	std::vector<Match> similar(const Ref &ref, const std::string &target, size_t limit, LookupResult &result);
+
+	// Complete a partial word to up to limit words of the version, the most common first.
+	std::vector<std::string> completeWord(const std::string &prefix, size_t limit, LookupResult &result);
+
+	// Complete a partial book name to up to limit book names, the books with the most verses first.
+	std::vector<std::string> completeBook(const std::string &prefix, size_t limit, LookupResult &result);
+
+	// Get the server's version cache and request queue metrics:
+	// "hits misses loads failures evictions residentBytes residentVersions budgetBytes reloads queued running rejected expired".
+	std::string stats(LookupResult &result);
+
+	// Get the Bible::fileStamp of the text lookup, next and prev answer from (the shared segment's, when
+	// using one, or else the server's loaded version's), which lags the file's own while a version reloads.
+	std::string stamp(LookupResult &result);
 };
 
 #endif
@@ -0,0 +1,46 @@
+// BookNames class function definitions
+// Computer Science, MVNU
+
+#include "BookNames.h"
+#include <cctype>
+using namespace std;
+
+Ref::book_id BookNames::find(std::string_view name) {
+	char normalized[maxLength + 1];
+	size_t length = 0;
+
+	// A leading ordinal word ("I", "II", "III", "1st", "First", ...) followed by more of the name is a number.
+	static const std::string_view ordinals[][3] = {
+		{"i", "1st", "first"}, {"ii", "2nd", "second"}, {"iii", "3rd", "third"},
+	};
+	std::string_view::size_type start = name.find_first_not_of(' ');
+	if(start != std::string_view::npos) {
+		name.remove_prefix(start);
+	}
+	std::string_view::size_type space = name.find(' ');
+	if(space != std::string_view::npos && name.find_first_not_of(' ', space) != std::string_view::npos) {
+		std::string_view word = name.substr(0, space);
+		for(int number = 0; number < 3 && length == 0; number++) {
+			for(std::string_view ordinal : ordinals[number]) {
+				if(word.size() == ordinal.size() && std::equal(word.begin(), word.end(), ordinal.begin(),
+						[](char a, char b) { return tolower((unsigned char)a) == b; })) {
+					normalized[length++] = '1' + number;
+					name.remove_prefix(space);
+					break;
+				}
+			}
+		}
+	}
+
+	// Keep only letters and digits, lowercased.
+	for(char c : name) {
+		unsigned char u = c;
+		if(isalnum(u)) {
+			if(length == maxLength) {
+				return 0;
+			}
+			normalized[length++] = tolower(u);
+		}
+	}
+	return findNormalized(std::string_view(normalized, length));
+}
@@ -0,0 +1,217 @@
+// Class BookNames
+// Computer Science, MVNU
+//
+// BookNames resolves book names and common abbreviations ("Genesis", "Gen", "1 Cor",
+// "Ps") to book numbers. Names are normalized to lowercase letters and digits
+// ("1 Cor." becomes "1cor"), then found through a perfect hash (hash and displace)
+// that is built at compile time, so a lookup is one hash, one table probe and one
+// string comparison.
+
+#ifndef BookNames_H
+#define BookNames_H
+
+#include "Ref.h"
+#include <cstdint>
+#include <string_view>
+
+// The hash table and the functions that build it at compile time (used by BookNames).
+struct BookNameHash {
+   struct Entry {
+      std::string_view name;
+      Ref::book_id book;
+   };
+
+   // Full names and common abbreviations, normalized.
+   static constexpr Entry entries[] = {
+      {"genesis", 1}, {"gen", 1}, {"ge", 1}, {"gn", 1},
+      {"exodus", 2}, {"exod", 2}, {"exo", 2}, {"ex", 2},
+      {"leviticus", 3}, {"lev", 3}, {"le", 3}, {"lv", 3},
+      {"numbers", 4}, {"num", 4}, {"nu", 4}, {"nm", 4}, {"nb", 4},
+      {"deuteronomy", 5}, {"deut", 5}, {"de", 5}, {"dt", 5},
+      {"joshua", 6}, {"josh", 6}, {"jos", 6}, {"jsh", 6},
+      {"judges", 7}, {"judg", 7}, {"jdg", 7}, {"jg", 7}, {"jdgs", 7},
+      {"ruth", 8}, {"rth", 8}, {"ru", 8},
+      {"1samuel", 9}, {"1sam", 9}, {"1sa", 9}, {"1sm", 9},
+      {"2samuel", 10}, {"2sam", 10}, {"2sa", 10}, {"2sm", 10},
+      {"1kings", 11}, {"1kgs", 11}, {"1ki", 11}, {"1kg", 11},
+      {"2kings", 12}, {"2kgs", 12}, {"2ki", 12}, {"2kg", 12},
+      {"1chronicles", 13}, {"1chron", 13}, {"1chr", 13}, {"1ch", 13},
+      {"2chronicles", 14}, {"2chron", 14}, {"2chr", 14}, {"2ch", 14},
+      {"ezra", 15}, {"ezr", 15},
+      {"nehemiah", 16}, {"neh", 16}, {"ne", 16},
+      {"esther", 17}, {"esth", 17}, {"est", 17}, {"es", 17},
+      {"job", 18}, {"jb", 18},
+      {"psalms", 19}, {"psalm", 19}, {"ps", 19}, {"psa", 19}, {"pss", 19}, {"psm", 19},
+      {"proverbs", 20}, {"prov", 20}, {"pro", 20}, {"prv", 20}, {"pr", 20},
+      {"ecclesiastes", 21}, {"eccles", 21}, {"eccl", 21}, {"ecc", 21}, {"ec", 21}, {"qoh", 21},
+      {"songofsolomon", 22}, {"songofsongs", 22}, {"song", 22}, {"sos", 22}, {"so", 22}, {"canticles", 22}, {"cant", 22},
+      {"isaiah", 23}, {"isa", 23}, {"is", 23},
+      {"jeremiah", 24}, {"jer", 24}, {"je", 24}, {"jr", 24},
+      {"lamentations", 25}, {"lam", 25}, {"la", 25},
+      {"ezekiel", 26}, {"ezek", 26}, {"eze", 26}, {"ezk", 26},
+      {"daniel", 27}, {"dan", 27}, {"da", 27}, {"dn", 27},
+      {"hosea", 28}, {"hos", 28}, {"ho", 28},
+      {"joel", 29}, {"jl", 29},
+      {"amos", 30}, {"am", 30},
+      {"obadiah", 31}, {"obad", 31}, {"ob", 31},
+      {"jonah", 32}, {"jnh", 32}, {"jon", 32},
+      {"micah", 33}, {"mic", 33}, {"mc", 33},
+      {"nahum", 34}, {"nah", 34}, {"na", 34},
+      {"habakkuk", 35}, {"hab", 35}, {"hb", 35},
+      {"zephaniah", 36}, {"zeph", 36}, {"zep", 36}, {"zp", 36},
+      {"haggai", 37}, {"hag", 37}, {"hg", 37},
+      {"zechariah", 38}, {"zech", 38}, {"zec", 38}, {"zc", 38},
+      {"malachi", 39}, {"mal", 39}, {"ml", 39},
+      {"matthew", 40}, {"matt", 40}, {"mat", 40}, {"mt", 40},
+      {"mark", 41}, {"mrk", 41}, {"mar", 41}, {"mk", 41}, {"mr", 41},
+      {"luke", 42}, {"luk", 42}, {"lk", 42},
+      {"john", 43}, {"joh", 43}, {"jhn", 43}, {"jn", 43},
+      {"acts", 44}, {"act", 44}, {"ac", 44},
+      {"romans", 45}, {"rom", 45}, {"ro", 45}, {"rm", 45},
+      {"1corinthians", 46}, {"1cor", 46}, {"1co", 46},
+      {"2corinthians", 47}, {"2cor", 47}, {"2co", 47},
+      {"galatians", 48}, {"gal", 48}, {"ga", 48},
+      {"ephesians", 49}, {"ephes", 49}, {"eph", 49},
+      {"philippians", 50}, {"phil", 50}, {"php", 50}, {"pp", 50},
+      {"colossians", 51}, {"col", 51},
+      {"1thessalonians", 52}, {"1thess", 52}, {"1thes", 52}, {"1th", 52},
+      {"2thessalonians", 53}, {"2thess", 53}, {"2thes", 53}, {"2th", 53},
+      {"1timothy", 54}, {"1tim", 54}, {"1ti", 54},
+      {"2timothy", 55}, {"2tim", 55}, {"2ti", 55},
+      {"titus", 56}, {"tit", 56},
+      {"philemon", 57}, {"philem", 57}, {"phm", 57}, {"pm", 57},
+      {"hebrews", 58}, {"heb", 58},
+      {"james", 59}, {"jas", 59}, {"jm", 59},
+      {"1peter", 60}, {"1pet", 60}, {"1pe", 60}, {"1pt", 60}, {"1p", 60},
+      {"2peter", 61}, {"2pet", 61}, {"2pe", 61}, {"2pt", 61}, {"2p", 61},
+      {"1john", 62}, {"1jn", 62}, {"1jhn", 62}, {"1joh", 62}, {"1jo", 62},
+      {"2john", 63}, {"2jn", 63}, {"2jhn", 63}, {"2joh", 63}, {"2jo", 63},
+      {"3john", 64}, {"3jn", 64}, {"3jhn", 64}, {"3joh", 64}, {"3jo", 64},
+      {"jude", 65}, {"jud", 65}, {"jd", 65},
+      {"revelation", 66}, {"revelations", 66}, {"rev", 66}, {"re", 66}, {"rv", 66},
+   };
+   static constexpr size_t entryCount = sizeof(entries) / sizeof(entries[0]);
+
+   // Check that no name is listed twice.
+   static constexpr bool unique() {
+      for(size_t i = 0; i < entryCount; i++) {
+         for(size_t j = i + 1; j < entryCount; j++) {
+            if(entries[i].name == entries[j].name) {
+               return false;
+            }
+         }
+      }
+      return true;
+   }
+
+   // The hash table has tableSize slots; keys are first grouped into bucketCount buckets,
+   // and each bucket gets the displacement (hash seed) that puts its keys in free slots.
+   static constexpr size_t tableSize = 1024;
+   static constexpr size_t bucketCount = 256;
+
+   struct Table {
+      uint16_t displacement[bucketCount];
+      int16_t slots[tableSize];	// Index into entries, or -1.
+      bool complete;		// Every bucket found a displacement.
+   };
+
+   // FNV-1a with a seed, then a murmur3 finalizer to spread the bits.
+   static constexpr uint32_t hash(std::string_view s, uint32_t seed) {
+      uint32_t h = 2166136261u ^ (seed * 0x9e3779b9u);
+      for(char c : s) {
+         h ^= (unsigned char)c;
+         h *= 16777619u;
+      }
+      h ^= h >> 16;
+      h *= 0x85ebca6bu;
+      h ^= h >> 13;
+      h *= 0xc2b2ae35u;
+      h ^= h >> 16;
+      return h;
+   }
+
+   static constexpr Table build() {
+      Table table = {};
+      for(size_t s = 0; s < tableSize; s++) {
+         table.slots[s] = -1;
+      }
+      table.complete = true;
+
+      // Place the largest buckets first, while the table is emptiest.
+      size_t bucketSize[bucketCount] = {};
+      size_t order[bucketCount] = {};
+      for(size_t e = 0; e < entryCount; e++) {
+         bucketSize[hash(entries[e].name, 0) % bucketCount]++;
+      }
+      for(size_t b = 0; b < bucketCount; b++) {
+         order[b] = b;
+      }
+      for(size_t i = 1; i < bucketCount; i++) {
+         for(size_t j = i; j > 0 && bucketSize[order[j]] > bucketSize[order[j - 1]]; j--) {
+            size_t swap = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = swap;
+         }
+      }
+
+      for(size_t i = 0; i < bucketCount && bucketSize[order[i]] > 0; i++) {
+         size_t bucket = order[i];
+         bool placed = false;
+         for(uint32_t d = 1; d < 65536 && !placed; d++) {
+            // Try this displacement: every key in the bucket needs its own free slot.
+            size_t chosen[entryCount] = {};
+            size_t count = 0;
+            placed = true;
+            for(size_t e = 0; e < entryCount && placed; e++) {
+               if(hash(entries[e].name, 0) % bucketCount != bucket) {
+                  continue;
+               }
+               size_t s = hash(entries[e].name, d) % tableSize;
+               placed = table.slots[s] < 0;
+               for(size_t c = 0; c < count && placed; c++) {
+                  placed = chosen[c] != s;
+               }
+               chosen[count++] = s;
+            }
+
+            if(placed) {
+               table.displacement[bucket] = d;
+               count = 0;
+               for(size_t e = 0; e < entryCount; e++) {
+                  if(hash(entries[e].name, 0) % bucketCount == bucket) {
+                     table.slots[chosen[count++]] = e;
+                  }
+               }
+            }
+         }
+         table.complete = table.complete && placed;
+      }
+      return table;
+   }
+};
+
+class BookNames {
+ public:
+   // Find the book with a name or abbreviation, in any case and spacing. Returns 0 if there is none.
+   static Ref::book_id find(std::string_view name);
+
+   // Find the book with an already normalized name (lowercase letters and digits only), or 0.
+   static constexpr Ref::book_id findNormalized(std::string_view normalized) {
+      int index = table.slots[slot(normalized)];
+      return (index >= 0 && BookNameHash::entries[index].name == normalized) ? BookNameHash::entries[index].book : 0;
+   }
+
+   // Longest normalized name.
+   static const size_t maxLength = 16;
+
+ private:
+   static constexpr BookNameHash::Table table = BookNameHash::build();
+   static_assert(BookNameHash::unique(), "a book name is listed twice");
+   static_assert(table.complete, "no perfect hash found for the book names");
+
+   static constexpr size_t slot(std::string_view normalized) {
+      return BookNameHash::hash(normalized, table.displacement[BookNameHash::hash(normalized, 0) % BookNameHash::bucketCount]) % BookNameHash::tableSize;
+   }
+};
+
+#endif //BookNames_H
@@ -0,0 +1,42 @@
+// Canon class function definitions
+// Computer Science, MVNU
+
+#include "Canon.h"
+#include <algorithm>
+using namespace std;
+
+string Canon::explain(const Ref &ref) {
+	if(contains(ref)) {
+		return "";
+	}
+	int book = ref.getBook();
+	string name = Ref(ref).getBookName();
+	if(chapters(book) == 0) {
+		return "there is no book " + to_string(book);
+	}
+	if(verses(book, ref.getChapter()) == 0) {
+		int count = chapters(book);
+		return name + " has " + to_string(count) + (count == 1 ? " chapter" : " chapters");
+	}
+	return name + " " + to_string(ref.getChapter()) + " has " + to_string(verses(book, ref.getChapter())) + " verses";
+}
+
+bool Canon::clamp(RefRange &range) {
+	if(!contains(range.first)) {
+		return false;
+	}
+
+	// Past the last chapter of the book: end at its last verse.
+	int book = range.last.getBook();
+	int chapter = range.last.getChapter();
+	int verse = range.last.getVerse();
+	if(book != range.first.getBook() || chapter > chapters(book)) {
+		book = range.first.getBook();
+		chapter = chapters(book);
+		verse = verses(book, chapter);
+	}
+	verse = min(verse, verses(book, chapter));
+
+	range.last = Ref(book, chapter, verse);
+	return true;
+}
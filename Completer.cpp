@@ -0,0 +1,161 @@
+// Completer class function definitions
+// Computer Science, MVNU
+
+#include "Completer.h"
+#include <algorithm>
+#include <cstring>
+#include <deque>
+#include <queue>
+using namespace std;
+
+const uint32_t Completer::noKey;
+
+Completer::Completer() {}
+
+Completer::Completer(const std::vector<std::pair<std::string, uint32_t>> &keys, const std::vector<uint32_t> &keyWeights) {
+	// Sort the keys, keeping each one's weight and id.
+	std::vector<uint32_t> order(keys.size());
+	for(uint32_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	std::sort(order.begin(), order.end(), [&keys](uint32_t a, uint32_t b) {
+		return keys[a].first < keys[b].first;
+	});
+
+	keyStart.reserve(keys.size() + 1);
+	for(uint32_t i : order) {
+		keyStart.push_back(text.size());
+		text += keys[i].first;
+		weights.push_back(keyWeights[i]);
+		ids.push_back(keys[i].second);
+	}
+	keyStart.push_back(text.size());
+
+	auto keyLength = [this](uint32_t k) { return keyStart[k + 1] - keyStart[k]; };
+	auto keyAt = [this](uint32_t k, uint32_t depth) { return text[keyStart[k] + depth]; };
+
+	// Build breadth first so each node's children are allocated together.
+	// Each pending node covers the sorted keys [first, last) that share its prefix of length depth.
+	struct Pending {
+		uint32_t node, first, last, depth;
+	};
+	std::deque<Pending> pending;
+	nodes.push_back(Node{0, 0, 0, 0, 0, noKey, 0});
+	pending.push_back(Pending{0, 0, (uint32_t)size(), 0});
+
+	while(!pending.empty()) {
+		Pending current = pending.front();
+		pending.pop_front();
+		uint32_t k = current.first;
+
+		// Sorting puts a key equal to the prefix first.
+		if(k < current.last && keyLength(k) == current.depth) {
+			nodes[current.node].key = k++;
+		}
+
+		nodes[current.node].firstChild = nodes.size();
+		while(k < current.last) {
+			// Keys with the same next character share a child, whose label runs to their common prefix.
+			char c = keyAt(k, current.depth);
+			uint32_t end = k + 1;
+			while(end < current.last && keyAt(end, current.depth) == c) {
+				end++;
+			}
+			uint32_t depth = current.depth + 1;
+			uint32_t limit = std::min(keyLength(k), keyLength(end - 1));
+			while(depth < limit && keyAt(k, depth) == keyAt(end - 1, depth)) {
+				depth++;
+			}
+
+			pending.push_back(Pending{(uint32_t)nodes.size(), k, end, depth});
+			nodes.push_back(Node{keyStart[k] + current.depth, depth - current.depth, 0, 0, 0, noKey, k});
+			nodes[current.node].childCount++;
+			k = end;
+		}
+	}
+
+	// Children follow their parents, so one backwards pass fills in the best weights.
+	for(size_t n = nodes.size(); n-- > 0;) {
+		Node &node = nodes[n];
+		node.best = (node.key != noKey) ? weights[node.key] : 0;
+		for(uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+			node.best = std::max(node.best, nodes[child].best);
+		}
+	}
+}
+
+bool Completer::findPrefix(const std::string &prefix, uint32_t &node) const {
+	node = 0;
+	size_t matched = 0;
+	while(matched < prefix.size()) {
+		// Children are sorted by first character.
+		const Node &parent = nodes[node];
+		const Node *begin = &nodes[parent.firstChild], *end = begin + parent.childCount;
+		char c = prefix[matched];
+		const Node *child = std::lower_bound(begin, end, c, [this](const Node &n, char value) {
+			return (unsigned char)text[n.labelStart] < (unsigned char)value;
+		});
+		if(child == end || text[child->labelStart] != c) {
+			return false;
+		}
+
+		// The prefix may end partway along the child's label.
+		size_t length = std::min<size_t>(child->labelLength, prefix.size() - matched);
+		if(memcmp(text.data() + child->labelStart, prefix.data() + matched, length) != 0) {
+			return false;
+		}
+		matched += length;
+		node = child - &nodes[0];
+	}
+	return true;
+}
+
+std::vector<Completer::Completion> Completer::complete(const std::string &prefix, size_t limit) const {
+	std::vector<Completion> results;
+	uint32_t start;
+	if(nodes.empty() || limit == 0 || !findPrefix(prefix, start)) {
+		return results;
+	}
+
+	// Best-first search: a node's entry is scored by the best weight below it, and a key's by its
+	// own weight, so keys come out in weight order. Ties go to the lowest key index (sorted order),
+	// taking a node's index as that of its first key.
+	struct Entry {
+		uint32_t weight;
+		uint32_t rank;		// Key index, or the node's first key index.
+		uint32_t node;		// Node to expand, or noKey for a key entry.
+		bool operator<(const Entry &other) const {
+			if(weight != other.weight) {
+				return weight < other.weight;
+			}
+			return rank > other.rank;
+		}
+	};
+	std::priority_queue<Entry> frontier;
+	frontier.push(Entry{nodes[start].best, nodes[start].firstKey, start});
+
+	while(!frontier.empty() && results.size() < limit) {
+		Entry entry = frontier.top();
+		frontier.pop();
+
+		if(entry.node == noKey) {
+			uint32_t k = entry.rank;
+			results.push_back(Completion{text.substr(keyStart[k], keyStart[k + 1] - keyStart[k]), weights[k], ids[k]});
+			continue;
+		}
+
+		const Node &node = nodes[entry.node];
+		if(node.key != noKey) {
+			frontier.push(Entry{weights[node.key], node.key, noKey});
+		}
+		for(uint32_t child = node.firstChild; child < node.firstChild + node.childCount; child++) {
+			frontier.push(Entry{nodes[child].best, nodes[child].firstKey, child});
+		}
+	}
+	return results;
+}
+
+size_t Completer::memoryUsage() const {
+	return sizeof(*this) + nodes.capacity() * sizeof(Node) + text.capacity()
+		+ (keyStart.capacity() + weights.capacity() + ids.capacity()) * sizeof(uint32_t);
+}
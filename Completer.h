@@ -0,0 +1,67 @@
+// Class Completer
+// Computer Science, MVNU
+//
+// A Completer is an immutable prefix tree over a fixed set of keys, each with a weight,
+// for finding the highest-weighted completions of a prefix.
+// The tree is compressed (each edge holds a run of characters) and stored in flat arrays:
+// a node's children are contiguous and sorted by their first character, and each node
+// records the best weight anywhere below it, so completions are found best first
+// without visiting the rest of the subtree.
+
+#ifndef Completer_H
+#define Completer_H
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Completer {
+ public:
+   // A completion: the key, its weight and the id it was added with.
+   struct Completion {
+      std::string key;
+      uint32_t weight;
+      uint32_t id;
+   };
+
+   // An empty completer.
+   Completer();
+
+   // Build from (key, id) pairs and a weight for each. Keys must be unique.
+   Completer(const std::vector<std::pair<std::string, uint32_t>> &keys, const std::vector<uint32_t> &weights);
+
+   // Find up to limit keys starting with prefix, highest weight first
+   // (equal weights in key order).
+   std::vector<Completion> complete(const std::string &prefix, size_t limit) const;
+
+   // Number of keys.
+   size_t size() const { return keyStart.empty() ? 0 : keyStart.size() - 1; }
+
+   // Estimate the memory used, in bytes.
+   size_t memoryUsage() const;
+
+ private:
+   static const uint32_t noKey = UINT32_MAX;
+
+   struct Node {
+      uint32_t labelStart;	// Edge label: offset into text...
+      uint32_t labelLength;	// ...and length.
+      uint32_t firstChild;	// Index of the first child in nodes.
+      uint32_t childCount;
+      uint32_t best;		// Highest weight of any key at or below this node.
+      uint32_t key;		// Index of the key ending at this node, or noKey.
+      uint32_t firstKey;	// Index of the first key at or below this node.
+   };
+
+   std::vector<Node> nodes;	// Nodes, parents before children; nodes[0] is the root.
+   std::string text;		// All keys, concatenated in sorted order (edge labels point into it).
+   std::vector<uint32_t> keyStart;	// Offset of each key in text, plus the end.
+   std::vector<uint32_t> weights;	// Weight of each key.
+   std::vector<uint32_t> ids;	// Id of each key.
+
+   // Find the node at or below which every key starts with prefix, or return false.
+   bool findPrefix(const std::string &prefix, uint32_t &node) const;
+};
+
+#endif //Completer_H
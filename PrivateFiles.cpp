@@ -0,0 +1,25 @@
+// PrivateFiles function definitions
+// Computer Science, MVNU
+
+#include "PrivateFiles.h"
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+bool privateDirectory(const std::string &directory) {
+	mkdir(directory.c_str(), 0700);
+	struct stat info;
+	if(lstat(directory.c_str(), &info) != 0 || !S_ISDIR(info.st_mode) || info.st_uid != geteuid()) {
+		return false;
+	}
+	// Made by an earlier run that shared it; the files in it are still checked one by one.
+	if((info.st_mode & (S_IRWXG | S_IRWXO)) && chmod(directory.c_str(), 0700) != 0) {
+		return false;
+	}
+	return true;
+}
+
+bool ownedFile(int fd) {
+	struct stat info;
+	return fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_uid == geteuid();
+}
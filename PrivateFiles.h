@@ -0,0 +1,21 @@
+// PrivateFiles: directories and files kept to the user running the program
+// Computer Science, MVNU
+//
+// The CGI keeps its caches in /tmp, where any local user can create files.
+// Whatever is read from there goes into responses, so it is only trusted if
+// this user made it: the directory must be this user's and writable by no
+// one else, and each file in it must be this user's own.
+
+#ifndef PrivateFiles_H
+#define PrivateFiles_H
+
+#include <string>
+
+// Create a directory (mode 0700) if it does not exist, and check that it is a directory, not a link,
+// owned by this user; group and other access is taken away if it has any. Returns false if it is not.
+bool privateDirectory(const std::string &directory);
+
+// Check that the file open as fd is a regular file owned by this user.
+bool ownedFile(int fd);
+
+#endif //PrivateFiles_H
@@ -0,0 +1,110 @@
+// Protocol function definitions
+// Computer Science, MVNU
+
+#include "Protocol.h"
+#include <cctype>
+#include <chrono>
+using namespace std;
+
+// Check that a pipe ID names a file directly in the pipe directory.
+static bool validPipeId(std::string_view id) {
+	for(char c : id) {
+		if(!isalnum((unsigned char)c) && c != '_' && c != '-' && c != '.') {
+			return false;
+		}
+	}
+	return !id.empty() && id[0] != '.';
+}
+
+// Read the fields of a request header (less its '@').
+static bool parseHeader(std::string_view header, Request &request) {
+	while(!header.empty()) {
+		std::string_view::size_type comma = header.find(',');
+		std::string_view field = header.substr(0, comma);
+		header.remove_prefix(comma == std::string_view::npos ? header.size() : comma + 1);
+
+		if(field.substr(0, 2) == "d=") {
+			if(!parseNumber(field.substr(2), request.deadline)) {
+				return false;
+			}
+		}
+		else if(field.substr(0, 2) == "r=") {
+			request.replyPipe = field.substr(2);
+			if(!validPipeId(request.replyPipe)) {
+				return false;
+			}
+		}
+		else if(field.substr(0, 2) == "n=") {
+			if(!parseNumber(field.substr(2), request.serial)) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+std::string_view nextToken(std::string_view &text) {
+	std::string_view::size_type start = text.find_first_not_of(' ');
+	if(start == std::string_view::npos) {
+		text = std::string_view();
+		return std::string_view();
+	}
+
+	std::string_view::size_type end = text.find(' ', start);
+	std::string_view token = text.substr(start, end - start);
+	text = (end == std::string_view::npos) ? std::string_view() : text.substr(end + 1);
+	return token;
+}
+
+bool parseRequest(std::string_view message, Request &request) {
+	request.deadline = 0;
+	request.replyPipe = std::string_view();
+	request.serial = 0;
+	std::string_view::size_type start = message.find_first_not_of(' ');
+	if(start != std::string_view::npos && message[start] == '@') {
+		std::string_view header = nextToken(message);
+		if(!parseHeader(header.substr(1), request)) {
+			request.version = request.action = request.arguments = request.argument = request.rest = std::string_view();
+			return false;
+		}
+	}
+
+	request.version = nextToken(message);
+	request.action = nextToken(message);
+	request.arguments = message;
+	request.argument = nextToken(message);
+	request.rest = message;
+	return !request.version.empty() && !request.action.empty();
+}
+
+void writeReplyHeader(std::ostream &out, uint64_t serial) {
+	if(serial != 0) {
+		out << "@n=" << serial << " ";
+	}
+}
+
+bool parseReply(std::string_view message, Reply &reply) {
+	int status;
+	reply.serial = 0;
+	std::string_view token = nextToken(message);
+	if(!token.empty() && token[0] == '@') {
+		if(token.substr(0, 3) != "@n=" || !parseNumber(token.substr(3), reply.serial)) {
+			reply.status = OTHER;
+			reply.body = std::string_view();
+			return false;
+		}
+		token = nextToken(message);
+	}
+	reply.body = message;
+	if(!parseNumber(token, status) || status < SUCCESS || status > BUSY) {
+		reply.status = OTHER;
+		return false;
+	}
+	reply.status = static_cast<LookupResult>(status);
+	return true;
+}
+
+uint64_t deadlineAfter(int timeout) {
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+	return std::chrono::duration_cast<std::chrono::milliseconds>(deadline.time_since_epoch()).count();
+}
@@ -0,0 +1,68 @@
+// Protocol: parsing of the messages exchanged with the lookup server
+// Computer Science, MVNU
+//
+// Requests are "[@header] <version> <action> <argument> [rest]" and replies "<status> [body]"
+// (see docs/DESIGN.txt). These parsers split messages into views of the original
+// text without allocating, and validate numbers with std::from_chars.
+
+#ifndef Protocol_H
+#define Protocol_H
+
+#include "Bible.h"
+#include "Ref.h"
+#include <charconv>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// A parsed request. Each field views the original message.
+struct Request {
+	std::string_view version;
+	std::string_view action;
+	std::string_view arguments;	// Everything after the action, verbatim.
+	std::string_view argument;	// The first argument: a ref, or a result limit for text queries.
+	std::string_view rest;		// Everything after the argument, verbatim.
+
+	// From the optional header "@d=<deadline>,r=<reply pipe>,n=<serial>" (any field may be left out):
+	uint64_t deadline;			// When the client stops waiting, in milliseconds of steady_clock, or 0 if never.
+	std::string_view replyPipe;	// Pipe ID of the client's own reply pipe, or empty for the shared one.
+	uint64_t serial;			// The client's number for the request, echoed in the reply, or 0 if none.
+};
+
+// A parsed reply.
+struct Reply {
+	uint64_t serial;		// From the optional header "@n=<serial>": the request replied to, or 0 if none.
+	LookupResult status;
+	std::string_view body;	// Everything after the status, verbatim.
+};
+
+// Longest reply header, "@n=<serial> ".
+const size_t maxReplyHeader = 24;
+
+// Split the next space-delimited token off text, like GetNextToken:
+// leading spaces are skipped, and one space after the token is removed with it.
+std::string_view nextToken(std::string_view &text);
+
+// Parse a whole token as a number. Returns false (leaving value unchanged) if the token
+// is not entirely digits or does not fit.
+template<typename T>
+bool parseNumber(std::string_view token, T &value) {
+	const char *end = token.data() + token.size();
+	std::from_chars_result result = std::from_chars(token.data(), end, value);
+	return !token.empty() && result.ec == std::errc() && result.ptr == end;
+}
+
+// Split a request message. Returns false if it lacks a version or action, or has a malformed header.
+bool parseRequest(std::string_view message, Request &request);
+
+// The deadline timeout milliseconds from now, as sent in a request header. steady_clock is
+// CLOCK_MONOTONIC, so client and server processes on one machine agree on it.
+uint64_t deadlineAfter(int timeout);
+
+// Write the header of the reply to a request with a serial (nothing if it has none).
+void writeReplyHeader(std::ostream &out, uint64_t serial);
+
+// Split a reply message. Returns false if the status is not a known LookupResult, or the header is malformed.
+bool parseReply(std::string_view message, Reply &reply);
+
+#endif //Protocol_H
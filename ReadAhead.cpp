@@ -0,0 +1,58 @@
+// ReadAhead class function definitions
+// Computer Science, MVNU
+
+#include "ReadAhead.h"
+#include <algorithm>
+using namespace std;
+
+const size_t ReadAhead::defaultSessions;
+const unsigned ReadAhead::sequentialReads;
+
+// Check if a read of ref continues in order from last: the same verse or one after it,
+// in the same chapter, the next chapter, or the first chapter of the next book.
+static bool inOrder(const Ref &last, const Ref &ref) {
+	if(ref < last) {
+		return false;
+	}
+	if(ref.getBook() == last.getBook()) {
+		return ref.getChapter() <= last.getChapter() + 1;
+	}
+	return ref.getBook() == last.getBook() + 1 && ref.getChapter() == Ref::MIN_CHAPTER_ID;
+}
+
+ReadAhead::ReadAhead(size_t sessions) : capacity(std::max<size_t>(sessions, 1)) {}
+
+bool ReadAhead::read(const std::string &session, const std::string &version, const Ref &ref) {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<std::string, Session>::iterator it = sessions.find(session);
+	if(it == sessions.end()) {
+		// A new session, in place of the least recently active one if there are too many.
+		if(sessions.size() >= capacity) {
+			sessions.erase(recent.back());
+			recent.pop_back();
+		}
+		it = sessions.emplace(session, Session{version, ref, 1, Ref(), recent.insert(recent.begin(), session)}).first;
+		return false;
+	}
+
+	Session &current = it->second;
+	recent.splice(recent.begin(), recent, current.position);
+	if(current.version == version && inOrder(current.last, ref)) {
+		current.streak++;
+	}
+	else {
+		current.version = version;
+		current.streak = 1;
+		current.ahead = Ref();
+	}
+	current.last = ref;
+
+	// Read ahead once per chapter, from the first verse read in it.
+	if(current.streak < sequentialReads
+			|| (current.ahead.getBook() == ref.getBook() && current.ahead.getChapter() == ref.getChapter())) {
+		return false;
+	}
+	current.ahead = ref;
+	return true;
+}
@@ -0,0 +1,49 @@
+// Class ReadAhead
+// Computer Science, MVNU
+//
+// A ReadAhead follows the verses each reading session (a client's reply pipe)
+// asks the lookup server for, to spot sessions reading in order: lookup, next,
+// lookup, walking forward through a chapter. Once a session has read three
+// verses in order, the server reads the text after its verse ahead of need,
+// once for each chapter the session moves into, so its next requests find the
+// text in memory. Only the most recently active sessions are followed.
+
+#ifndef ReadAhead_H
+#define ReadAhead_H
+
+#include "Ref.h"
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+
+class ReadAhead {
+ public:
+   // Default number of sessions followed.
+   static const size_t defaultSessions = 256;
+
+   // In-order reads before a session counts as reading sequentially.
+   static const unsigned sequentialReads = 3;
+
+   ReadAhead(size_t sessions = defaultSessions);
+
+   // Note that a session read ref in a version. Returns true if the session is reading the version in
+   // order and has just moved into a chapter not yet read ahead, so the text after ref should be read ahead.
+   bool read(const std::string &session, const std::string &version, const Ref &ref);
+
+ private:
+   struct Session {
+      std::string version;
+      Ref last;			// The last verse read.
+      unsigned streak;	// Reads in order, ending with last.
+      Ref ahead;		// A verse of the chapter last read ahead from, or an invalid Ref.
+      std::list<std::string>::iterator position;	// Position in the recent list.
+   };
+
+   size_t capacity;
+   std::mutex mutex;
+   std::map<std::string, Session> sessions;
+   std::list<std::string> recent;	// Sessions, most recently active first.
+};
+
+#endif //ReadAhead_H
@@ -2,6 +2,10 @@
 // Computer Science, MVNU
 
 #include "Ref.h"
+#include "BookNames.h"
+#include "Canon.h"
+#include <cctype>
+#include <charconv>
 #include <iostream>
 #include <string>
 #include <sstream>
@@ -25,9 +29,9 @@ string GetNextToken(string& str, const string& delimiters = " ") {
   // Find position of delimiter at end of token
   string::size_type endPos = str.find_first_of(delimiters, startPos);
 
-  // Found a token, remove it from string, and return it
+  // Found a token, remove it (and the delimiter after it) from string, and return it
   string next = str.substr(startPos, endPos - startPos);
-  string rest = str.substr(endPos - startPos + 1, string::npos);
+  string rest = (endPos == string::npos) ? "" : str.substr(endPos + 1, string::npos);
   str = rest;
   return(next);
 }
@@ -36,18 +40,44 @@ string GetNextToken(string& str, const string& delimiters = " ") {
 
 Ref::Ref() {book = 0; chapter = 0; verse = 0;}  	// Default constructor
 
-Ref::Ref(const string s) { // Parse constructor - receives a line "34:5:7 text"
-    string rtext = s; // make local copy of string to avoid modifying parameter
-    // parse the reference - notice, currently there is no error checking!
-    // Get book number
-    string strbook = GetNextToken(rtext,":");
-    book = atoi(strbook.c_str());
-    // Get the chapterter number
-    string strchapter = GetNextToken(rtext,":");
-    chapter = atoi(strchapter.c_str());
-    // Get the verse number
-    string strverse = GetNextToken(rtext," ");
-    verse = atoi(strverse.c_str());
+Ref::Ref(const string &s) { // Parse constructor - receives a line "34:5:7 text"
+    // Invalid refs keep whatever ids could be read, for lookups to report.
+    std::string_view text(s);
+    parse(text, *this);
+}
+
+bool Ref::parse(std::string_view &text, Ref &ref) {
+	const char *p = text.data(), *end = p + text.size();
+	short ids[3] = {0, 0, 0};
+	bool valid = true;
+
+	for(int i = 0; i < 3; i++) {
+		std::from_chars_result result = std::from_chars(p, end, ids[i]);
+		if(result.ec == std::errc::result_out_of_range) {
+			valid = false;
+		}
+		else if(result.ec != std::errc()) {
+			valid = false;
+			break;
+		}
+		p = result.ptr;
+
+		// Ids are separated by colons.
+		if(i < 2) {
+			if(p == end || *p != ':') {
+				valid = false;
+				break;
+			}
+			p++;
+		}
+	}
+
+	ref = Ref(ids[0], ids[1], ids[2]);
+	text.remove_prefix(p - text.data());
+	return valid
+		&& ref.book >= MIN_BOOK_ID && ref.book <= MAX_BOOK_ID
+		&& ref.chapter >= MIN_CHAPTER_ID && ref.chapter <= MAX_CHAPTER_ID
+		&& ref.verse >= MIN_VERSE_ID && ref.verse <= MAX_VERSE_ID;
 }
 
 Ref::Ref(const Ref::book_id b, const Ref::chapter_id c, const Ref::verse_id v) { 	// Construct Ref from three ids
@@ -57,9 +87,113 @@ Ref::Ref(const Ref::book_id b, const Ref::chapter_id c, const Ref::verse_id v) {
 }
 
 // Accessors
-Ref::book_id Ref::getBook() {return book;}	 // Access book number
-Ref::chapter_id Ref::getChapter() {return chapter;}	 // Access chapterter number
-Ref::verse_id Ref::getVerse() {return verse;}; // Access verse number
+Ref::book_id Ref::getBook() const {return book;}	 // Access book number
+Ref::chapter_id Ref::getChapter() const {return chapter;}	 // Access chapterter number
+Ref::verse_id Ref::getVerse() const {return verse;}; // Access verse number
+
+// Read up to three numbers separated by colons ("3", "3:16" or "43:3:16") from the start of text,
+// skipping spaces first. Returns how many were read.
+static int parseNumbers(std::string_view &text, int numbers[3]) {
+	std::string_view::size_type start = text.find_first_not_of(' ');
+	text.remove_prefix(start == std::string_view::npos ? text.size() : start);
+
+	int count = 0;
+	const char *p = text.data(), *end = p + text.size();
+	while(count < 3 && p != end && isdigit((unsigned char)*p)) {
+		std::from_chars_result result = std::from_chars(p, end, numbers[count]);
+		if(result.ec != std::errc()) {
+			break;
+		}
+		p = result.ptr;
+		count++;
+		if(count == 3 || end - p < 2 || *p != ':' || !isdigit((unsigned char)p[1])) {
+			break;
+		}
+		p++;
+	}
+	text.remove_prefix(p - text.data());
+	return count;
+}
+
+bool Ref::parseRange(std::string_view text, RefRange &range) {
+	int start[3], end[3];
+	int book = 0;
+
+	// A name runs up to the first digit after a letter ("1 Cor 13" names "1 Cor").
+	std::string_view::size_type letter = text.find_first_not_of(" 0123456789:-");
+	int starts;
+	if(letter == std::string_view::npos || text.substr(0, letter).find(':') != std::string_view::npos) {
+		// Numeric: "<book>:<chapter>:<verse>".
+		starts = parseNumbers(text, start);
+		if(starts != 3) {
+			return false;
+		}
+		book = start[0];
+		start[0] = start[1];
+		start[1] = start[2];
+		starts = 2;
+	}
+	else {
+		std::string_view::size_type digit = text.find_first_of("0123456789", letter);
+		std::string_view name = text.substr(0, digit);
+		book = BookNames::find(name);
+		if(book == 0 || name.find_first_of(":-") != std::string_view::npos) {
+			return false;
+		}
+		text.remove_prefix(digit == std::string_view::npos ? text.size() : digit);
+		starts = parseNumbers(text, start);
+
+		// Books with one chapter are cited by verse alone ("Jude 5", "Obadiah 3-6").
+		if(starts == 1 && Canon::chapters(book) == 1) {
+			start[1] = start[0];
+			start[0] = MIN_CHAPTER_ID;
+			starts = 2;
+		}
+	}
+
+	// An optional end after a dash: a verse (or chapter, if the start was a chapter), or chapter:verse.
+	int ends = 0;
+	std::string_view::size_type dash = text.find_first_not_of(' ');
+	if(dash != std::string_view::npos && text[dash] == '-') {
+		text.remove_prefix(dash + 1);
+		ends = parseNumbers(text, end);
+		if(starts == 0 || ends == 0 || ends > 2) {
+			return false;
+		}
+	}
+	if(text.find_first_not_of(' ') != std::string_view::npos) {
+		return false;
+	}
+
+	int firstChapter = MIN_CHAPTER_ID, firstVerse = MIN_VERSE_ID, lastChapter = MAX_CHAPTER_ID, lastVerse = MAX_VERSE_ID;
+	if(starts >= 1) {
+		firstChapter = lastChapter = start[0];
+	}
+	if(starts == 2) {
+		firstVerse = lastVerse = start[1];
+	}
+	if(ends == 2) {
+		lastChapter = end[0];
+		lastVerse = end[1];
+	}
+	else if(ends == 1 && starts == 2) {
+		lastVerse = end[0];
+	}
+	else if(ends == 1) {
+		lastChapter = end[0];
+	}
+
+	auto inRange = [](int value, int min, int max) { return value >= min && value <= max; };
+	if(!inRange(book, MIN_BOOK_ID, MAX_BOOK_ID)
+			|| !inRange(firstChapter, MIN_CHAPTER_ID, MAX_CHAPTER_ID) || !inRange(lastChapter, MIN_CHAPTER_ID, MAX_CHAPTER_ID)
+			|| !inRange(firstVerse, MIN_VERSE_ID, MAX_VERSE_ID) || !inRange(lastVerse, MIN_VERSE_ID, MAX_VERSE_ID)) {
+		return false;
+	}
+
+	range.first = Ref(book, firstChapter, firstVerse);
+	range.last = Ref(book, lastChapter, lastVerse);
+	return !(range.last < range.first);
+}
 
 // Ref comparison operators.
 bool Ref::operator==(const Ref &r) const {
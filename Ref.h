@@ -10,6 +10,7 @@
 #ifndef Ref_H
 #define Ref_H
 #include <string>
+#include <string_view>
 #include <stdlib.h>
 using namespace std;
 
@@ -37,12 +38,26 @@ private:
 	verse_id verse;
 public:
 	Ref();  	// Default constructor
-	Ref(string s); 	// Parse constructor - example parameter "43:3:16"
+	Ref(const string &s); 	// Parse constructor - example parameter "43:3:16"
 	Ref(const book_id, const chapter_id, const verse_id); // Construct from three ids
 	// Accessors
-	book_id getBook();	// Access book number
-	chapter_id getChapter();	// Access chapter number
-	verse_id getVerse();	// Access verse number
+	book_id getBook() const;	// Access book number
+	chapter_id getChapter() const;	// Access chapter number
+	verse_id getVerse() const;	// Access verse number
+
+	// Parse "<book>:<chapter>:<verse>" from the start of text without allocating, removing it from text.
+	// Returns false if the ref is malformed or any id is outside the MIN/MAX limits; ref then
+	// still holds the ids that were read (0 for ids missing or too large to hold), so lookups
+	// of it report which part is wrong.
+	static bool parse(std::string_view &text, Ref &ref);
+
+	// Parse a human-readable reference or passage, such as "John 3:16", "John 3:16-18",
+	// "1 Cor 13" (a whole chapter), "Gen 1-3", "Ps 119:105" or "Jude", into the range of
+	// refs it covers. Book names may be abbreviated; numeric refs ("43:3:16-18") work too.
+	// Ranges running to the end of a chapter or book end at MAX_VERSE_ID or MAX_CHAPTER_ID
+	// (Canon::clamp narrows them). Books with one chapter take a lone number as a verse ("Jude 5").
+	// Returns false if the text is not a reference, or names ids outside the MIN/MAX limits.
+	static bool parseRange(std::string_view text, struct RefRange &range);
 
 	// Get human-readable name of the book.
 	string getBookName();
@@ -61,4 +76,13 @@ public:
 	void display(); 	// Display the reference on cout, example output: John 3:16
 };
 
+// An inclusive range of references, from first to last.
+struct RefRange {
+	Ref first;
+	Ref last;
+
+	// Check if a reference is in the range.
+	bool contains(const Ref &ref) const { return !(ref < first) && !(last < ref); }
+};
+
 #endif //Ref_H
@@ -0,0 +1,47 @@
+// Render function definitions
+// Computer Science, MVNU
+
+#include "Render.h"
+using namespace std;
+
+void renderChapterHeading(Ref ref, std::string &html) {
+	html += "<h2>";
+	html += ref.getBookName();
+	html += " ";
+	html += std::to_string(ref.getChapter());
+	html += "</h2>\n";
+}
+
+void renderVerse(Verse verse, std::string &html) {
+	html += "<p><em>";
+	html += std::to_string(verse.getRef().getVerse());
+	html += ".</em> ";
+	html += verse.getVerse();
+	html += "</p>\n";
+}
+
+std::string escapeHTML(const std::string &text) {
+	std::string escaped;
+	for(char c : text) {
+		switch(c) {
+			case '&':
+				escaped += "&amp;";
+				break;
+			case '<':
+				escaped += "&lt;";
+				break;
+			case '>':
+				escaped += "&gt;";
+				break;
+			case '"':
+				escaped += "&quot;";
+				break;
+			case '\'':
+				escaped += "&#39;";
+				break;
+			default:
+				escaped += c;
+		}
+	}
+	return escaped;
+}
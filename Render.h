@@ -0,0 +1,25 @@
+// Render: the HTML fragments bibleajax shows for passages
+// Computer Science, MVNU
+//
+// A passage is shown as a heading for each chapter it reaches, followed by a
+// paragraph for each verse. These are kept in one place so that whatever
+// produces a passage (the CGI, or fragments rendered and cached ahead of time)
+// produces exactly the same bytes.
+
+#ifndef Render_H
+#define Render_H
+
+#include "Ref.h"
+#include "Verse.h"
+#include <string>
+
+// Append the heading of a ref's chapter: "<h2>Genesis 1</h2>" and a newline.
+void renderChapterHeading(Ref ref, std::string &html);
+
+// Append a verse: "<p><em>1.</em> text</p>" and a newline.
+void renderVerse(Verse verse, std::string &html);
+
+// Escape text (such as form input echoed back) for HTML: &, <, >, " and ' become entities.
+std::string escapeHTML(const std::string &text);
+
+#endif //Render_H
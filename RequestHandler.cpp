@@ -0,0 +1,555 @@
+// RequestHandler function definitions
+// Computer Science, MVNU
+
+#include "RequestHandler.h"
+#include "Protocol.h"
+#include "TextScan.h"
+#include "WordDiff.h"
+#include "fifo.h"
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <list>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+using namespace std;
+
+/* Most results returned for one search request. */
+static const size_t maxSearchResults = 100;
+
+/* Most rows returned for one parallel lookup. */
+static const size_t maxParallelRows = 1000;
+
+/* Threads one request may use for its own work (see setRequestThreads). */
+static unsigned requestThreads = 1;
+
+void setRequestThreads(unsigned threads) {
+	requestThreads = std::max(1u, threads);
+}
+
+/* Version identifier requesting a text query across every version. */
+static const std::string allVersions = "*";
+
+/* A text query against one Bible, returning at most limit refs. */
+typedef std::function<std::vector<Ref>(Bible &, size_t, LookupResult &)> TextQuery;
+
+/*
+ * Run a text query against one version, or every version if the version is "*".
+ * Writes the matching refs to out, prefixed with "<version>/" when querying every version.
+ * Returns the status of the query.
+ */
+static LookupResult textQuery(BibleCache &bibles, const std::string &version, size_t limit, std::ostream &out, const TextQuery &query) {
+	std::list<std::string> versions;
+	if(version == allVersions) {
+		versions = Bible::getVersionList();
+	}
+	else {
+		versions.push_back(version);
+	}
+
+	std::stringstream refs;
+	LookupResult result = SUCCESS;
+	size_t found = 0;
+	for(const std::string &current : versions) {
+		std::shared_ptr<Bible> bible = bibles.get(current);
+		if(!bible) {
+			result = OTHER;
+			break;
+		}
+
+		bool indexed = bible->hasTextIndex();
+		for(const Ref &ref : query(*bible, limit - found, result)) {
+			refs << " ";
+			if(version == allVersions) {
+				refs << current << "/";
+			}
+			refs << ref.toString();
+			found++;
+		}
+
+		/* The first query of a version builds its index, so account for the memory. */
+		if(!indexed) {
+			bibles.refresh(current);
+		}
+		if(result != SUCCESS || found >= limit) {
+			break;
+		}
+	}
+
+	out << result;
+	if(result == SUCCESS) {
+		out << refs.str();
+	}
+	return result;
+}
+
+/*
+ * Scan the raw text of one version, or every version (in parallel) if the version is "*".
+ * Writes up to limit matching refs to out in the same form as textQuery.
+ * A scan still running at the deadline stops, with status OTHER (its client has stopped waiting).
+ * Returns the status of the scan.
+ */
+static LookupResult textScan(BibleCache &bibles, const std::string &version, size_t limit, std::ostream &out, const TextMatcher &matcher,
+		RequestQueue::Clock::time_point deadline) {
+	std::list<std::string> versions;
+	if(version == allVersions) {
+		versions = Bible::getVersionList();
+	}
+	else {
+		versions.push_back(version);
+	}
+
+	std::vector<std::shared_ptr<Bible>> scanned;
+	for(const std::string &current : versions) {
+		std::shared_ptr<Bible> bible = bibles.get(current);
+		if(!bible) {
+			out << OTHER;
+			return OTHER;
+		}
+		scanned.push_back(bible);
+	}
+
+	bool expired;
+	std::vector<std::vector<Ref>> found = scanBibles(scanned, matcher, requestThreads, deadline, &expired);
+	if(expired) {
+		out << OTHER;
+		return OTHER;
+	}
+
+	out << SUCCESS;
+	std::list<std::string>::const_iterator current = versions.begin();
+	size_t written = 0;
+	for(size_t i = 0; i < found.size() && written < limit; i++, ++current) {
+		for(size_t j = 0; j < found[i].size() && written < limit; j++, written++) {
+			out << " ";
+			if(version == allVersions) {
+				out << *current << "/";
+			}
+			out << found[i][j].toString();
+		}
+	}
+	return SUCCESS;
+}
+
+/*
+ * Look up a passage in several versions at once, each distinct version once, on up to requestThreads threads.
+ * Returns the combined status: OTHER if any version is unknown (or more versions are listed than exist),
+ * SUCCESS if any version has verses in the passage, or else the first version's status for its first ref.
+ */
+static LookupResult lookupPassages(BibleCache &bibles, const std::vector<std::string> &versions, const Ref &first, const Ref &last,
+		std::vector<std::vector<Verse>> &passages) {
+	passages.assign(versions.size(), std::vector<Verse>());
+	if(versions.size() > Bible::getVersionList().size()) {
+		return OTHER;
+	}
+
+	/* A version listed more than once is looked up once and copied. */
+	std::vector<std::string> distinct;
+	std::vector<size_t> column(versions.size());
+	for(size_t i = 0; i < versions.size(); i++) {
+		column[i] = std::find(distinct.begin(), distinct.end(), versions[i]) - distinct.begin();
+		if(column[i] == distinct.size()) {
+			distinct.push_back(versions[i]);
+		}
+	}
+
+	std::vector<std::vector<Verse>> found(distinct.size());
+	std::vector<LookupResult> distinctResults(distinct.size(), OTHER);
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		for(size_t i; (i = next++) < distinct.size();) {
+			std::shared_ptr<Bible> bible = bibles.get(distinct[i]);
+			if(bible) {
+				found[i] = bible->lookupRange(first, last, maxParallelRows, distinctResults[i]);
+			}
+		}
+	};
+	std::vector<std::thread> threads;
+	for(size_t i = 1; i < std::min<size_t>(distinct.size(), requestThreads); i++) {
+		threads.emplace_back(work);
+	}
+	work();
+	for(std::thread &thread : threads) {
+		thread.join();
+	}
+
+	std::vector<LookupResult> results(versions.size());
+	for(size_t i = 0; i < versions.size(); i++) {
+		passages[i] = found[column[i]];
+		results[i] = distinctResults[column[i]];
+	}
+
+	LookupResult result = results.empty() ? OTHER : results[0];
+	for(LookupResult versionResult : results) {
+		if(versionResult == OTHER) {
+			return OTHER;
+		}
+		if(versionResult == SUCCESS) {
+			result = SUCCESS;
+		}
+	}
+	return result;
+}
+
+/*
+ * Look up a passage in several versions and write the rows aligned by ref:
+ * "<ref>\t<text in version 1>\t...\t<text in version n>" for every ref any of the versions has,
+ * with an empty field where a version lacks the verse. Rows are tab-separated too, so each row
+ * is n + 1 fields. The reply stops early rather than outgrow a pipe message.
+ * Returns the status of the lookup.
+ */
+static LookupResult parallelLookup(BibleCache &bibles, const std::vector<std::string> &versions, const Ref &first, const Ref &last, std::ostream &out) {
+	std::vector<std::vector<Verse>> passages;
+	LookupResult result = lookupPassages(bibles, versions, first, last, passages);
+	out << result;
+	if(result != SUCCESS) {
+		return result;
+	}
+
+	/* Merge the passages by ref. */
+	std::vector<size_t> next(versions.size(), 0);
+	std::string row;
+	size_t length = 0, rows = 0;
+	for(;;) {
+		Ref current;
+		bool found = false;
+		for(size_t i = 0; i < versions.size(); i++) {
+			if(next[i] < passages[i].size() && (!found || passages[i][next[i]].getRef() < current)) {
+				current = passages[i][next[i]].getRef();
+				found = true;
+			}
+		}
+		if(!found || rows >= maxParallelRows) {
+			break;
+		}
+
+		row = (rows > 0 ? "\t" : " ") + current.toString();
+		for(size_t i = 0; i < versions.size(); i++) {
+			row += '\t';
+			if(next[i] < passages[i].size() && passages[i][next[i]].getRef() == current) {
+				std::string text = passages[i][next[i]++].getVerse();
+				std::replace(text.begin(), text.end(), '\t', ' ');
+				row += text;
+			}
+		}
+
+		/* Leave room for the reply header, status and message terminator. */
+		if(length + row.size() + 8 + maxReplyHeader > MaxMess) {
+			break;
+		}
+		out << row;
+		length += row.size();
+		rows++;
+	}
+	return result;
+}
+
+/*
+ * Diff a passage between two versions word by word and write a row for each ref either has:
+ * "<ref>\t<span>\t<span>...", each span an op symbol (= unchanged, - only in the first version,
+ * + only in the second) followed by its words. The reply stops early rather than outgrow a pipe message.
+ * Returns the status of the lookup.
+ */
+static LookupResult diffLookup(BibleCache &bibles, const std::vector<std::string> &versions, const Ref &first, const Ref &last, std::ostream &out) {
+	std::vector<std::vector<Verse>> passages;
+	LookupResult result = versions.size() == 2 ? lookupPassages(bibles, versions, first, last, passages) : OTHER;
+	out << result;
+	if(result != SUCCESS) {
+		return result;
+	}
+
+	/* Verses only one version has are wholly deleted or inserted. */
+	WordDiff differ;
+	std::vector<Verse> &from = passages[0], &to = passages[1];
+	size_t i = 0, j = 0, length = 0, rows = 0;
+	std::string row;
+	while((i < from.size() || j < to.size()) && rows < maxParallelRows) {
+		Ref current;
+		std::string fromText, toText;
+		if(j >= to.size() || (i < from.size() && from[i].getRef() < to[j].getRef())) {
+			current = from[i].getRef();
+			fromText = from[i++].getVerse();
+		}
+		else if(i >= from.size() || to[j].getRef() < from[i].getRef()) {
+			current = to[j].getRef();
+			toText = to[j++].getVerse();
+		}
+		else {
+			current = from[i].getRef();
+			fromText = from[i++].getVerse();
+			toText = to[j++].getVerse();
+		}
+		std::replace(fromText.begin(), fromText.end(), '\t', ' ');
+		std::replace(toText.begin(), toText.end(), '\t', ' ');
+
+		row = (rows > 0 ? "\t" : " ") + current.toString();
+		for(const DiffSpan &span : differ.diff(fromText, toText)) {
+			row += '\t';
+			row += WordDiff::opSymbol(span.op);
+			row += span.text;
+		}
+
+		/* Leave room for the reply header, status and message terminator. */
+		if(length + row.size() + 8 + maxReplyHeader > MaxMess) {
+			break;
+		}
+		out << row;
+		length += row.size();
+		rows++;
+	}
+	return result;
+}
+
+/*
+ * Find the verses most similar to a verse of one version, in another version or every version ("*").
+ * Writes up to limit refs to out, best first, in the same form as textQuery.
+ * Returns the status of the search: the lookup status of the verse if it is missing.
+ */
+static LookupResult similarVerses(BibleCache &bibles, const std::string &version, const Ref &ref, const std::string &target,
+		size_t limit, std::ostream &out) {
+	std::shared_ptr<Bible> source = bibles.get(version);
+	LookupResult result = OTHER;
+	Verse verse;
+	if(source) {
+		verse = source->lookup(ref, result);
+	}
+	if(result != SUCCESS) {
+		out << result;
+		return result;
+	}
+
+	std::list<std::string> versions;
+	if(target == allVersions) {
+		versions = Bible::getVersionList();
+	}
+	else {
+		versions.push_back(target.empty() ? version : target);
+	}
+
+	/* Gather each version's best, then keep the best overall; a verse is not similar to itself. */
+	std::vector<std::pair<SimilarityIndex::Match, std::string>> found;
+	for(const std::string &current : versions) {
+		std::shared_ptr<Bible> bible = bibles.get(current);
+		if(!bible) {
+			out << OTHER;
+			return OTHER;
+		}
+		bool indexed = bible->hasSimilarityIndex();
+		Ref exclude = (current == version) ? ref : Ref();
+		for(const SimilarityIndex::Match &match : bible->similar(verse.getVerse(), exclude, limit, result)) {
+			found.push_back(std::make_pair(match, current));
+		}
+		if(!indexed) {
+			bibles.refresh(current);
+		}
+	}
+	std::stable_sort(found.begin(), found.end(), [](const std::pair<SimilarityIndex::Match, std::string> &a, const std::pair<SimilarityIndex::Match, std::string> &b) {
+		return a.first.score > b.first.score;
+	});
+
+	out << SUCCESS;
+	for(size_t i = 0; i < found.size() && i < limit; i++) {
+		out << " ";
+		if(target == allVersions) {
+			out << found[i].second << "/";
+		}
+		out << found[i].first.ref.toString();
+	}
+	return SUCCESS;
+}
+
+LookupResult handleRequest(BibleCache &bibles, RequestQueue &requests, const std::string &message, Arena &arena, std::ostream &out) {
+	/* Split into pieces, viewing the request text in place. */
+	Request parsed;
+	bool wellFormed = parseRequest(message, parsed);
+	std::string version(parsed.version);
+	std::string_view requestType = parsed.action;
+	std::string_view rest = parsed.rest;
+
+	/* The argument is a ref, or for text queries a result limit. Invalid refs are reported by the lookup. */
+	LookupResult result;
+	Ref ref;
+	std::string_view refText = parsed.argument;
+	Ref::parse(refText, ref);
+	size_t limit = 0;
+	parseNumber(parsed.argument, limit);
+	limit = std::min(limit, maxSearchResults);
+
+	/* Access the appropriate bible, loading it if needed. */
+	std::shared_ptr<Bible> bible;
+
+	/* First check for error conditions, then do the actual lookup. */
+	if(!wellFormed) {
+		result = OTHER;
+		out << result;
+	}
+	else if(requestType == "stats") {
+		/* Cache and queue metrics do not need a version. */
+		result = SUCCESS;
+		out << result << " " << BibleCache::formatStats(bibles.getStats()) << " " << RequestQueue::formatStats(requests.getStats());
+	}
+	else if(requestType == "resolve") {
+		/* Human-readable refs ("John 3:16-18") are resolved to the range they cover, for any version. */
+		RefRange range;
+		if(Ref::parseRange(parsed.arguments, range)) {
+			result = SUCCESS;
+			out << result << " " << range.first.toString() << " " << range.last.toString();
+		}
+		else {
+			result = OTHER;
+			out << result;
+		}
+	}
+	else if(requestType == "search" || requestType == "phrase" || requestType == "near") {
+		/*
+		 * Text queries may cover every version.
+		 * The ref field holds the result limit, and the rest of the request is the query
+		 * (preceded by the word distance, for near).
+		 */
+		if(requestType == "search") {
+			std::string query(rest);
+			result = textQuery(bibles, version, limit, out, [&](Bible &bible, size_t remaining, LookupResult &status) {
+				return bible.search(query, remaining, status);
+			});
+		}
+		else if(requestType == "phrase") {
+			std::string query(rest);
+			result = textQuery(bibles, version, limit, out, [&](Bible &bible, size_t remaining, LookupResult &status) {
+				return bible.searchPhrase(query, remaining, status);
+			});
+		}
+		else {
+			unsigned distance = 0;
+			parseNumber(nextToken(rest), distance);
+			std::string query(rest);
+			result = textQuery(bibles, version, limit, out, [&](Bible &bible, size_t remaining, LookupResult &status) {
+				return bible.searchNear(query, distance, remaining, status);
+			});
+		}
+	}
+	else if(requestType == "scan" || requestType == "regex") {
+		/*
+		 * Scans read the raw text rather than the index, and may cover every version.
+		 * The ref field holds the result limit, and the rest of the request, verbatim, is the
+		 * substring or (case-insensitive) regular expression. They stop at the request's deadline.
+		 */
+		RequestQueue::Clock::time_point deadline = parsed.deadline == 0 ? RequestQueue::Clock::time_point::max()
+			: RequestQueue::Clock::time_point(std::chrono::milliseconds(parsed.deadline));
+		if(requestType == "scan") {
+			result = textScan(bibles, version, limit, out, SubstringMatcher(std::string(rest)), deadline);
+		}
+		else {
+			try {
+				result = textScan(bibles, version, limit, out, RegexMatcher(std::string(rest), true), deadline);
+			}
+			catch(const std::regex_error &e) {
+				result = OTHER;
+				out << result;
+			}
+		}
+	}
+	else if(requestType == "parallel" || requestType == "diff") {
+		/*
+		 * Side-by-side lookup and diffs: the version field is a comma-separated list of
+		 * versions (two for a diff), and the arguments are the first and last refs of the passage.
+		 */
+		std::vector<std::string> versions;
+		std::string_view list = parsed.version;
+		while(!list.empty()) {
+			std::string_view::size_type comma = list.find(',');
+			versions.push_back(std::string(list.substr(0, comma)));
+			list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+		}
+		Ref last;
+		std::string_view lastText = parsed.rest;
+		if(Ref::parse(lastText, last)) {
+			result = requestType == "parallel" ? parallelLookup(bibles, versions, ref, last, out)
+				: diffLookup(bibles, versions, ref, last, out);
+		}
+		else {
+			result = OTHER;
+			out << result;
+		}
+	}
+	else if(requestType == "similar") {
+		/*
+		 * The ref field holds the result limit, followed by the ref of the verse to match and
+		 * optionally the version (or "*" for every version) to find similar verses in.
+		 */
+		Ref similarTo;
+		std::string_view similarText = nextToken(rest);
+		Ref::parse(similarText, similarTo);
+		result = similarVerses(bibles, version, similarTo, std::string(nextToken(rest)), limit, out);
+	}
+	else if(!(bible = bibles.get(version))) {
+		result = OTHER;
+		out << result;
+	}
+	else {
+		/* Perform requested operation and return results. */
+		if(requestType == "complete") {
+			/*
+			 * Type-ahead: the ref field holds the result limit, the next word is what to
+			 * complete (word or book), and the rest of the request is the prefix.
+			 * Books are returned by number.
+			 */
+			std::string_view kind = nextToken(rest);
+			if(kind == "word") {
+				std::vector<std::string> words = bible->completeWord(std::string(rest), limit, result);
+				out << result;
+				for(const std::string &word : words) {
+					out << " " << word;
+				}
+			}
+			else if(kind == "book") {
+				std::vector<Ref::book_id> books = bible->completeBook(std::string(rest), limit, result);
+				out << result;
+				for(Ref::book_id book : books) {
+					out << " " << book;
+				}
+			}
+			else {
+				result = OTHER;
+				out << result;
+			}
+		}
+		else if(requestType == "lookup") {
+			std::string_view text = bible->lookupText(ref, arena, result);
+			out << result << " " << ref.toString() << " " << text;
+		}
+		else if(requestType == "next") {
+			Ref nextRef = bible->next(ref, result);
+			out << result << " " << nextRef.toString();
+		}
+		else if(requestType == "prev") {
+			Ref prevRef = bible->prev(ref, result);
+			out << result << " " << prevRef.toString();
+		}
+		else if(requestType == "nextchapter" || requestType == "prevchapter" || requestType == "nextbook" || requestType == "prevbook") {
+			/* Chapter and book navigation: the ref names a chapter, and the reply is the first ref moved to. */
+			Ref moved = requestType == "nextchapter" ? bible->nextChapter(ref, result)
+				: requestType == "prevchapter" ? bible->prevChapter(ref, result)
+				: requestType == "nextbook" ? bible->nextBook(ref, result)
+				: bible->prevBook(ref, result);
+			out << result << " " << moved.toString();
+		}
+		else if(requestType == "chapter") {
+			/* A chapter's first and last refs and verse count. */
+			Ref first, last;
+			size_t verses = bible->chapterBounds(ref, first, last, result);
+			out << result << " " << first.toString() << " " << last.toString() << " " << verses;
+		}
+		else if(requestType == "stamp") {
+			/* Which text the version's replies come from: the stamp of its file when loaded (until reloaded). */
+			result = SUCCESS;
+			out << result << " " << bible->getFileStamp();
+		}
+		else {
+			result = OTHER;
+			out << result;
+		}
+	}
+	return result;
+}
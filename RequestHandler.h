@@ -0,0 +1,28 @@
+// RequestHandler: carrying out the lookup server's requests
+// Computer Science, MVNU
+//
+// A request message (see docs/DESIGN.txt) is carried out against the loaded versions and its reply
+// written to a stream. This is kept apart from the server's pipes and workers, so biblebench times
+// the server's own handling of requests.
+
+#ifndef RequestHandler_H
+#define RequestHandler_H
+
+#include "Arena.h"
+#include "Bible.h"
+#include "BibleCache.h"
+#include "RequestQueue.h"
+#include <ostream>
+#include <string>
+
+// Set the threads one request may use for its own work (parallel lookups and scans), at least one.
+// The server shares the cores among its workers, so requests running at once do not each take every core.
+// Set before any request is handled.
+void setRequestThreads(unsigned threads);
+
+// Carry out one request and write the reply to out. Temporaries come from arena where they can,
+// so the common requests (lookup, next, prev and chapter navigation) allocate nothing from the heap.
+// The queue's statistics are reported by the stats request. Returns the status of the request.
+LookupResult handleRequest(BibleCache &bibles, RequestQueue &requests, const std::string &message, Arena &arena, std::ostream &out);
+
+#endif //RequestHandler_H
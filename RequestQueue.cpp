@@ -0,0 +1,135 @@
+// RequestQueue class function definitions
+// Computer Science, MVNU
+
+#include "RequestQueue.h"
+#include <algorithm>
+#include <sstream>
+using namespace std;
+
+RequestQueue::RequestQueue(size_t capacity, size_t versionLimit, const std::list<std::string> &versions)
+		: capacity(capacity), versionLimit(versionLimit), stats() {
+	waiting.reserve(capacity);
+	spare.reserve(capacity);
+	// Only known versions are counted, so requests naming others add nothing to the map.
+	for(const std::string &version : versions) {
+		running[version] = 0;
+	}
+}
+
+void RequestQueue::charge(Pending &request) {
+	request.charged.clear();
+	if(request.version == "*") {
+		for(std::map<std::string, size_t>::iterator it = running.begin(); it != running.end(); ++it) {
+			request.charged.push_back(&it->second);
+		}
+		return;
+	}
+	std::string::size_type start = 0;
+	while(start <= request.version.size()) {
+		std::string::size_type comma = request.version.find(',', start);
+		if(comma == std::string::npos) {
+			comma = request.version.size();
+		}
+		// Unknown versions are not charged, and a version listed twice is charged once.
+		std::map<std::string, size_t>::iterator it = running.find(request.version.substr(start, comma - start));
+		if(it != running.end() && std::find(request.charged.begin(), request.charged.end(), &it->second) == request.charged.end()) {
+			request.charged.push_back(&it->second);
+		}
+		start = comma + 1;
+	}
+}
+
+bool RequestQueue::runnable(const Pending &request) {
+	for(size_t *versionRunning : request.charged) {
+		if(versionLimit != 0 && *versionRunning >= versionLimit) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool RequestQueue::push(Pending &request) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(waiting.size() >= capacity) {
+		stats.rejected++;
+		return false;
+	}
+	charge(request);
+	waiting.push_back(std::move(request));
+	if(!spare.empty()) {
+		request = std::move(spare.back());
+		spare.pop_back();
+	}
+	stats.queued = waiting.size();
+	changed.notify_one();
+	return true;
+}
+
+RequestQueue::Pending RequestQueue::pop() {
+	std::unique_lock<std::mutex> lock(mutex);
+	for(;;) {
+		// Take the oldest runnable request, dropping any that have expired.
+		Clock::time_point now = Clock::now(), soonest = Clock::time_point::max();
+		for(std::vector<Pending>::iterator it = waiting.begin(); it != waiting.end();) {
+			if(it->deadline <= now) {
+				if(spare.size() < capacity) {
+					spare.push_back(std::move(*it));
+				}
+				it = waiting.erase(it);
+				stats.expired++;
+				continue;
+			}
+			if(runnable(*it)) {
+				for(size_t *versionRunning : it->charged) {
+					(*versionRunning)++;
+				}
+				stats.running++;
+				Pending request = std::move(*it);
+				waiting.erase(it);
+				stats.queued = waiting.size();
+				return request;
+			}
+			soonest = std::min(soonest, it->deadline);
+			++it;
+		}
+		stats.queued = waiting.size();
+
+		// Wait for a new request or a free slot, or for the next deadline to drop that request.
+		if(soonest == Clock::time_point::max()) {
+			changed.wait(lock);
+		}
+		else {
+			changed.wait_until(lock, soonest);
+		}
+	}
+}
+
+void RequestQueue::finish(const Pending &request) {
+	std::lock_guard<std::mutex> lock(mutex);
+	for(size_t *versionRunning : request.charged) {
+		if(*versionRunning > 0) {
+			(*versionRunning)--;
+		}
+	}
+	stats.running--;
+	// Any waiting worker may now be able to run a request for these versions.
+	changed.notify_all();
+}
+
+void RequestQueue::recycle(Pending &request) {
+	std::lock_guard<std::mutex> lock(mutex);
+	if(spare.size() < capacity) {
+		spare.push_back(std::move(request));
+	}
+}
+
+RequestQueue::Stats RequestQueue::getStats() {
+	std::lock_guard<std::mutex> lock(mutex);
+	return stats;
+}
+
+std::string RequestQueue::formatStats(const Stats &stats) {
+	std::stringstream ss;
+	ss << stats.queued << " " << stats.running << " " << stats.rejected << " " << stats.expired;
+	return ss.str();
+}
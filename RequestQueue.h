@@ -0,0 +1,91 @@
+// Class RequestQueue
+// Computer Science, MVNU
+//
+// A RequestQueue holds requests received by the lookup server until a worker
+// thread takes them. It is bounded: a request arriving when it is full is turned
+// away at once (for the server to reply BUSY) rather than waiting behind an
+// ever-growing backlog. It also limits how many requests for one version run at
+// once, so a flood of requests for one version cannot take every worker; workers
+// take the oldest request with a free slot in every version it runs against (each
+// of a list, or every version for "*"). Requests whose deadlines
+// pass while queued are dropped unrun, since their clients have stopped waiting.
+// Finished requests are kept to be filled in again, so that once the server is
+// warm, receiving and queueing a request takes no memory from the heap.
+
+#ifndef RequestQueue_H
+#define RequestQueue_H
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+class RequestQueue {
+ public:
+   typedef std::chrono::steady_clock Clock;
+
+   // A received request.
+   struct Pending {
+      std::string message;		// The request, less its header.
+      // The versions it runs against, which the concurrency limit applies to: a version,
+      // a comma-separated list of versions, or "*" for every version.
+      std::string version;
+      std::vector<size_t *> charged;	// The running counts of those versions (set by push).
+      std::string replyPipe;	// Pipe ID to reply on, or "" for the shared reply pipe.
+      Clock::time_point deadline;	// When the client stops waiting (Clock::time_point::max() if never).
+      uint64_t serial;			// The client's number for the request, echoed in the reply (0 if none).
+   };
+
+   // Counters describing the queue since construction.
+   struct Stats {
+      size_t queued;			// Requests waiting now.
+      size_t running;			// Requests taken by workers and not yet finished.
+      unsigned long rejected;	// Requests turned away because the queue was full.
+      unsigned long expired;	// Requests dropped because their deadlines passed while queued.
+   };
+
+   // Construct a queue holding at most capacity requests, running at most versionLimit requests
+   // for any one of versions at once (0 for no limit). Versions not among them are not limited.
+   RequestQueue(size_t capacity, size_t versionLimit, const std::list<std::string> &versions);
+
+   // Add a request, leaving a finished one (see recycle) in its place to fill in for the next, if there is one.
+   // Returns false, leaving the request, if the queue is full.
+   bool push(Pending &request);
+
+   // Wait for the oldest request whose versions are all below their limits, and take it, counting it
+   // against each until finish. Requests found past their deadlines are dropped along the way.
+   Pending pop();
+
+   // Release the slots held by a request taken by pop.
+   void finish(const Pending &request);
+
+   // Keep a request that is done with, so push can hand its memory back for a new request.
+   void recycle(Pending &request);
+
+   // Get a snapshot of the counters.
+   Stats getStats();
+
+   // Format the counters as "queued running rejected expired".
+   static std::string formatStats(const Stats &stats);
+
+ private:
+   size_t capacity;
+   size_t versionLimit;
+   std::mutex mutex;
+   std::condition_variable changed;
+   std::vector<Pending> waiting;		// Oldest first, in space reserved for capacity requests.
+   std::vector<Pending> spare;		// Requests done with, to be filled in again.
+   std::map<std::string, size_t> running;	// Requests running for each version, fixed at construction.
+   Stats stats;
+
+   // Find the running counts of the versions a request runs against. Must hold the mutex.
+   void charge(Pending &request);
+
+   // Check if a request's versions are all below their limits. Must hold the mutex.
+   bool runnable(const Pending &request);
+};
+
+#endif //RequestQueue_H
@@ -0,0 +1,239 @@
+// ResponseCache class function definitions
+// Computer Science, MVNU
+
+#include "ResponseCache.h"
+#include "PrivateFiles.h"
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sstream>
+#include <unistd.h>
+#include <zlib.h>
+using namespace std;
+
+// First line of every cache file.
+static const char *cacheMagic = "BIBLEFRG";
+
+// A final, empty block with fixed codes, ending a deflate stream made of fragments.
+static const char finalBlock[] = {0x03, 0x00};
+
+// Write all of a buffer to a file descriptor.
+static bool writeAll(int fd, const char *data, size_t size) {
+	while(size > 0) {
+		ssize_t written = write(fd, data, size);
+		if(written <= 0) {
+			return false;
+		}
+		data += written;
+		size -= written;
+	}
+	return true;
+}
+
+// Read the rest of a file descriptor into contents.
+static bool readAll(int fd, std::string &contents) {
+	char buffer[65536];
+	ssize_t got;
+	while((got = read(fd, buffer, sizeof(buffer))) > 0) {
+		contents.append(buffer, got);
+	}
+	return got == 0;
+}
+
+// Append a 32-bit value to a string, least or most significant byte first.
+static void appendLittleEndian(std::string &out, uint32_t value) {
+	for(int i = 0; i < 4; i++) {
+		out += (char)(value >> (8 * i));
+	}
+}
+
+static void appendBigEndian(std::string &out, uint32_t value) {
+	for(int i = 3; i >= 0; i--) {
+		out += (char)(value >> (8 * i));
+	}
+}
+
+ResponseCache::Encoding ResponseCache::negotiate(const char *acceptEncoding) {
+	bool gzip = false, deflate = false;
+	std::string header = acceptEncoding ? acceptEncoding : "";
+	std::stringstream codings(header);
+	std::string coding;
+	while(getline(codings, coding, ',')) {
+		// "name[;q=value]": a quality of zero refuses the coding.
+		std::string::size_type semicolon = coding.find(';');
+		std::string name, parameters = semicolon == std::string::npos ? "" : coding.substr(semicolon + 1);
+		for(char c : coding.substr(0, semicolon)) {
+			if(!isspace((unsigned char)c)) {
+				name += tolower((unsigned char)c);
+			}
+		}
+		std::string::size_type q = parameters.find("q=");
+		if(q != std::string::npos && strtod(parameters.c_str() + q + 2, NULL) <= 0) {
+			continue;
+		}
+		gzip = gzip || name == "gzip" || name == "x-gzip";
+		deflate = deflate || name == "deflate";
+	}
+	return gzip ? GZIP : deflate ? DEFLATE : IDENTITY;
+}
+
+const char *ResponseCache::encodingName(Encoding encoding) {
+	switch(encoding) {
+		case GZIP:
+			return "gzip";
+		case DEFLATE:
+			return "deflate";
+		case IDENTITY:
+		default:
+			return "";
+	}
+}
+
+ResponseCache::Fragment ResponseCache::compress(const std::string &text, int level) {
+	Fragment fragment;
+	fragment.crc = crc32(crc32(0, NULL, 0), (const Bytef *)text.data(), text.size());
+	fragment.adler = adler32(adler32(0, NULL, 0), (const Bytef *)text.data(), text.size());
+	fragment.length = text.size();
+
+	// A raw stream (no zlib header), flushed to a byte boundary but not finished, so more can follow it.
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	deflateInit2(&stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+	fragment.deflated.resize(deflateBound(&stream, text.size()) + 16);
+	stream.next_in = (Bytef *)text.data();
+	stream.avail_in = text.size();
+	stream.next_out = (Bytef *)&fragment.deflated[0];
+	stream.avail_out = fragment.deflated.size();
+	deflate(&stream, Z_SYNC_FLUSH);
+	fragment.deflated.resize(stream.total_out);
+	deflateEnd(&stream);
+	return fragment;
+}
+
+bool ResponseCache::inflate(const Fragment &fragment, std::string &text) {
+	z_stream stream;
+	memset(&stream, 0, sizeof(stream));
+	if(inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+		return false;
+	}
+	size_t start = text.size();
+	text.resize(start + fragment.length);
+	stream.next_in = (Bytef *)fragment.deflated.data();
+	stream.avail_in = fragment.deflated.size();
+	stream.next_out = (Bytef *)&text[start];
+	stream.avail_out = fragment.length;
+	int status = ::inflate(&stream, Z_SYNC_FLUSH);
+	bool ok = (status == Z_OK || status == Z_BUF_ERROR) && stream.total_out == fragment.length && stream.avail_in == 0;
+	inflateEnd(&stream);
+	if(!ok) {
+		text.resize(start);
+	}
+	return ok;
+}
+
+std::string ResponseCache::encode(const std::vector<Fragment> &fragments, Encoding encoding) {
+	uint32_t crc = crc32(0, NULL, 0), adler = adler32(0, NULL, 0);
+	uint64_t length = 0;
+	size_t size = 0;
+	for(const Fragment &fragment : fragments) {
+		crc = crc32_combine(crc, fragment.crc, fragment.length);
+		adler = adler32_combine(adler, fragment.adler, fragment.length);
+		length += fragment.length;
+		size += fragment.deflated.size();
+	}
+
+	std::string body;
+	body.reserve(size + 32);
+	if(encoding == GZIP) {
+		// Magic, deflate, no flags, no modification time, no extra flags, Unix.
+		body.append("\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03", 10);
+	}
+	else {
+		// Deflate with a 32 KB window, default level; the check bits make the header a multiple of 31.
+		body.append("\x78\x9c", 2);
+	}
+	for(const Fragment &fragment : fragments) {
+		body += fragment.deflated;
+	}
+	body.append(finalBlock, sizeof(finalBlock));
+	if(encoding == GZIP) {
+		appendLittleEndian(body, crc);
+		appendLittleEndian(body, (uint32_t)length);
+	}
+	else {
+		appendBigEndian(body, adler);
+	}
+	return body;
+}
+
+ResponseCache::ResponseCache(const std::string &directory) : directory(directory) {
+	if(!privateDirectory(directory)) {
+		this->directory.clear();
+	}
+}
+
+std::string ResponseCache::chapterPath(const std::string &version, const Ref &ref) {
+	if(directory.empty() || version.empty() || version.find('/') != std::string::npos || version[0] == '.') {
+		return "";
+	}
+	return directory + "/" + version + "." + std::to_string(ref.getBook()) + "." + std::to_string(ref.getChapter());
+}
+
+bool ResponseCache::load(const std::string &path, const std::string &stamp, Fragment &fragment) {
+	// The stamp is public, so a file planted by another user could match it; only this user's are read.
+	int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd == -1) {
+		return false;
+	}
+	std::string contents;
+	bool loaded = ownedFile(fd) && readAll(fd, contents);
+	close(fd);
+	if(!loaded) {
+		return false;
+	}
+
+	std::istringstream in(contents);
+	std::string magic, fileStamp;
+	size_t size = 0;
+	if(!getline(in, magic) || magic != cacheMagic || !getline(in, fileStamp) || fileStamp != stamp
+			|| !(in >> fragment.crc >> fragment.adler >> fragment.length >> size) || in.get() != '\n') {
+		return false;
+	}
+	fragment.deflated.resize(size);
+	return size == 0 || in.read(&fragment.deflated[0], size);
+}
+
+void ResponseCache::store(const std::string &path, const std::string &stamp, const Fragment &fragment) {
+	std::string temporary = path + "." + std::to_string(getpid());
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if(fd == -1) {
+		return;
+	}
+	std::string header = std::string(cacheMagic) + "\n" + stamp + "\n" + std::to_string(fragment.crc) + " "
+		+ std::to_string(fragment.adler) + " " + std::to_string(fragment.length) + " " + std::to_string(fragment.deflated.size()) + "\n";
+	bool written = writeAll(fd, header.data(), header.size()) && writeAll(fd, fragment.deflated.data(), fragment.deflated.size());
+	close(fd);
+	if(!written || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+	}
+}
+
+bool ResponseCache::chapter(const std::string &version, const std::string &file, const Ref &ref,
+		const std::function<bool(std::string &html, std::string &stamp)> &render, Fragment &fragment) {
+	std::string path = chapterPath(version, ref), stamp = Bible::fileStamp(file);
+	if(!path.empty() && !stamp.empty() && load(path, stamp, fragment)) {
+		return true;
+	}
+
+	std::string html, rendered;
+	if(!render(html, rendered)) {
+		return false;
+	}
+	// Compressed once and served many times, so worth the best compression.
+	fragment = compress(html, Z_BEST_COMPRESSION);
+	if(!path.empty() && !stamp.empty() && rendered == stamp) {
+		store(path, stamp, fragment);
+	}
+	return true;
+}
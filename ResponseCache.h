@@ -0,0 +1,77 @@
+// Class ResponseCache
+// Computer Science, MVNU
+//
+// A ResponseCache keeps the HTML of whole chapters, compressed, in files shared
+// by every run of the CGI, keyed by version and chapter, so a popular chapter is
+// looked up, rendered and compressed once and afterwards served as stored bytes.
+// Each chapter is a Fragment: a raw deflate stream cut off with a sync flush, so
+// fragments (and text compressed on the spot) can be joined into one gzip or
+// zlib body by concatenation, with the checksums combined (crc32_combine,
+// adler32_combine) rather than computed over the whole body again.
+// A cached chapter records the size and modification time of its version's
+// file, and is rendered again once the file changes.
+// The directory and its files must be the user's own (see PrivateFiles.h), since
+// their bytes are sent as they are; otherwise nothing is cached.
+
+#ifndef ResponseCache_H
+#define ResponseCache_H
+
+#include "Bible.h"
+#include "Ref.h"
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class ResponseCache {
+ public:
+   // Content codings a response can be sent in.
+   enum Encoding { IDENTITY, GZIP, DEFLATE };
+
+   // Text compressed as a piece of a deflate stream.
+   struct Fragment {
+      std::string deflated;	// Raw deflate data, ending byte-aligned and not final.
+      uint32_t crc;			// CRC-32 of the text.
+      uint32_t adler;		// Adler-32 of the text.
+      uint64_t length;		// Length of the text.
+   };
+
+   // Choose the coding for an Accept-Encoding header (which may be NULL): gzip if accepted, else deflate, else none.
+   static Encoding negotiate(const char *acceptEncoding);
+
+   // Name of a coding for the Content-Encoding header ("" for IDENTITY).
+   static const char *encodingName(Encoding encoding);
+
+   // Compress text into a fragment, at a zlib compression level.
+   static Fragment compress(const std::string &text, int level = -1);
+
+   // Decompress a fragment back into text, appending it to text. Returns false if it is corrupt.
+   static bool inflate(const Fragment &fragment, std::string &text);
+
+   // Join fragments into a complete body in a coding (other than IDENTITY).
+   static std::string encode(const std::vector<Fragment> &fragments, Encoding encoding);
+
+   // Use the cache files in a directory, creating it if needed. Nothing is cached if it is not private to this user.
+   ResponseCache(const std::string &directory);
+
+   // Get the fragment of a whole chapter of a version, whose text is in file. If it is not cached (or is out of
+   // date) render is called to produce its HTML and give the Bible::fileStamp of the text it rendered ("" if not
+   // known). The HTML is compressed, and stored only if that is the file's stamp: text rendered from a version
+   // the server has not yet reloaded is never kept as the new file's. Returns false if render fails.
+   bool chapter(const std::string &version, const std::string &file, const Ref &ref,
+      const std::function<bool(std::string &html, std::string &stamp)> &render, Fragment &fragment);
+
+ private:
+   std::string directory;	// Empty if it cannot be trusted.
+
+   // Path of a chapter's cache file, or "" if the version cannot name a file (or there is no directory).
+   std::string chapterPath(const std::string &version, const Ref &ref);
+
+   // Read a cached fragment, if present, stored by this user and stamped with stamp.
+   static bool load(const std::string &path, const std::string &stamp, Fragment &fragment);
+
+   // Write a fragment to the cache (replacing any file at once, for readers running alongside).
+   static void store(const std::string &path, const std::string &stamp, const Fragment &fragment);
+};
+
+#endif //ResponseCache_H
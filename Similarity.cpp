@@ -0,0 +1,215 @@
+// SimilarityIndex class function definitions
+// Computer Science, MVNU
+
+#include "Similarity.h"
+#include "TextIndex.h"
+#include "TextScan.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_GATHER
+#endif
+using namespace std;
+
+// Verses scored by one task.
+static const size_t chunkVerses = 4096;
+
+// A scored verse ordinal.
+typedef std::pair<float, uint32_t> Scored;
+
+// Higher scores first, then lower ordinals (reference order).
+static bool better(const Scored &a, const Scored &b) {
+	return a.first > b.first || (a.first == b.first && a.second < b.second);
+}
+
+// Multiply each weight by the query's weight for its term: out[i] = weights[i] * dense[terms[i]].
+static void gatherProducts(const uint32_t *terms, const float *weights, const float *dense, size_t count, float *out) {
+	for(size_t i = 0; i < count; i++) {
+		out[i] = weights[i] * dense[terms[i]];
+	}
+}
+
+#ifdef HAVE_AVX2_GATHER
+// The same, gathering eight query weights at a time.
+__attribute__((target("avx2")))
+static void gatherProductsAvx2(const uint32_t *terms, const float *weights, const float *dense, size_t count, float *out) {
+	size_t i = 0;
+	for(; i + 8 <= count; i += 8) {
+		__m256i index = _mm256_loadu_si256((const __m256i *)(terms + i));
+		__m256 query = _mm256_i32gather_ps(dense, index, 4);
+		_mm256_storeu_ps(out + i, _mm256_mul_ps(query, _mm256_loadu_ps(weights + i)));
+	}
+	gatherProducts(terms + i, weights + i, dense, count - i, out + i);
+}
+#endif
+
+void SimilarityIndex::countTerms(const std::string &text, std::vector<std::pair<std::string, uint32_t>> &counts) {
+	std::vector<std::string> words = TextIndex::tokenize(text);
+	std::sort(words.begin(), words.end());
+	counts.clear();
+	for(const std::string &word : words) {
+		if(counts.empty() || counts.back().first != word) {
+			counts.push_back(make_pair(word, 0));
+		}
+		counts.back().second++;
+	}
+}
+
+void SimilarityIndex::addVerse(const Ref &ref, const std::string &text) {
+	if(starts.empty()) {
+		starts.push_back(0);
+	}
+
+	std::vector<std::pair<std::string, uint32_t>> counts;
+	countTerms(text, counts);
+	for(const std::pair<std::string, uint32_t> &count : counts) {
+		uint32_t id = vocabulary.emplace(count.first, vocabulary.size()).first->second;
+		if(id == verseCounts.size()) {
+			verseCounts.push_back(0);
+		}
+		verseCounts[id]++;
+		terms.push_back(id);
+		weights.push_back(count.second);
+	}
+	refs.push_back(ref);
+	starts.push_back(terms.size());
+}
+
+void SimilarityIndex::finish() {
+	if(starts.empty()) {
+		starts.push_back(0);
+	}
+
+	// Terms in every verse carry no weight.
+	idf.resize(verseCounts.size());
+	for(size_t id = 0; id < idf.size(); id++) {
+		idf[id] = std::log((double)refs.size() / verseCounts[id]);
+	}
+	std::vector<uint32_t>().swap(verseCounts);
+
+	// Weight each count as (1 + log tf) * idf, and normalize each verse's vector.
+	for(size_t v = 0; v < refs.size(); v++) {
+		double norm = 0;
+		for(uint32_t i = starts[v]; i < starts[v + 1]; i++) {
+			weights[i] = (1 + std::log(weights[i])) * idf[terms[i]];
+			norm += (double)weights[i] * weights[i];
+		}
+		norm = std::sqrt(norm);
+		for(uint32_t i = starts[v]; i < starts[v + 1] && norm > 0; i++) {
+			weights[i] /= norm;
+		}
+	}
+	terms.shrink_to_fit();
+	weights.shrink_to_fit();
+}
+
+std::vector<SimilarityIndex::Match> SimilarityIndex::similar(const std::string &text, size_t limit, const Ref &exclude,
+		unsigned threads, bool allowSimd) const {
+	std::vector<Match> matches;
+	if(limit == 0 || refs.empty()) {
+		return matches;
+	}
+
+	// Weight the text like a verse, spread over a dense array by term id.
+	std::vector<float> dense(vocabulary.size(), 0);
+	std::vector<std::pair<std::string, uint32_t>> counts;
+	countTerms(text, counts);
+	double norm = 0;
+	for(const std::pair<std::string, uint32_t> &count : counts) {
+		std::unordered_map<std::string, uint32_t>::const_iterator term = vocabulary.find(count.first);
+		if(term != vocabulary.end()) {
+			dense[term->second] = (1 + std::log(count.second)) * idf[term->second];
+			norm += (double)dense[term->second] * dense[term->second];
+		}
+	}
+	if(norm == 0) {
+		return matches;
+	}
+	for(float &weight : dense) {
+		weight /= std::sqrt(norm);
+	}
+
+	std::vector<Ref>::const_iterator excluded = std::lower_bound(refs.begin(), refs.end(), exclude);
+	uint32_t excludeOrdinal = (excluded != refs.end() && *excluded == exclude) ? excluded - refs.begin() : UINT32_MAX;
+#ifdef HAVE_AVX2_GATHER
+	bool simd = allowSimd && cpuHasAvx2();
+#endif
+
+	// Each task keeps the best verses of its chunk in a bounded heap, worst on top.
+	size_t tasks = (refs.size() + chunkVerses - 1) / chunkVerses;
+	std::vector<std::vector<Scored>> best(tasks);
+	std::atomic<size_t> next(0);
+	auto work = [&]() {
+		std::vector<float> products;
+		for(size_t t; (t = next++) < tasks;) {
+			size_t begin = t * chunkVerses, end = std::min(refs.size(), begin + chunkVerses);
+			uint32_t first = starts[begin], count = starts[end] - first;
+			products.resize(count);
+#ifdef HAVE_AVX2_GATHER
+			if(simd) {
+				gatherProductsAvx2(terms.data() + first, weights.data() + first, dense.data(), count, products.data());
+			}
+			else
+#endif
+			gatherProducts(terms.data() + first, weights.data() + first, dense.data(), count, products.data());
+
+			std::vector<Scored> &heap = best[t];
+			for(size_t v = begin; v < end; v++) {
+				float score = 0;
+				for(uint32_t i = starts[v] - first; i < starts[v + 1] - first; i++) {
+					score += products[i];
+				}
+				if(score <= 0 || v == excludeOrdinal) {
+					continue;
+				}
+				Scored scored(score, v);
+				if(heap.size() < limit) {
+					heap.push_back(scored);
+					std::push_heap(heap.begin(), heap.end(), better);
+				}
+				else if(better(scored, heap.front())) {
+					std::pop_heap(heap.begin(), heap.end(), better);
+					heap.back() = scored;
+					std::push_heap(heap.begin(), heap.end(), better);
+				}
+			}
+		}
+	};
+
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::max<size_t>(1, std::min<size_t>(threads, tasks));
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+
+	// Merge the chunks' best.
+	std::vector<Scored> all;
+	for(const std::vector<Scored> &heap : best) {
+		all.insert(all.end(), heap.begin(), heap.end());
+	}
+	std::sort(all.begin(), all.end(), better);
+	all.resize(std::min(all.size(), limit));
+	for(const Scored &scored : all) {
+		matches.push_back(Match{refs[scored.second], scored.first});
+	}
+	return matches;
+}
+
+size_t SimilarityIndex::memoryUsage() const {
+	size_t vocabularyBytes = 0;
+	for(const auto &entry : vocabulary) {
+		vocabularyBytes += sizeof(entry) + entry.first.capacity() + sizeof(void *);
+	}
+	return sizeof(SimilarityIndex) + vocabularyBytes + idf.capacity() * sizeof(float) + refs.capacity() * sizeof(Ref)
+		+ starts.capacity() * sizeof(uint32_t) + terms.capacity() * sizeof(uint32_t) + weights.capacity() * sizeof(float);
+}
@@ -0,0 +1,61 @@
+// Class SimilarityIndex
+// Computer Science, MVNU
+//
+// A SimilarityIndex holds a sparse TF-IDF vector for every verse of one Bible
+// version, L2-normalized, in compressed sparse rows (a term id and weight per
+// distinct term of the verse). The verses most similar to a text are those whose
+// vectors have the greatest dot product (cosine similarity) with the text's vector.
+// Scoring spreads the query over a dense array, gathers it at each verse's terms
+// (eight at a time with AVX2 where the CPU supports it), and keeps the best verses
+// of each chunk in a bounded heap, with chunks scored in parallel.
+
+#ifndef Similarity_H
+#define Similarity_H
+
+#include "Ref.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class SimilarityIndex {
+ public:
+   // A verse and its cosine similarity to the query.
+   struct Match {
+      Ref ref;
+      float score;
+   };
+
+   // Add the next verse (in reference order) to the index.
+   void addVerse(const Ref &ref, const std::string &text);
+
+   // Finish building, weighting and normalizing the verse vectors. No verses may be added afterwards.
+   void finish();
+
+   // Find up to limit verses most similar to a text, best first (ties in reference order), leaving out
+   // the verse exclude (pass an invalid Ref to keep all). Verses sharing no terms with the text are not returned.
+   // Scores chunks on up to threads threads (0 for one per core), with AVX2 unless allowSimd is false.
+   std::vector<Match> similar(const std::string &text, size_t limit, const Ref &exclude,
+      unsigned threads = 0, bool allowSimd = true) const;
+
+   // Number of indexed verses.
+   size_t size() const { return refs.size(); }
+
+   // Estimate the memory used by the index, in bytes.
+   size_t memoryUsage() const;
+
+ private:
+   std::unordered_map<std::string, uint32_t> vocabulary;	// Term ids.
+   std::vector<uint32_t> verseCounts;	// Number of verses containing each term, while building.
+   std::vector<float> idf;		// Inverse document frequency of each term.
+
+   std::vector<Ref> refs;		// Verse references by ordinal.
+   std::vector<uint32_t> starts;	// Index of each verse's first entry in terms and weights, plus the end.
+   std::vector<uint32_t> terms;		// Term ids of each verse's distinct terms.
+   std::vector<float> weights;		// Term counts until finish, then normalized TF-IDF weights.
+
+   // Count the occurrences of each distinct term of a text, in term order.
+   static void countTerms(const std::string &text, std::vector<std::pair<std::string, uint32_t>> &counts);
+};
+
+#endif //Similarity_H
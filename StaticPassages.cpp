@@ -0,0 +1,227 @@
+// StaticPassages class function definitions
+// Computer Science, MVNU
+
+#include "StaticPassages.h"
+#include "Bible.h"
+#include "PrivateFiles.h"
+#include "Render.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+using namespace std;
+
+// First line of every index file.
+static const char *indexMagic = "BIBLEPRE";
+
+// The entries start after the header lines, at a multiple of this.
+static const size_t entryAlignment = 8;
+
+static Ref entryRef(const StaticPassages::Entry &entry) {
+	return Ref(entry.book, entry.chapter, entry.verse);
+}
+
+StaticPassages::Chapter StaticPassages::render(const std::vector<Verse> &verses) {
+	Chapter chapter;
+	if(verses.empty()) {
+		return chapter;
+	}
+	Verse first = verses.front();
+	renderChapterHeading(first.getRef(), chapter.html);
+	for(Verse verse : verses) {
+		Ref ref = verse.getRef();
+		Entry entry{ref.getBook(), ref.getChapter(), ref.getVerse(), 0, 0, chapter.html.size(), 0};
+		renderVerse(verse, chapter.html);
+		entry.end = chapter.html.size();
+		chapter.entries.push_back(entry);
+	}
+	return chapter;
+}
+
+std::string StaticPassages::htmlPath(const std::string &directory, const std::string &version) {
+	return directory + "/" + version + ".html";
+}
+
+std::string StaticPassages::indexPath(const std::string &directory, const std::string &version) {
+	return directory + "/" + version + ".idx";
+}
+
+bool StaticPassages::write(const std::string &directory, const std::string &version, const std::string &stamp,
+		const std::vector<Chapter> &chapters) {
+	if(!privateDirectory(directory)) {
+		return false;
+	}
+	std::string html = htmlPath(directory, version), index = indexPath(directory, version);
+	std::string htmlTemporary = html + "." + std::to_string(getpid()), indexTemporary = index + "." + std::to_string(getpid());
+
+	// The chapters back to back, with each entry moved to its chapter's place in the file.
+	std::vector<Entry> entries;
+	uint64_t size = 0;
+	{
+		std::ofstream out(htmlTemporary, ios::binary | ios::trunc);
+		for(const Chapter &chapter : chapters) {
+			out.write(chapter.html.data(), chapter.html.size());
+			for(Entry entry : chapter.entries) {
+				entry.heading = size;
+				entry.start += size;
+				entry.end += size;
+				entries.push_back(entry);
+			}
+			size += chapter.html.size();
+		}
+		if(!out) {
+			out.close();
+			unlink(htmlTemporary.c_str());
+			return false;
+		}
+	}
+	{
+		std::string header = std::string(indexMagic) + "\n" + stamp + "\n" + std::to_string(size) + " "
+			+ std::to_string(entries.size()) + "\n";
+		header.resize((header.size() + entryAlignment - 1) / entryAlignment * entryAlignment, '\n');
+		std::ofstream out(indexTemporary, ios::binary | ios::trunc);
+		out.write(header.data(), header.size());
+		out.write((const char *)entries.data(), entries.size() * sizeof(Entry));
+		if(!out) {
+			out.close();
+			unlink(htmlTemporary.c_str());
+			unlink(indexTemporary.c_str());
+			return false;
+		}
+	}
+
+	// The HTML goes in place first, so an index is never read alongside the wrong HTML for long;
+	// its size is checked as well.
+	if(rename(htmlTemporary.c_str(), html.c_str()) != 0 || rename(indexTemporary.c_str(), index.c_str()) != 0) {
+		unlink(htmlTemporary.c_str());
+		unlink(indexTemporary.c_str());
+		return false;
+	}
+	return true;
+}
+
+StaticPassages::StaticPassages(const std::string &directory, const std::string &version, const std::string &file)
+		: fd(-1), mapping(NULL), length(0), entries(NULL), count(0) {
+	if(version.empty() || version.find('/') != std::string::npos || version[0] == '.') {
+		return;
+	}
+	// The files are sent as they are, so only this user's, in a directory only this user can change, are used.
+	stamp = Bible::fileStamp(file);
+	if(stamp.empty() || !privateDirectory(directory)) {
+		return;
+	}
+	int indexFd = open(indexPath(directory, version).c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(indexFd < 0) {
+		return;
+	}
+	struct stat info;
+	if(ownedFile(indexFd) && fstat(indexFd, &info) == 0 && info.st_size > 0) {
+		void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, indexFd, 0);
+		if(mapped != MAP_FAILED) {
+			mapping = (const char *)mapped;
+			length = info.st_size;
+		}
+	}
+	close(indexFd);
+	if(!mapping) {
+		return;
+	}
+
+	// "BIBLEPRE", the text's stamp, then the HTML size and the entry count, each on a line.
+	const char *end = mapping + length;
+	const char *magicEnd = (const char *)memchr(mapping, '\n', length);
+	const char *stampEnd = magicEnd ? (const char *)memchr(magicEnd + 1, '\n', end - magicEnd - 1) : NULL;
+	const char *sizesEnd = stampEnd ? (const char *)memchr(stampEnd + 1, '\n', end - stampEnd - 1) : NULL;
+	if(!sizesEnd || std::string(mapping, magicEnd) != indexMagic || std::string(magicEnd + 1, stampEnd) != stamp) {
+		return;
+	}
+	std::string sizes(stampEnd + 1, sizesEnd);
+	char *rest;
+	uint64_t htmlSize = strtoull(sizes.c_str(), &rest, 10);
+	size_t entryCount = strtoull(rest, NULL, 10);
+	size_t offset = (sizesEnd + 1 - mapping + entryAlignment - 1) / entryAlignment * entryAlignment;
+	if(offset > length || (length - offset) / sizeof(Entry) < entryCount) {
+		return;
+	}
+
+	// Every span is sent straight from its offsets, so each entry must lie within the HTML, in order.
+	const Entry *stored = (const Entry *)(mapping + offset);
+	for(size_t i = 0; i < entryCount; i++) {
+		if(stored[i].heading > stored[i].start || stored[i].start > stored[i].end || stored[i].end > htmlSize
+				|| (i > 0 && !(entryRef(stored[i - 1]) < entryRef(stored[i])))) {
+			return;
+		}
+	}
+
+	fd = open(htmlPath(directory, version).c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd >= 0 && (!ownedFile(fd) || fstat(fd, &info) != 0 || (uint64_t)info.st_size != htmlSize)) {
+		close(fd);
+		fd = -1;
+	}
+	if(fd >= 0) {
+		entries = stored;
+		count = entryCount;
+	}
+}
+
+StaticPassages::~StaticPassages() {
+	if(mapping) {
+		munmap((void *)mapping, length);
+	}
+	if(fd >= 0) {
+		close(fd);
+	}
+}
+
+bool StaticPassages::valid() {
+	return fd >= 0 && entries;
+}
+
+bool StaticPassages::passage(const Ref &first, const Ref &last, size_t limit, std::vector<Span> &spans) {
+	spans.clear();
+	if(!valid()) {
+		return false;
+	}
+	const Entry *end = entries + count;
+	const Entry *entry = std::lower_bound(entries, end, first, [](const Entry &entry, const Ref &ref) {
+		return entryRef(entry) < ref;
+	});
+	if(entry == end || !(entryRef(*entry) == first)) {
+		return false;
+	}
+
+	for(size_t taken = 0; taken < limit && entry != end && entry->book == first.getBook() && !(last < entryRef(*entry));
+			taken++, entry++) {
+		if(spans.empty() || spans.back().heading != entry->heading) {
+			// Into a chapter: whole so far if nothing of it comes before this verse.
+			spans.push_back(Span{entryRef(*entry), entry->heading, entry->start, entry->end,
+				entry == entries || entry[-1].heading != entry->heading});
+		}
+		spans.back().end = entry->end;
+	}
+
+	// The last chapter is only whole if the passage reached its last verse.
+	if(entry != end && entry->heading == spans.back().heading) {
+		spans.back().whole = false;
+	}
+	return true;
+}
+
+bool StaticPassages::read(uint64_t start, uint64_t end, std::string &html) {
+	size_t size = html.size();
+	html.resize(size + (end - start));
+	size_t done = 0;
+	while(done < end - start) {
+		ssize_t got = pread(fd, &html[size + done], end - start - done, start + done);
+		if(got <= 0) {
+			html.resize(size);
+			return false;
+		}
+		done += got;
+	}
+	return true;
+}
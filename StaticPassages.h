@@ -0,0 +1,92 @@
+// Class StaticPassages
+// Computer Science, MVNU
+//
+// StaticPassages holds a version rendered ahead of time: every chapter, in
+// order, as the HTML bibleajax shows for it (a heading, then a paragraph per
+// verse), in one file, "<version>.html", with an index of where each verse and
+// each chapter heading starts in it, "<version>.idx". Verses follow each other
+// in the file as a passage shows them, so any passage within a book is one span
+// of the file (after a heading, if it starts mid-chapter), sent as it is.
+// The index records the size and modification time of the version's text file,
+// and is not used once the text changes.
+// The files are sent as they are, so they are only used from a directory private
+// to the user (see PrivateFiles.h), if they are the user's own and every entry of
+// the index lies within the HTML file.
+
+#ifndef StaticPassages_H
+#define StaticPassages_H
+
+#include "Ref.h"
+#include "Verse.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class StaticPassages {
+ public:
+   // Where a verse is in the HTML file.
+   struct Entry {
+      int16_t book, chapter, verse, unused;
+      uint64_t heading;	// Start of its chapter's heading.
+      uint64_t start;	// Start of its paragraph.
+      uint64_t end;		// End of its paragraph.
+   };
+
+   // A chapter rendered on its own, with offsets from the start of its HTML.
+   struct Chapter {
+      std::string html;
+      std::vector<Entry> entries;
+   };
+
+   // The part of a passage in one chapter.
+   struct Span {
+      Ref first;			// Its first verse.
+      uint64_t heading;	// Start of the chapter's heading.
+      uint64_t start;		// Start of the first verse.
+      uint64_t end;		// End of the last verse.
+      bool whole;			// True if it has every verse of the chapter.
+   };
+
+   // Render a chapter's verses (which must all be from one chapter, in order).
+   static Chapter render(const std::vector<Verse> &verses);
+
+   // Write a version's chapters, in order, to directory, stamped with the stamp of its text file.
+   // Returns false if the files could not be written (or the directory is not private to this user).
+   static bool write(const std::string &directory, const std::string &version, const std::string &stamp,
+      const std::vector<Chapter> &chapters);
+
+   // Open a version's files in directory, if they were rendered from the current text in file and can be trusted.
+   StaticPassages(const std::string &directory, const std::string &version, const std::string &file);
+   ~StaticPassages();
+   StaticPassages(const StaticPassages &) = delete;
+   StaticPassages &operator=(const StaticPassages &) = delete;
+
+   // Check if the files could be used.
+   bool valid();
+
+   // Descriptor of the HTML file, for reading spans from.
+   int getFd() { return fd; }
+
+   // The Bible::fileStamp of the text the files were rendered from (that of the version's file when opened).
+   std::string getStamp() { return stamp; }
+
+   // Split a passage into spans, one per chapter: up to count verses from first (which must be in
+   // the version), staying in first's book and ending by last. Returns false if first is not in it.
+   bool passage(const Ref &first, const Ref &last, size_t count, std::vector<Span> &spans);
+
+   // Read a span of the HTML file, appending it to html. Returns false if it could not be read.
+   bool read(uint64_t start, uint64_t end, std::string &html);
+
+ private:
+   int fd;
+   std::string stamp;
+   const char *mapping;	// The index file.
+   size_t length;
+   const Entry *entries;
+   size_t count;
+
+   static std::string htmlPath(const std::string &directory, const std::string &version);
+   static std::string indexPath(const std::string &directory, const std::string &version);
+};
+
+#endif //StaticPassages_H
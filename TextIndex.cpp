@@ -0,0 +1,479 @@
+// TextIndex class function definitions
+// Computer Science, MVNU
+
+#include "TextIndex.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <functional>
+#include <thread>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+using namespace std;
+
+// Lists this many times longer than the other are searched by galloping.
+static const size_t gallopRatio = 32;
+
+// Append an unsigned value in LEB128 varint form.
+static void putVarint(std::vector<uint8_t> &out, uint32_t value) {
+	while(value >= 0x80) {
+		out.push_back((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out.push_back(value);
+}
+
+// Read a varint, advancing p.
+static uint32_t getVarint(const uint8_t *&p) {
+	uint32_t value = 0;
+	int shift = 0;
+	while(*p & 0x80) {
+		value |= (uint32_t)(*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	value |= (uint32_t)(*p++) << shift;
+	return value;
+}
+
+TextIndex::TextIndex() {}
+
+std::vector<std::string> TextIndex::tokenize(const std::string &text) {
+	std::vector<std::string> tokens;
+	std::string token;
+
+	for(char c : text) {
+		unsigned char u = c;
+		// Letters, digits and non-ASCII bytes (parts of UTF-8 characters) make up words; apostrophes are dropped.
+		if(isalnum(u) || u >= 0x80) {
+			token += tolower(u);
+		}
+		else if(c != '\'' && !token.empty()) {
+			tokens.push_back(token);
+			token.clear();
+		}
+	}
+	if(!token.empty()) {
+		tokens.push_back(token);
+	}
+	return tokens;
+}
+
+void TextIndex::addVerse(const Ref &ref, const std::string &text) {
+	refs.push_back(ref);
+	pending.push_back(text);
+}
+
+// One thread's postings for a term over a contiguous range of verses.
+// The first ordinal is encoded relative to 0 and fixed up when chunks are merged.
+struct ChunkPostings {
+	std::vector<uint8_t> bytes;
+	uint32_t verses = 0;
+	uint32_t last = 0;	// Last ordinal added.
+};
+typedef std::unordered_map<std::string, ChunkPostings> ChunkIndex;
+
+// Index verses [begin, end) of texts into chunk.
+static void indexChunk(const std::vector<std::string> &texts, size_t begin, size_t end, ChunkIndex &chunk) {
+	std::vector<std::pair<std::string, uint32_t>> words;
+
+	for(size_t ordinal = begin; ordinal < end; ordinal++) {
+		// Pair each word with its position, grouped by word.
+		std::vector<std::string> tokens = TextIndex::tokenize(texts[ordinal]);
+		words.clear();
+		for(size_t position = 0; position < tokens.size(); position++) {
+			words.push_back(std::make_pair(std::move(tokens[position]), (uint32_t)position));
+		}
+		std::sort(words.begin(), words.end());
+
+		for(size_t i = 0; i < words.size();) {
+			size_t j = i;
+			while(j < words.size() && words[j].first == words[i].first) {
+				j++;
+			}
+
+			// Encode (ordinal delta, count, position deltas...).
+			ChunkPostings &list = chunk[words[i].first];
+			putVarint(list.bytes, ordinal - (list.verses ? list.last : 0));
+			putVarint(list.bytes, j - i);
+			uint32_t previous = 0;
+			for(size_t k = i; k < j; k++) {
+				putVarint(list.bytes, words[k].second - previous);
+				previous = words[k].second;
+			}
+			list.verses++;
+			list.last = ordinal;
+
+			i = j;
+		}
+	}
+}
+
+void TextIndex::finish(unsigned threads) {
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	// Keep chunks big enough to be worth a thread.
+	threads = std::max<size_t>(1, std::min<size_t>(threads, pending.size() / 1024));
+
+	// Index contiguous ranges of verses in parallel.
+	std::vector<ChunkIndex> chunks(threads);
+	std::vector<std::thread> workers;
+	for(unsigned t = 0; t < threads; t++) {
+		size_t begin = pending.size() * t / threads, end = pending.size() * (t + 1) / threads;
+		workers.push_back(std::thread(indexChunk, std::cref(pending), begin, end, std::ref(chunks[t])));
+	}
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+
+	// Gather each term's pieces in chunk order.
+	std::unordered_map<std::string, std::vector<const ChunkPostings *>> pieces;
+	for(const ChunkIndex &chunk : chunks) {
+		for(const auto &entry : chunk) {
+			pieces[entry.first].push_back(&entry.second);
+		}
+	}
+
+	// Concatenate the pieces, re-encoding each piece's first ordinal relative to the previous piece.
+	for(const auto &entry : pieces) {
+		Term term;
+		term.start = postings.size();
+		term.verses = 0;
+
+		uint32_t last = 0;
+		for(const ChunkPostings *piece : entry.second) {
+			const uint8_t *p = piece->bytes.data();
+			uint32_t first = getVarint(p);
+			putVarint(postings, first - last);
+			postings.insert(postings.end(), p, piece->bytes.data() + piece->bytes.size());
+			term.verses += piece->verses;
+			last = piece->last;
+		}
+
+		term.length = postings.size() - term.start;
+		terms[entry.first] = term;
+	}
+
+	pending.clear();
+	pending.shrink_to_fit();
+	postings.shrink_to_fit();
+	refs.shrink_to_fit();
+
+	std::vector<std::pair<std::string, uint32_t>> keys;
+	std::vector<uint32_t> weights;
+	keys.reserve(terms.size());
+	weights.reserve(terms.size());
+	for(const auto &entry : terms) {
+		keys.push_back(std::make_pair(entry.first, 0));
+		weights.push_back(entry.second.verses);
+	}
+	completer = Completer(keys, weights);
+}
+
+std::vector<std::string> TextIndex::complete(const std::string &prefix, size_t limit) const {
+	// Normalize the prefix like the text, keeping a partial last word.
+	std::string normalized;
+	for(char c : prefix) {
+		unsigned char u = c;
+		if(isalnum(u) || u >= 0x80) {
+			normalized += tolower(u);
+		}
+	}
+
+	std::vector<std::string> words;
+	for(Completer::Completion &completion : completer.complete(normalized, limit)) {
+		words.push_back(completion.key);
+	}
+	return words;
+}
+
+void TextIndex::decode(const Term &term, Postings &out) const {
+	out.ordinals.resize(term.verses);
+	out.counts.resize(term.verses);
+	out.positionStart.resize(term.verses);
+	out.positions.clear();
+
+	const uint8_t *p = postings.data() + term.start;
+	uint32_t ordinal = 0;
+	for(uint32_t i = 0; i < term.verses; i++) {
+		ordinal += getVarint(p);
+		out.ordinals[i] = ordinal;
+		out.counts[i] = getVarint(p);
+		out.positionStart[i] = out.positions.size();
+
+		uint32_t position = 0;
+		for(uint32_t k = 0; k < out.counts[i]; k++) {
+			position += getVarint(p);
+			out.positions.push_back(position);
+		}
+	}
+}
+
+void intersectSorted(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+		std::vector<uint32_t> &out, std::vector<uint32_t> &positionsA, std::vector<uint32_t> &positionsB) {
+	// Walk the shorter list, finding each of its values in the longer one.
+	if(a.size() > b.size()) {
+		intersectSorted(b, a, out, positionsB, positionsA);
+		return;
+	}
+
+	size_t j = 0;
+	if(a.empty() || b.size() / a.size() >= gallopRatio) {
+		for(size_t i = 0; i < a.size() && j < b.size(); i++) {
+			// Gallop forward to bracket the value, then binary search the bracket.
+			size_t step = 1;
+			while(j + step < b.size() && b[j + step] < a[i]) {
+				step *= 2;
+			}
+			j = std::lower_bound(b.begin() + j, b.begin() + std::min(j + step + 1, b.size()), a[i]) - b.begin();
+			if(j < b.size() && b[j] == a[i]) {
+				out.push_back(a[i]);
+				positionsA.push_back(i);
+				positionsB.push_back(j);
+			}
+		}
+		return;
+	}
+
+	for(size_t i = 0; i < a.size(); i++) {
+		uint32_t value = a[i];
+#ifdef __SSE2__
+		// Skip whole blocks of four that are below the value, then compare a block at once.
+		while(j + 4 <= b.size() && b[j + 3] < value) {
+			j += 4;
+		}
+		if(j + 4 <= b.size()) {
+			__m128i block = _mm_loadu_si128((const __m128i *)&b[j]);
+			int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(block, _mm_set1_epi32(value))));
+			if(mask) {
+				out.push_back(value);
+				positionsA.push_back(i);
+				positionsB.push_back(j + __builtin_ctz(mask));
+			}
+			continue;
+		}
+#endif
+		while(j < b.size() && b[j] < value) {
+			j++;
+		}
+		if(j < b.size() && b[j] == value) {
+			out.push_back(value);
+			positionsA.push_back(i);
+			positionsB.push_back(j);
+		}
+	}
+}
+
+bool TextIndex::findTerms(const std::vector<std::string> &words, std::vector<const Term *> &found) const {
+	found.clear();
+	for(const std::string &word : words) {
+		std::unordered_map<std::string, Term>::const_iterator it = terms.find(word);
+		if(it == terms.end()) {
+			return false;
+		}
+		found.push_back(&it->second);
+	}
+	return true;
+}
+
+void TextIndex::matchAll(const std::vector<const Term *> &queryTerms, std::vector<Postings> &lists,
+		std::vector<uint32_t> &matches, std::vector<std::vector<uint32_t>> &where) const {
+	lists.resize(queryTerms.size());
+	where.assign(queryTerms.size(), std::vector<uint32_t>());
+	matches.clear();
+	if(queryTerms.empty()) {
+		return;
+	}
+
+	// Intersect from the rarest term, so the candidate list only shrinks.
+	std::vector<size_t> order(queryTerms.size());
+	for(size_t t = 0; t < order.size(); t++) {
+		order[t] = t;
+	}
+	std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return queryTerms[a]->verses < queryTerms[b]->verses; });
+
+	decode(*queryTerms[order[0]], lists[order[0]]);
+	matches = lists[order[0]].ordinals;
+	for(size_t i = 0; i < matches.size(); i++) {
+		where[order[0]].push_back(i);
+	}
+
+	for(size_t k = 1; k < order.size() && !matches.empty(); k++) {
+		size_t t = order[k];
+		decode(*queryTerms[t], lists[t]);
+
+		std::vector<uint32_t> matched, fromMatches, fromList;
+		intersectSorted(matches, lists[t].ordinals, matched, fromMatches, fromList);
+
+		// Keep the earlier terms' positions for the verses that still match.
+		for(size_t j = 0; j < k; j++) {
+			std::vector<uint32_t> &w = where[order[j]];
+			std::vector<uint32_t> kept(matched.size());
+			for(size_t i = 0; i < matched.size(); i++) {
+				kept[i] = w[fromMatches[i]];
+			}
+			w.swap(kept);
+		}
+		where[t].swap(fromList);
+		matches.swap(matched);
+	}
+}
+
+// Sort and remove repeated words.
+static std::vector<std::string> distinctWords(std::vector<std::string> words) {
+	std::sort(words.begin(), words.end());
+	words.erase(std::unique(words.begin(), words.end()), words.end());
+	return words;
+}
+
+std::vector<Ref> TextIndex::search(const std::string &query, size_t limit) const {
+	std::vector<Ref> results;
+
+	// Every term must match, so a missing term means no results.
+	std::vector<const Term *> queryTerms;
+	if(!findTerms(distinctWords(tokenize(query)), queryTerms) || queryTerms.empty()) {
+		return results;
+	}
+
+	std::vector<Postings> lists;
+	std::vector<uint32_t> candidates;
+	std::vector<std::vector<uint32_t>> where;
+	matchAll(queryTerms, lists, candidates, where);
+
+	// Score each term's occurrences in a verse by TF-IDF.
+	double total = refs.size();
+	std::vector<double> scores(candidates.size());
+	for(size_t t = 0; t < queryTerms.size(); t++) {
+		double idf = std::log(1 + total / queryTerms[t]->verses);
+		for(size_t i = 0; i < candidates.size(); i++) {
+			scores[i] += (1 + std::log((double)lists[t].counts[where[t][i]])) * idf;
+		}
+	}
+
+	// Rank by score, then by reference order.
+	std::vector<uint32_t> order(candidates.size());
+	for(size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	limit = std::min(limit, order.size());
+	std::partial_sort(order.begin(), order.begin() + limit, order.end(), [&](uint32_t a, uint32_t b) {
+		return scores[a] != scores[b] ? scores[a] > scores[b] : candidates[a] < candidates[b];
+	});
+
+	for(size_t i = 0; i < limit; i++) {
+		results.push_back(refs[candidates[order[i]]]);
+	}
+	return results;
+}
+
+std::vector<Ref> TextIndex::phrase(const std::string &query, size_t limit) const {
+	std::vector<Ref> results;
+
+	std::vector<std::string> words = tokenize(query);
+	std::vector<std::string> distinct = distinctWords(words);
+	std::vector<const Term *> queryTerms;
+	if(!findTerms(distinct, queryTerms) || queryTerms.empty()) {
+		return results;
+	}
+
+	std::vector<Postings> lists;
+	std::vector<uint32_t> candidates;
+	std::vector<std::vector<uint32_t>> where;
+	matchAll(queryTerms, lists, candidates, where);
+
+	// The term (index into distinct) of each word of the phrase.
+	std::vector<size_t> wordTerm(words.size());
+	for(size_t w = 0; w < words.size(); w++) {
+		wordTerm[w] = std::lower_bound(distinct.begin(), distinct.end(), words[w]) - distinct.begin();
+	}
+
+	// Check each verse containing all the words for the words at consecutive positions.
+	for(size_t i = 0; i < candidates.size() && results.size() < limit; i++) {
+		auto positionsOf = [&](size_t t, const uint32_t *&begin, const uint32_t *&end) {
+			const Postings &list = lists[t];
+			begin = list.positions.data() + list.positionStart[where[t][i]];
+			end = begin + list.counts[where[t][i]];
+		};
+
+		const uint32_t *firstBegin, *firstEnd;
+		positionsOf(wordTerm[0], firstBegin, firstEnd);
+		for(const uint32_t *start = firstBegin; start != firstEnd; start++) {
+			bool found = true;
+			for(size_t w = 1; w < words.size() && found; w++) {
+				const uint32_t *begin, *end;
+				positionsOf(wordTerm[w], begin, end);
+				found = std::binary_search(begin, end, *start + (uint32_t)w);
+			}
+			if(found) {
+				results.push_back(refs[candidates[i]]);
+				break;
+			}
+		}
+	}
+	return results;
+}
+
+std::vector<Ref> TextIndex::near(const std::string &query, unsigned distance, size_t limit) const {
+	std::vector<Ref> results;
+
+	std::vector<const Term *> queryTerms;
+	if(!findTerms(distinctWords(tokenize(query)), queryTerms) || queryTerms.empty()) {
+		return results;
+	}
+
+	std::vector<Postings> lists;
+	std::vector<uint32_t> candidates;
+	std::vector<std::vector<uint32_t>> where;
+	matchAll(queryTerms, lists, candidates, where);
+
+	// Every occurrence of a query term in a verse, as (position, term).
+	std::vector<std::pair<uint32_t, uint32_t>> occurrences;
+	std::vector<uint32_t> inWindow(queryTerms.size());
+
+	for(size_t i = 0; i < candidates.size() && results.size() < limit; i++) {
+		occurrences.clear();
+		for(size_t t = 0; t < queryTerms.size(); t++) {
+			const Postings &list = lists[t];
+			const uint32_t *begin = list.positions.data() + list.positionStart[where[t][i]];
+			for(uint32_t k = 0; k < list.counts[where[t][i]]; k++) {
+				occurrences.push_back(std::make_pair(begin[k], (uint32_t)t));
+			}
+		}
+		std::sort(occurrences.begin(), occurrences.end());
+
+		// Slide a window over the occurrences, looking for one holding every term within the distance.
+		std::fill(inWindow.begin(), inWindow.end(), 0);
+		size_t covered = 0, left = 0;
+		bool found = false;
+		for(size_t right = 0; right < occurrences.size() && !found; right++) {
+			if(inWindow[occurrences[right].second]++ == 0) {
+				covered++;
+			}
+			while(covered == queryTerms.size()) {
+				if(occurrences[right].first - occurrences[left].first <= distance) {
+					found = true;
+					break;
+				}
+				if(--inWindow[occurrences[left].second] == 0) {
+					covered--;
+				}
+				left++;
+			}
+		}
+
+		if(found) {
+			results.push_back(refs[candidates[i]]);
+		}
+	}
+	return results;
+}
+
+size_t TextIndex::memoryUsage() const {
+	size_t bytes = sizeof(TextIndex) + refs.capacity() * sizeof(Ref) + postings.capacity() + completer.memoryUsage();
+	for(const auto &entry : terms) {
+		// Hash node: key, value, next pointer and cached hash, plus the bucket pointer.
+		bytes += sizeof(entry) + entry.first.capacity() + 3 * sizeof(void *);
+	}
+	return bytes;
+}
@@ -0,0 +1,95 @@
+// Class TextIndex
+// Computer Science, MVNU
+//
+// A TextIndex is a positional inverted index over the verses of one Bible version.
+// Verses are numbered by ordinal in reference order, and words by position
+// within their verse. Each normalized term (lowercase letters and digits)
+// maps to a postings list of the ordinals of verses containing it, each with
+// the term's count and positions in the verse, all delta and varint encoded.
+
+#ifndef TextIndex_H
+#define TextIndex_H
+
+#include "Completer.h"
+#include "Ref.h"
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextIndex {
+ public:
+   // A decoded postings list.
+   struct Postings {
+      std::vector<uint32_t> ordinals;	// Verse ordinals, increasing.
+      std::vector<uint32_t> counts;		// Occurrences of the term in each verse.
+      std::vector<uint32_t> positionStart;	// Index of each verse's first position in positions.
+      std::vector<uint32_t> positions;	// Word positions of the term, increasing within each verse.
+   };
+
+   TextIndex();
+
+   // Add the next verse (in reference order) to the index.
+   void addVerse(const Ref &ref, const std::string &text);
+
+   // Finish building, indexing the added verses in parallel on up to threads threads
+   // (0 for one per core). No verses may be added afterwards.
+   void finish(unsigned threads = 0);
+
+   // Split text into normalized terms.
+   static std::vector<std::string> tokenize(const std::string &text);
+
+   // Find verses containing every term of a query, best matches (by TF-IDF) first.
+   std::vector<Ref> search(const std::string &query, size_t limit) const;
+
+   // Find verses containing the words of a phrase consecutively, in reference order.
+   std::vector<Ref> phrase(const std::string &query, size_t limit) const;
+
+   // Find verses containing every term of a query within a span of distance words
+   // (the first and last of the terms at most distance positions apart), in reference order.
+   std::vector<Ref> near(const std::string &query, unsigned distance, size_t limit) const;
+
+   // Find up to limit terms starting with a prefix, those in the most verses first.
+   std::vector<std::string> complete(const std::string &prefix, size_t limit) const;
+
+   // Number of indexed verses.
+   size_t size() const { return refs.size(); }
+
+   // Estimate the memory used by the index, in bytes.
+   size_t memoryUsage() const;
+
+ private:
+   // Where a term's postings are in the postings buffer.
+   struct Term {
+      uint64_t start;		// Offset of the encoded postings.
+      uint32_t length;		// Encoded length in bytes.
+      uint32_t verses;		// Number of verses containing the term (document frequency).
+   };
+
+   std::vector<Ref> refs;	// Verse references by ordinal.
+   std::unordered_map<std::string, Term> terms;
+   std::vector<uint8_t> postings;	// All encoded postings lists.
+   Completer completer;		// Prefix tree over the terms, weighted by document frequency.
+
+   // Verse text waiting to be indexed by finish.
+   std::vector<std::string> pending;
+
+   // Decode a term's postings list.
+   void decode(const Term &term, Postings &out) const;
+
+   // Look up the terms of a query. Returns false if any term is not in the index.
+   bool findTerms(const std::vector<std::string> &words, std::vector<const Term *> &found) const;
+
+   // Decode the postings of several terms and find the verses containing all of them.
+   // For each matching verse, where[t] gives its index in lists[t].
+   void matchAll(const std::vector<const Term *> &queryTerms, std::vector<Postings> &lists,
+      std::vector<uint32_t> &matches, std::vector<std::vector<uint32_t>> &where) const;
+};
+
+// Intersect two increasing lists, appending common values to out with the positions
+// in each list where they were found. Uses galloping search when one list is much
+// shorter than the other, and SIMD block comparison otherwise.
+void intersectSorted(const std::vector<uint32_t> &a, const std::vector<uint32_t> &b,
+	std::vector<uint32_t> &out, std::vector<uint32_t> &positionsA, std::vector<uint32_t> &positionsB);
+
+#endif //TextIndex_H
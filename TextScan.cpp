@@ -0,0 +1,660 @@
+// TextScan function definitions
+// Computer Science, MVNU
+
+#include "TextScan.h"
+#include "Bible.h"
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <thread>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_SEARCH
+#endif
+using namespace std;
+
+bool cpuHasAvx2() {
+#ifdef HAVE_AVX2_SEARCH
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
+
+// Scalar search from start: memmem for each successive match.
+static void findScalar(const char *text, size_t length, size_t start, const std::string &needle, std::vector<size_t> &matches) {
+	while(start + needle.size() <= length) {
+		const char *found = (const char *)memmem(text + start, length - start, needle.data(), needle.size());
+		if(!found) {
+			break;
+		}
+		matches.push_back(found - text);
+		start = found - text + 1;
+	}
+}
+
+#ifdef HAVE_AVX2_SEARCH
+// Compare the needle's first and last bytes against 32 candidate positions at once,
+// then confirm candidates with memcmp.
+__attribute__((target("avx2")))
+static void findAvx2(const char *text, size_t length, const std::string &needle, std::vector<size_t> &matches) {
+	const size_t k = needle.size();
+	const __m256i first = _mm256_set1_epi8(needle[0]);
+	const __m256i last = _mm256_set1_epi8(needle[k - 1]);
+
+	size_t i = 0;
+	for(; i + k - 1 + 32 <= length; i += 32) {
+		__m256i blockFirst = _mm256_loadu_si256((const __m256i *)(text + i));
+		__m256i blockLast = _mm256_loadu_si256((const __m256i *)(text + i + k - 1));
+		uint32_t mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(first, blockFirst), _mm256_cmpeq_epi8(last, blockLast)));
+
+		while(mask) {
+			unsigned bit = __builtin_ctz(mask);
+			if(k <= 2 || memcmp(text + i + bit + 1, needle.data() + 1, k - 2) == 0) {
+				matches.push_back(i + bit);
+			}
+			mask &= mask - 1;
+		}
+	}
+
+	// Finish the tail that does not fill a whole block.
+	findScalar(text, length, i, needle, matches);
+}
+#endif
+
+void findSubstring(const char *text, size_t length, const std::string &needle, bool simd, std::vector<size_t> &matches) {
+	if(needle.empty()) {
+		return;
+	}
+#ifdef HAVE_AVX2_SEARCH
+	if(simd && cpuHasAvx2()) {
+		findAvx2(text, length, needle, matches);
+		return;
+	}
+#endif
+	findScalar(text, length, 0, needle, matches);
+}
+
+SubstringMatcher::SubstringMatcher(const std::string &needle, bool allowSimd) : needle(needle), simd(allowSimd && cpuHasAvx2()) {}
+
+void SubstringMatcher::matchLines(const char *text, size_t length, std::vector<size_t> &lineStarts) const {
+	std::vector<size_t> matches;
+	findSubstring(text, length, needle, simd, matches);
+
+	// Report each line once, and only for matches within its verse text.
+	size_t nextLine = 0;
+	for(size_t match : matches) {
+		if(match < nextLine) {
+			continue;
+		}
+
+		const char *newline = (const char *)memrchr(text, '\n', match);
+		size_t lineStart = newline ? newline - text + 1 : 0;
+		const char *lineEndPointer = (const char *)memchr(text + match, '\n', length - match);
+		size_t lineEnd = lineEndPointer ? lineEndPointer - text : length;
+		const char *space = (const char *)memchr(text + lineStart, ' ', lineEnd - lineStart);
+		size_t verseStart = space ? space - text + 1 : lineEnd;
+
+		if(match >= verseStart && match + needle.size() <= lineEnd) {
+			lineStarts.push_back(lineStart);
+			nextLine = lineEnd + 1;
+		}
+	}
+}
+
+// Syntax tree of a regular expression, compiled to the NFA once parsed.
+struct RegexNode {
+	enum Kind { BYTES, EMPTY, CONCAT, ALTERNATE, REPEAT, ASSERT } kind;
+	std::bitset<256> bytes;		// For BYTES.
+	RegexMatcher::Instruction::Op assertion;	// For ASSERT.
+	int min, max;				// For REPEAT; max is -1 if unbounded.
+	std::vector<RegexNode> children;
+
+	RegexNode(Kind kind = EMPTY) : kind(kind), assertion(RegexMatcher::Instruction::MATCH), min(0), max(0) {}
+};
+
+static bool isWordByte(unsigned char c) {
+	return isalnum(c) || c == '_';
+}
+
+// The bytes matched by \d, \w or \s (or their negations), if class is one of those letters.
+static bool classEscape(char escape, std::bitset<256> &bytes) {
+	bytes.reset();
+	for(int c = 0; c < 256; c++) {
+		switch(tolower(escape)) {
+			case 'd': bytes[c] = isdigit(c); break;
+			case 'w': bytes[c] = isWordByte(c); break;
+			case 's': bytes[c] = c == ' ' || (c >= '\t' && c <= '\r'); break;
+			default: return false;
+		}
+	}
+	if(isupper(escape)) {
+		bytes.flip();
+	}
+	return true;
+}
+
+// Recursive descent over the pattern, in the ECMAScript grammar.
+class RegexParser {
+ public:
+	RegexParser(const std::string &pattern, bool ignoreCase) : pattern(pattern), position(0), ignoreCase(ignoreCase) {}
+
+	RegexNode parse() {
+		RegexNode node = alternation();
+		if(position < pattern.size()) {
+			// Only an unmatched ')' stops an alternation early.
+			throw std::regex_error(std::regex_constants::error_paren);
+		}
+		return node;
+	}
+
+ private:
+	const std::string &pattern;
+	size_t position;
+	bool ignoreCase;
+
+	bool atEnd() { return position >= pattern.size(); }
+	char peek() { return pattern[position]; }
+
+	RegexNode alternation() {
+		RegexNode node(RegexNode::ALTERNATE);
+		node.children.push_back(concatenation());
+		while(!atEnd() && peek() == '|') {
+			position++;
+			node.children.push_back(concatenation());
+		}
+		return node.children.size() == 1 ? node.children.front() : node;
+	}
+
+	RegexNode concatenation() {
+		RegexNode node(RegexNode::CONCAT);
+		while(!atEnd() && peek() != '|' && peek() != ')') {
+			node.children.push_back(repetition());
+		}
+		return node;
+	}
+
+	RegexNode repetition() {
+		RegexNode node = atom();
+		int min, max;
+		// Quantifiers may follow one another ("a**" repeats "a*"), as std::regex allows.
+		while(quantifier(min, max)) {
+			// A lazy quantifier matches the same lines.
+			if(!atEnd() && peek() == '?') {
+				position++;
+			}
+			if(node.kind == RegexNode::ASSERT) {
+				throw std::regex_error(std::regex_constants::error_badrepeat);
+			}
+			RegexNode repeated(RegexNode::REPEAT);
+			repeated.min = min;
+			repeated.max = max;
+			repeated.children.push_back(node);
+			node = repeated;
+		}
+		return node;
+	}
+
+	// Read a quantifier if one is next. A '{' must start a valid count.
+	bool quantifier(int &min, int &max) {
+		if(atEnd()) {
+			return false;
+		}
+		switch(peek()) {
+			case '*': position++; min = 0; max = -1; return true;
+			case '+': position++; min = 1; max = -1; return true;
+			case '?': position++; min = 0; max = 1; return true;
+			case '{': break;
+			default: return false;
+		}
+
+		position++;
+		if(!number(min)) {
+			throw std::regex_error(std::regex_constants::error_badbrace);
+		}
+		max = min;
+		if(!atEnd() && peek() == ',') {
+			position++;
+			max = -1;
+			if(!atEnd() && isdigit((unsigned char)peek())) {
+				number(max);
+			}
+		}
+		if(atEnd() || peek() != '}') {
+			throw std::regex_error(std::regex_constants::error_brace);
+		}
+		position++;
+		if(min > maxRepeat() || max > maxRepeat()) {
+			throw std::regex_error(std::regex_constants::error_complexity);
+		}
+		if(max != -1 && max < min) {
+			throw std::regex_error(std::regex_constants::error_badbrace);
+		}
+		return true;
+	}
+
+	static int maxRepeat() { return RegexMatcher::maxRepeat; }
+
+	bool number(int &value) {
+		size_t start = position;
+		value = 0;
+		while(!atEnd() && isdigit((unsigned char)peek())) {
+			// Anything past the limit is refused by the caller, so stop counting there.
+			value = std::min(value * 10 + (peek() - '0'), maxRepeat() + 1);
+			position++;
+		}
+		return position > start;
+	}
+
+	RegexNode atom() {
+		char c = pattern[position++];
+		switch(c) {
+			case '*': case '+': case '?': case '{':
+				throw std::regex_error(std::regex_constants::error_badrepeat);
+			case '(': {
+				if(!atEnd() && peek() == '?') {
+					// Only non-capturing groups; lookaround is not supported.
+					if(position + 1 >= pattern.size() || pattern[position + 1] != ':') {
+						throw std::regex_error(std::regex_constants::error_paren);
+					}
+					position += 2;
+				}
+				RegexNode group = alternation();
+				if(atEnd() || peek() != ')') {
+					throw std::regex_error(std::regex_constants::error_paren);
+				}
+				position++;
+				return group;
+			}
+			case '[':
+				return bytes(set());
+			case '.': {
+				std::bitset<256> any;
+				any.set();
+				any[(unsigned char)'\n'] = any[(unsigned char)'\r'] = false;
+				return bytes(any);
+			}
+			case '^':
+				return assertion(RegexMatcher::Instruction::TEXT_START);
+			case '$':
+				return assertion(RegexMatcher::Instruction::TEXT_END);
+			case '\\': {
+				if(atEnd()) {
+					throw std::regex_error(std::regex_constants::error_escape);
+				}
+				char escape = pattern[position];
+				if(escape == 'b' || escape == 'B') {
+					position++;
+					return assertion(escape == 'b' ? RegexMatcher::Instruction::WORD_BOUNDARY : RegexMatcher::Instruction::NOT_WORD_BOUNDARY);
+				}
+				std::bitset<256> set;
+				if(classEscape(escape, set)) {
+					position++;
+					return bytes(set);
+				}
+				return literal(escaped());
+			}
+			default:
+				return literal(c);
+		}
+	}
+
+	// The byte an escape (after its '\\') stands for.
+	unsigned char escaped() {
+		char c = pattern[position++];
+		switch(c) {
+			case 't': return '\t';
+			case 'n': return '\n';
+			case 'r': return '\r';
+			case 'f': return '\f';
+			case 'v': return '\v';
+			case '0': return '\0';
+			case 'x': {
+				if(position + 2 > pattern.size() || !isxdigit((unsigned char)pattern[position]) || !isxdigit((unsigned char)pattern[position + 1])) {
+					throw std::regex_error(std::regex_constants::error_escape);
+				}
+				unsigned char value = std::stoi(pattern.substr(position, 2), NULL, 16);
+				position += 2;
+				return value;
+			}
+			default:
+				if(c >= '1' && c <= '9') {
+					// Backreferences cannot be matched without backtracking.
+					throw std::regex_error(std::regex_constants::error_backref);
+				}
+				if(isalnum((unsigned char)c)) {
+					throw std::regex_error(std::regex_constants::error_escape);
+				}
+				return c;
+		}
+	}
+
+	// A bracketed set, after its '['.
+	std::bitset<256> set() {
+		std::bitset<256> members;
+		bool negated = !atEnd() && peek() == '^';
+		if(negated) {
+			position++;
+		}
+		while(!atEnd() && peek() != ']') {
+			std::bitset<256> single;
+			int low = member(single);
+			if(low >= 0 && position + 1 < pattern.size() && peek() == '-' && pattern[position + 1] != ']') {
+				position++;
+				int high = member(single);
+				if(high < 0 || high < low) {
+					throw std::regex_error(std::regex_constants::error_range);
+				}
+				for(int c = low; c <= high; c++) {
+					members[c] = true;
+				}
+			}
+			else if(low >= 0) {
+				members[low] = true;
+			}
+			else {
+				members |= single;
+			}
+		}
+		if(atEnd()) {
+			throw std::regex_error(std::regex_constants::error_brack);
+		}
+		position++;
+		members = folded(members);
+		return negated ? ~members : members;
+	}
+
+	// One member of a set: returns its byte, or -1 for a class escape (its bytes put in set).
+	int member(std::bitset<256> &set) {
+		if(atEnd()) {
+			throw std::regex_error(std::regex_constants::error_brack);
+		}
+		char c = pattern[position++];
+		if(c != '\\') {
+			return (unsigned char)c;
+		}
+		if(atEnd()) {
+			throw std::regex_error(std::regex_constants::error_escape);
+		}
+		if(classEscape(peek(), set)) {
+			position++;
+			return -1;
+		}
+		// In a set, \b is a backspace.
+		if(peek() == 'b') {
+			position++;
+			return '\b';
+		}
+		return escaped();
+	}
+
+	// The set with both cases of every letter in it, when ignoring case.
+	std::bitset<256> folded(std::bitset<256> set) {
+		if(ignoreCase) {
+			for(int c = 'a'; c <= 'z'; c++) {
+				if(set[c] || set[toupper(c)]) {
+					set[c] = set[toupper(c)] = true;
+				}
+			}
+		}
+		return set;
+	}
+
+	RegexNode literal(unsigned char c) {
+		std::bitset<256> set;
+		set[c] = true;
+		return bytes(folded(set));
+	}
+
+	static RegexNode bytes(const std::bitset<256> &set) {
+		RegexNode node(RegexNode::BYTES);
+		node.bytes = set;
+		return node;
+	}
+
+	static RegexNode assertion(RegexMatcher::Instruction::Op op) {
+		RegexNode node(RegexNode::ASSERT);
+		node.assertion = op;
+		return node;
+	}
+};
+
+// Emits the instructions for a syntax tree, refusing programs past maxProgramSize.
+class RegexCompiler {
+ public:
+	RegexCompiler(std::vector<RegexMatcher::Instruction> &program, std::vector<std::bitset<256>> &sets) : program(program), sets(sets) {}
+
+	void compile(const RegexNode &node) {
+		switch(node.kind) {
+			case RegexNode::EMPTY:
+				break;
+			case RegexNode::BYTES:
+				sets.push_back(node.bytes);
+				emit(RegexMatcher::Instruction::BYTES, sets.size() - 1);
+				break;
+			case RegexNode::ASSERT:
+				emit(node.assertion);
+				break;
+			case RegexNode::CONCAT:
+				for(const RegexNode &child : node.children) {
+					compile(child);
+				}
+				break;
+			case RegexNode::ALTERNATE: {
+				// split(first, rest); first; jump end; rest...
+				std::vector<int> jumps;
+				for(size_t i = 0; i < node.children.size(); i++) {
+					int split = -1;
+					if(i + 1 < node.children.size()) {
+						split = emit(RegexMatcher::Instruction::SPLIT, program.size() + 1);
+					}
+					compile(node.children[i]);
+					if(i + 1 < node.children.size()) {
+						jumps.push_back(emit(RegexMatcher::Instruction::JUMP));
+						program[split].y = program.size();
+					}
+				}
+				for(int jump : jumps) {
+					program[jump].x = program.size();
+				}
+				break;
+			}
+			case RegexNode::REPEAT:
+				repeat(node);
+				break;
+		}
+	}
+
+ private:
+	std::vector<RegexMatcher::Instruction> &program;
+	std::vector<std::bitset<256>> &sets;
+
+	int emit(RegexMatcher::Instruction::Op op, int x = 0, int y = 0) {
+		if(program.size() >= RegexMatcher::maxProgramSize) {
+			throw std::regex_error(std::regex_constants::error_complexity);
+		}
+		program.push_back(RegexMatcher::Instruction{op, x, y});
+		return program.size() - 1;
+	}
+
+	// Whether a node compiles to no instructions: copying it out any number of times adds nothing.
+	static bool emitsNothing(const RegexNode &node) {
+		switch(node.kind) {
+			case RegexNode::EMPTY:
+				return true;
+			case RegexNode::CONCAT:
+				return std::all_of(node.children.begin(), node.children.end(), emitsNothing);
+			case RegexNode::REPEAT:
+				return node.max == 0 || emitsNothing(node.children.front());
+			default:
+				return false;
+		}
+	}
+
+	void repeat(const RegexNode &node) {
+		const RegexNode &child = node.children.front();
+		if(node.max == 0 || emitsNothing(child)) {
+			return;
+		}
+
+		// The copies required, then any number more (split(body, end); body; jump split),
+		// or up to max optional copies, each able to skip to the end.
+		for(int i = 0; i < node.min; i++) {
+			compile(child);
+		}
+		if(node.max == -1) {
+			int split = emit(RegexMatcher::Instruction::SPLIT, program.size() + 1);
+			compile(child);
+			emit(RegexMatcher::Instruction::JUMP, split);
+			program[split].y = program.size();
+		}
+		else {
+			std::vector<int> optional;
+			for(int i = node.min; i < node.max; i++) {
+				optional.push_back(emit(RegexMatcher::Instruction::SPLIT, program.size() + 1));
+				compile(child);
+			}
+			for(int split : optional) {
+				program[split].y = program.size();
+			}
+		}
+	}
+};
+
+const size_t RegexMatcher::maxPatternLength;
+const int RegexMatcher::maxRepeat;
+const size_t RegexMatcher::maxProgramSize;
+
+RegexMatcher::RegexMatcher(const std::string &pattern, bool ignoreCase) {
+	if(pattern.size() > maxPatternLength) {
+		throw std::regex_error(std::regex_constants::error_complexity);
+	}
+	RegexCompiler(program, sets).compile(RegexParser(pattern, ignoreCase).parse());
+	program.push_back(Instruction{Instruction::MATCH, 0, 0});
+}
+
+bool RegexMatcher::add(States &states, int pc, const char *text, size_t length, size_t i, unsigned stamp, std::vector<int> &stack) const {
+	bool before = i > 0 && isWordByte(text[i - 1]), after = i < length && isWordByte(text[i]);
+	stack.clear();
+	stack.push_back(pc);
+	while(!stack.empty()) {
+		pc = stack.back();
+		stack.pop_back();
+		if(states.added[pc] == stamp) {
+			continue;
+		}
+		states.added[pc] = stamp;
+
+		const Instruction &instruction = program[pc];
+		switch(instruction.op) {
+			case Instruction::BYTES: states.list.push_back(pc); break;
+			case Instruction::MATCH: return true;
+			case Instruction::JUMP: stack.push_back(instruction.x); break;
+			case Instruction::SPLIT: stack.push_back(instruction.y); stack.push_back(instruction.x); break;
+			case Instruction::TEXT_START: if(i == 0) stack.push_back(pc + 1); break;
+			case Instruction::TEXT_END: if(i == length) stack.push_back(pc + 1); break;
+			case Instruction::WORD_BOUNDARY: if(before != after) stack.push_back(pc + 1); break;
+			case Instruction::NOT_WORD_BOUNDARY: if(before == after) stack.push_back(pc + 1); break;
+		}
+	}
+	return false;
+}
+
+bool RegexMatcher::search(const char *text, size_t length, States &current, States &next, std::vector<int> &stack, unsigned &stamp) const {
+	// A match may start anywhere, so the first instruction is added again at each position.
+	current.list.clear();
+	if(add(current, 0, text, length, 0, ++stamp, stack)) {
+		return true;
+	}
+	for(size_t i = 0; i < length; i++) {
+		unsigned char c = text[i];
+		next.list.clear();
+		++stamp;
+		for(int pc : current.list) {
+			if(sets[program[pc].x][c] && add(next, pc + 1, text, length, i + 1, stamp, stack)) {
+				return true;
+			}
+		}
+		if(add(next, 0, text, length, i + 1, stamp, stack)) {
+			return true;
+		}
+		std::swap(current, next);
+	}
+	return false;
+}
+
+void RegexMatcher::matchLines(const char *text, size_t length, std::vector<size_t> &lineStarts) const {
+	States current, next;
+	current.added.assign(program.size(), 0);
+	next.added.assign(program.size(), 0);
+	std::vector<int> stack;
+	unsigned stamp = 0;
+
+	size_t lineStart = 0;
+	while(lineStart < length) {
+		const char *newline = (const char *)memchr(text + lineStart, '\n', length - lineStart);
+		size_t lineEnd = newline ? newline - text : length;
+		const char *space = (const char *)memchr(text + lineStart, ' ', lineEnd - lineStart);
+
+		if(space && search(space + 1, text + lineEnd - (space + 1), current, next, stack, stamp)) {
+			lineStarts.push_back(lineStart);
+		}
+		lineStart = lineEnd + 1;
+	}
+}
+
+std::vector<std::vector<Ref>> scanBibles(const std::vector<std::shared_ptr<Bible>> &bibles, const TextMatcher &matcher, unsigned threads,
+		std::chrono::steady_clock::time_point deadline, bool *expired) {
+	// One task per chunk of each Bible.
+	struct Task {
+		size_t bible;
+		size_t chunk;
+		std::vector<Ref> found;
+	};
+	std::vector<Task> tasks;
+	for(size_t b = 0; b < bibles.size(); b++) {
+		size_t chunks = bibles[b]->textChunkCount();
+		for(size_t c = 0; c < chunks; c++) {
+			tasks.push_back(Task());
+			tasks.back().bible = b;
+			tasks.back().chunk = c;
+		}
+	}
+
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::max<size_t>(1, std::min<size_t>(threads, tasks.size()));
+
+	// Workers take the next task until none are left, or until nobody is waiting for the result.
+	std::atomic<size_t> next(0);
+	std::atomic<bool> late(false);
+	auto work = [&]() {
+		for(size_t t; (t = next++) < tasks.size();) {
+			if(late || (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline)) {
+				late = true;
+				break;
+			}
+			bibles[tasks[t].bible]->scanTextChunk(tasks[t].chunk, matcher, tasks[t].found);
+		}
+	};
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+	if(expired) {
+		*expired = late;
+	}
+
+	// Tasks are in chunk order, so concatenating keeps file order.
+	std::vector<std::vector<Ref>> results(bibles.size());
+	for(Task &task : tasks) {
+		results[task.bible].insert(results[task.bible].end(), task.found.begin(), task.found.end());
+	}
+	return results;
+}
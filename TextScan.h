@@ -0,0 +1,103 @@
+// TextScan: brute-force scanning of verse text
+// Computer Science, MVNU
+//
+// For queries the full-text index cannot answer, the raw text of one or more
+// Bible versions can be scanned for a substring (vectorized with AVX2 where the
+// CPU supports it) or a regular expression, in parallel across versions and
+// chunks of text. Regular expressions are matched without backtracking, so a
+// scan's cost is bounded by the pattern's size whatever the pattern is.
+
+#ifndef TextScan_H
+#define TextScan_H
+
+#include "Ref.h"
+#include <bitset>
+#include <chrono>
+#include <memory>
+#include <regex>
+#include <string>
+#include <vector>
+
+class Bible;
+
+// Finds the lines of text (each "<ref> <verse text>") whose verse text matches.
+class TextMatcher {
+ public:
+   virtual ~TextMatcher() {}
+
+   // Append the offsets (within text) of the lines whose verse text matches.
+   // The text holds whole lines, each ending in a newline (except perhaps the last).
+   virtual void matchLines(const char *text, size_t length, std::vector<size_t> &lineStarts) const = 0;
+};
+
+// Matches verse text containing an exact substring.
+class SubstringMatcher : public TextMatcher {
+ public:
+   // Use AVX2 when the CPU supports it, unless allowSimd is false.
+   SubstringMatcher(const std::string &needle, bool allowSimd = true);
+
+   void matchLines(const char *text, size_t length, std::vector<size_t> &lineStarts) const;
+
+   // Check if the AVX2 search is in use.
+   bool usingSimd() const { return simd; }
+
+ private:
+   std::string needle;
+   bool simd;
+};
+
+// Matches verse text containing a match for an ECMAScript regular expression, without backreferences
+// or lookaround: literals and escapes, ., classes ([a-z], [^...], \d \w \s and their negations),
+// ^ $ \b \B, groups ((...) and (?:...)), | and the quantifiers * + ? {n} {n,} {n,m} (lazy or not;
+// either matches the same lines). The pattern is compiled to a Thompson NFA whose states are all
+// followed at once through each line, so matching takes time linear in the text for any pattern.
+class RegexMatcher : public TextMatcher {
+ public:
+   // Longest pattern, largest count in {n,m}, and most instructions once counted repeats are copied out.
+   static const size_t maxPatternLength = 256;
+   static const int maxRepeat = 1000;
+   static const size_t maxProgramSize = 2000;
+
+   // Throws std::regex_error if the pattern is invalid, unsupported or too large.
+   RegexMatcher(const std::string &pattern, bool ignoreCase = false);
+
+   void matchLines(const char *text, size_t length, std::vector<size_t> &lineStarts) const;
+
+   // One NFA instruction: match a byte in a set, branch, or check where in the text it is.
+   struct Instruction {
+      enum Op { BYTES, SPLIT, JUMP, TEXT_START, TEXT_END, WORD_BOUNDARY, NOT_WORD_BOUNDARY, MATCH } op;
+      int x;	// The set of BYTES, or the target of SPLIT and JUMP.
+      int y;	// The other target of SPLIT.
+   };
+
+ private:
+   std::vector<Instruction> program;
+   std::vector<std::bitset<256>> sets;
+
+   // The current instructions of the NFA, each once, and a stamp per instruction marking it added.
+   struct States {
+      std::vector<int> list;
+      std::vector<unsigned> added;
+   };
+
+   // Check if the verse text has a match anywhere.
+   bool search(const char *text, size_t length, States &current, States &next, std::vector<int> &stack, unsigned &stamp) const;
+
+   // Add an instruction, and those it leads to without reading a byte, at position i of the text.
+   // Returns true if that reaches MATCH.
+   bool add(States &states, int pc, const char *text, size_t length, size_t i, unsigned stamp, std::vector<int> &stack) const;
+};
+
+// Find all starting positions of needle in text, using AVX2 if simd is set (and supported).
+void findSubstring(const char *text, size_t length, const std::string &needle, bool simd, std::vector<size_t> &matches);
+
+// Check if the CPU supports the AVX2 substring search.
+bool cpuHasAvx2();
+
+// Scan every chunk of every Bible's text with a matcher on up to threads threads (0 for one per core).
+// Returns the matching refs for each Bible, in order of the Bibles given and in file order within each.
+// Chunks not started by the deadline are left unscanned, and expired set if given.
+std::vector<std::vector<Ref>> scanBibles(const std::vector<std::shared_ptr<Bible>> &bibles, const TextMatcher &matcher, unsigned threads = 0,
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(), bool *expired = NULL);
+
+#endif //TextScan_H
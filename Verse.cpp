@@ -11,15 +11,22 @@ Verse::Verse() { // Default constructor
     verseRef = Ref();
 }
 
-Verse::Verse(const string s) {
-	// Copy the verse and split it into Ref and verse text portions.
-	string buffer = s;
-	// Split on the first whitespace.
-	string refToken = GetNextToken(buffer, " ");
+Verse::Verse(const string &s) {
+	// Split the verse on the first whitespace into Ref and verse text portions.
+	std::string_view text(s);
+	std::string_view::size_type start = text.find_first_not_of(' ');
+	text.remove_prefix(start == std::string_view::npos ? text.size() : start);
 	// Initialize Ref from first token.
-	verseRef = Ref(refToken);
-	// Initialize text from remaining buffer.
-	verseText = buffer;
+	Ref::parse(text, verseRef);
+	// Initialize text from the rest, after the whitespace.
+	verseText = std::string(textOf(s));
+}
+
+std::string_view Verse::textOf(std::string_view line) {
+	// The text follows the first space after the ref (and any spaces before it).
+	std::string_view::size_type start = line.find_first_not_of(' ');
+	std::string_view::size_type space = start == std::string_view::npos ? start : line.find(' ', start);
+	return space == std::string_view::npos ? std::string_view() : line.substr(space + 1);
 }
 
 string Verse::getVerse() {
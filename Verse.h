@@ -9,6 +9,7 @@
 #ifndef Verse_H
 #define Verse_H
 #include <string>
+#include <string_view>
 #include <stdlib.h>
 #include "Ref.h"
 using namespace std;
@@ -22,7 +23,10 @@ class Verse {
    Verse();   	// Default constructor
 
    // Parse constructor, pass in complete verse line with ref and text.
-   Verse(const string s);
+   Verse(const string &s);
+
+   // The text of a verse line (complete with ref), without the ref.
+   static std::string_view textOf(std::string_view line);
 
    // Get the verse text.
    string getVerse();
@@ -0,0 +1,299 @@
+// VerseSegment class function definitions
+// Computer Science, MVNU
+
+#include "VerseSegment.h"
+#include "fifo.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+using namespace std;
+
+const uint32_t VerseSegment::layoutVersion;
+
+// Directory of the segments, a memory-backed file system.
+static const char *segmentDirectory = "/dev/shm/";
+
+// First bytes of every segment.
+static const char segmentMagic[8] = {'B', 'I', 'B', 'L', 'E', 'S', 'E', 'G'};
+
+// Write all of a buffer to a file descriptor.
+static bool writeAll(int fd, const void *data, size_t size) {
+	const char *p = (const char *)data;
+	while(size > 0) {
+		ssize_t written = write(fd, p, size);
+		if(written <= 0) {
+			return false;
+		}
+		p += written;
+		size -= written;
+	}
+	return true;
+}
+
+VerseSegment::VerseSegment() : mapping(NULL), length(0), header(NULL), refs(NULL), starts(NULL), text(NULL) {}
+
+VerseSegment::~VerseSegment() {
+	detach();
+}
+
+std::string VerseSegment::segmentPath(const std::string &version) {
+	if(version.empty() || version.find('/') != std::string::npos || version[0] == '.') {
+		return "";
+	}
+	return segmentDirectory + (SIG + "biblelookup." + version);
+}
+
+bool VerseSegment::owned(int fd) {
+	struct stat info;
+	return fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_uid == geteuid();
+}
+
+uint64_t VerseSegment::retire(int fd) {
+	uint64_t generation = 0;
+	struct stat info;
+	if(owned(fd) && fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(Header)) {
+		void *mapped = mmap(NULL, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if(mapped != MAP_FAILED) {
+			Header *old = (Header *)mapped;
+			if(memcmp(old->magic, segmentMagic, sizeof(segmentMagic)) == 0) {
+				generation = old->generation;
+				// Readers of the old segment see this before their next use.
+				__atomic_store_n(&old->retired, 1, __ATOMIC_RELEASE);
+			}
+			munmap(mapped, sizeof(Header));
+		}
+	}
+	return generation;
+}
+
+bool VerseSegment::publish(const std::string &version, Bible &bible) {
+	std::string path = segmentPath(version);
+	if(path.empty() || !bible.valid()) {
+		return false;
+	}
+
+	std::vector<SegmentRef> verseRefs;
+	std::vector<uint64_t> verseStarts;
+	std::string verseText;
+	bible.forEachVerse([&](const Ref &ref, const std::string &verse) {
+		verseRefs.push_back(SegmentRef{ref.getBook(), ref.getChapter(), ref.getVerse(), 0});
+		verseStarts.push_back(verseText.size());
+		verseText += verse;
+	});
+	verseStarts.push_back(verseText.size());
+
+	Header written;
+	memset(&written, 0, sizeof(written));
+	memcpy(written.magic, segmentMagic, sizeof(segmentMagic));
+	written.layout = layoutVersion;
+	written.verses = verseRefs.size();
+	written.refsOffset = sizeof(Header);
+	written.startsOffset = written.refsOffset + verseRefs.size() * sizeof(SegmentRef);
+	written.textOffset = written.startsOffset + verseStarts.size() * sizeof(uint64_t);
+	written.textLength = verseText.size();
+	std::string stamp = bible.getFileStamp();
+	memcpy(written.stamp, stamp.data(), std::min(stamp.size(), sizeof(written.stamp) - 1));
+
+	// The generation continues from the segment being replaced, which is only retired once the new one is in place.
+	// The temporary is made afresh, so a file planted under its name is never written into and published;
+	// one left by a crashed server of this user is removed first (others' cannot be, in the sticky /dev/shm).
+	std::string temporary = path + ".new";
+	int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	if(fd == -1 && errno == EEXIST && unlink(temporary.c_str()) == 0) {
+		fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+	}
+	if(fd == -1) {
+		return false;
+	}
+	int old = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(old != -1 && owned(old)) {
+		Header previous;
+		if(read(old, &previous, sizeof(previous)) == sizeof(previous) && memcmp(previous.magic, segmentMagic, sizeof(segmentMagic)) == 0) {
+			written.generation = previous.generation;
+		}
+	}
+	if(old != -1) {
+		close(old);
+	}
+	written.generation++;
+
+	bool ok = writeAll(fd, &written, sizeof(written))
+		&& writeAll(fd, verseRefs.data(), verseRefs.size() * sizeof(SegmentRef))
+		&& writeAll(fd, verseStarts.data(), verseStarts.size() * sizeof(uint64_t))
+		&& writeAll(fd, verseText.data(), verseText.size());
+	close(fd);
+
+	// Hold the old segment open across the rename, to retire it once readers can find the new one.
+	old = open(path.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+	if(!ok || rename(temporary.c_str(), path.c_str()) != 0) {
+		unlink(temporary.c_str());
+		if(old != -1) {
+			close(old);
+		}
+		return false;
+	}
+	if(old != -1) {
+		retire(old);
+		close(old);
+	}
+	return true;
+}
+
+void VerseSegment::remove(const std::string &version) {
+	std::string path = segmentPath(version);
+	int fd = path.empty() ? -1 : open(path.c_str(), O_RDWR | O_NOFOLLOW | O_CLOEXEC);
+	if(fd == -1) {
+		return;
+	}
+	if(retire(fd) > 0) {
+		unlink(path.c_str());
+	}
+	close(fd);
+}
+
+bool VerseSegment::map(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+	if(fd == -1) {
+		return false;
+	}
+	// A segment planted by another user would be served as verse text, so only this user's are read.
+	struct stat info;
+	if(!owned(fd) || fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(Header)) {
+		close(fd);
+		return false;
+	}
+	void *mapped = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(mapped == MAP_FAILED) {
+		return false;
+	}
+	mapping = (const char *)mapped;
+	length = info.st_size;
+	header = (const Header *)mapping;
+
+	// Check the layout and that every array lies within the segment.
+	const Header &h = *header;
+	if(memcmp(h.magic, segmentMagic, sizeof(segmentMagic)) != 0 || h.layout != layoutVersion
+			|| __atomic_load_n(&h.retired, __ATOMIC_ACQUIRE)
+			|| h.verses > length / sizeof(SegmentRef)
+			|| h.refsOffset != sizeof(Header) || h.startsOffset != h.refsOffset + h.verses * sizeof(SegmentRef)
+			|| h.textOffset != h.startsOffset + (h.verses + 1) * sizeof(uint64_t)
+			|| h.textOffset > length || h.textLength > length - h.textOffset) {
+		detach();
+		return false;
+	}
+	refs = (const SegmentRef *)(mapping + h.refsOffset);
+	starts = (const uint64_t *)(mapping + h.startsOffset);
+	text = mapping + h.textOffset;
+	return true;
+}
+
+bool VerseSegment::attach(const std::string &version) {
+	if(mapping && version == this->version && !__atomic_load_n(&header->retired, __ATOMIC_ACQUIRE)) {
+		return true;
+	}
+
+	detach();
+	std::string path = segmentPath(version);
+	if(path.empty() || !map(path)) {
+		return false;
+	}
+	this->version = version;
+	return true;
+}
+
+void VerseSegment::detach() {
+	if(mapping) {
+		munmap((void *)mapping, length);
+	}
+	mapping = NULL;
+	length = 0;
+	header = NULL;
+	refs = NULL;
+	starts = NULL;
+	text = NULL;
+}
+
+uint64_t VerseSegment::generation() const {
+	return header ? header->generation : 0;
+}
+
+std::string VerseSegment::stamp() const {
+	return header ? std::string(header->stamp, strnlen(header->stamp, sizeof(header->stamp))) : "";
+}
+
+Ref VerseSegment::toRef(const SegmentRef &stored) {
+	return Ref(stored.book, stored.chapter, stored.verse);
+}
+
+size_t VerseSegment::lowerBound(const Ref &ref) const {
+	return std::lower_bound(refs, refs + header->verses, ref, [](const SegmentRef &stored, const Ref &r) {
+		return toRef(stored) < r;
+	}) - refs;
+}
+
+bool VerseSegment::has(const Ref &ref) const {
+	size_t position = lowerBound(ref);
+	return position < header->verses && toRef(refs[position]) == ref;
+}
+
+LookupResult VerseSegment::status(const Ref &ref) const {
+	// The same checks as Bible::getRefLookupStatus.
+	if(has(ref)) {
+		return SUCCESS;
+	}
+	if(!has(Ref(ref.getBook(), Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID))) {
+		return NO_BOOK;
+	}
+	return has(Ref(ref.getBook(), ref.getChapter(), Ref::MIN_VERSE_ID)) ? NO_VERSE : NO_CHAPTER;
+}
+
+Verse VerseSegment::lookup(const Ref &ref, LookupResult &status) const {
+	// Build the verse the way a client builds one from the server's reply.
+	status = this->status(ref);
+	std::string line = ref.toString() + " ";
+	if(status == SUCCESS) {
+		size_t position = lowerBound(ref);
+		uint64_t start = starts[position], end = starts[position + 1];
+		if(start <= end && end <= header->textLength) {
+			line.append(text + start, end - start);
+		}
+		else {
+			status = OTHER;
+		}
+	}
+	// A failed lookup is answered with no text, as the server answers it.
+	return Verse(line);
+}
+
+Ref VerseSegment::next(const Ref &ref, LookupResult &status) const {
+	status = this->status(ref);
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	size_t position = lowerBound(ref) + 1;
+	if(position >= header->verses) {
+		status = NO_BOOK;
+		return Ref();
+	}
+	return toRef(refs[position]);
+}
+
+Ref VerseSegment::prev(const Ref &ref, LookupResult &status) const {
+	status = this->status(ref);
+	if(status != SUCCESS) {
+		return Ref();
+	}
+	size_t position = lowerBound(ref);
+	if(position == 0) {
+		status = NO_BOOK;
+		return Ref();
+	}
+	return toRef(refs[position - 1]);
+}
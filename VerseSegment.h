@@ -0,0 +1,120 @@
+// Class VerseSegment
+// Computer Science, MVNU
+//
+// A VerseSegment is a read-only snapshot of one Bible version's references and
+// verse text, published by the lookup server as a file in shared memory (/dev/shm)
+// so that clients can answer lookup, next and prev by mapping it, without a round
+// trip to the server. The layout is:
+//    * Header           - magic, layout version, generation, the sizes below, and the
+//                         Bible::fileStamp of the text the version was read from
+//    * SegmentRef[n]    - every reference of the version, sorted
+//    * uint64_t[n + 1]  - the start of each verse's text, then the end of the last
+//    * text             - the verse texts (without their refs), back to back
+// A segment is written whole under a temporary name and renamed into place, so a
+// mapped segment never changes, except that the server marks it retired when it
+// is replaced (its version reloaded, with the next generation) or removed (evicted).
+// Readers check the mark before each use and map the current segment again.
+// Segments are named with the user's pipe signature (fifo.h SIG), and only segments
+// owned by the process's own user are read, retired or removed, so servers of other
+// users neither collide nor can plant text for clients; a client run as a different
+// user than the server asks the server instead.
+
+#ifndef VerseSegment_H
+#define VerseSegment_H
+
+#include "Bible.h"
+#include "Ref.h"
+#include "Verse.h"
+#include <cstdint>
+#include <string>
+
+class VerseSegment {
+ public:
+   // Version of the layout; readers ignore segments with any other.
+   static const uint32_t layoutVersion = 2;
+
+   VerseSegment();
+   ~VerseSegment();
+
+   // Write a version's segment, replacing (and retiring) any segment already published for it.
+   // Reads every verse, so builds the Bible's full index. Returns false if it could not be written.
+   static bool publish(const std::string &version, Bible &bible);
+
+   // Retire and delete a version's segment, if it has one.
+   static void remove(const std::string &version);
+
+   // Map the current segment of a version, if it has a valid one owned by this user, or keep using the
+   // one mapped if it is still current. Returns false (and maps nothing) if there is no such segment.
+   bool attach(const std::string &version);
+
+   // Unmap the segment, if one is mapped.
+   void detach();
+
+   // Generation of the mapped segment: 1 for a version's first segment, and one more for each replacement.
+   uint64_t generation() const;
+
+   // The Bible::fileStamp of the text the mapped segment was published from.
+   std::string stamp() const;
+
+   // The same as Bible::lookup, next and prev on the Bible the segment was published from,
+   // except that a failed lookup's verse has no text, as in the server's reply. Must be attached.
+   Verse lookup(const Ref &ref, LookupResult &status) const;
+   Ref next(const Ref &ref, LookupResult &status) const;
+   Ref prev(const Ref &ref, LookupResult &status) const;
+
+ private:
+   // A reference as stored in a segment.
+   struct SegmentRef {
+      int16_t book;
+      int16_t chapter;
+      int16_t verse;
+      int16_t unused;
+   };
+
+   struct Header {
+      char magic[8];
+      uint32_t layout;
+      uint32_t retired;		// Set (atomically) once the segment is replaced or removed.
+      uint64_t generation;
+      uint64_t verses;
+      uint64_t refsOffset;	// Offsets of the arrays from the start of the segment.
+      uint64_t startsOffset;
+      uint64_t textOffset;
+      uint64_t textLength;
+      char stamp[64];		// Null-terminated.
+   };
+
+   std::string version;
+   const char *mapping;		// The mapped segment, or NULL.
+   size_t length;
+   const Header *header;
+   const SegmentRef *refs;
+   const uint64_t *starts;
+   const char *text;
+
+   // Path of a version's segment, or "" if the version cannot name a file.
+   static std::string segmentPath(const std::string &version);
+
+   // Check that the file open as fd is a regular file owned by this user.
+   static bool owned(int fd);
+
+   // Mark the segment open as fd retired, returning its generation (0 if it is not a segment of this user's).
+   static uint64_t retire(int fd);
+
+   // Convert a stored ref.
+   static Ref toRef(const SegmentRef &stored);
+
+   // Map and check the segment at path.
+   bool map(const std::string &path);
+
+   // Position of a ref among the segment's refs, or of the first ref after it.
+   size_t lowerBound(const Ref &ref) const;
+
+   // Check if the segment has a ref.
+   bool has(const Ref &ref) const;
+
+   // The lookup status Bible::lookup would give a ref.
+   LookupResult status(const Ref &ref) const;
+};
+
+#endif //VerseSegment_H
@@ -0,0 +1,294 @@
+// VerseStore class function definitions
+// Computer Science, MVNU
+
+#include "VerseStore.h"
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+using namespace std;
+
+const size_t FileVerseStore::chunkSize;
+const size_t FileVerseStore::lineBlock;
+
+FileVerseStore::FileVerseStore(const std::string &path) : fd(-1), length(0) {
+	fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if(fd == -1) {
+		return;
+	}
+	struct stat info;
+	if(fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		close(fd);
+		fd = -1;
+		return;
+	}
+	length = info.st_size;
+
+	// Divide the file into chunks of about chunkSize bytes, ending after a newline.
+	chunkStart.push_back(0);
+	char block[4096];
+	while(chunkStart.back() < length) {
+		uint64_t end = std::min<uint64_t>(chunkStart.back() + chunkSize, length);
+		// Look for the newline ending the chunk from its last byte on.
+		for(uint64_t at = end - 1; at < length; at += sizeof(block)) {
+			size_t size = std::min<uint64_t>(sizeof(block), length - at);
+			if(!readAt(at, block, size)) {
+				close(fd);
+				fd = -1;
+				return;
+			}
+			const char *newline = (const char *)memchr(block, '\n', size);
+			end = newline ? at + (newline - block) + 1 : std::min<uint64_t>(at + size, length);
+			if(newline) {
+				break;
+			}
+		}
+		chunkStart.push_back(end);
+	}
+}
+
+FileVerseStore::~FileVerseStore() {
+	if(fd >= 0) {
+		close(fd);
+	}
+}
+
+bool FileVerseStore::readAt(uint64_t offset, char *data, size_t size) {
+	while(size > 0) {
+		ssize_t got = pread(fd, data, size, offset);
+		if(got <= 0) {
+			return false;
+		}
+		data += got;
+		offset += got;
+		size -= got;
+	}
+	return true;
+}
+
+bool FileVerseStore::readLine(uint64_t offset, std::string &line) {
+	if(fd < 0 || offset >= length) {
+		return false;
+	}
+
+	// Read a block at a time until the newline (or the end of the file).
+	char block[lineBlock];
+	line.clear();
+	for(;;) {
+		size_t size = std::min<uint64_t>(sizeof(block), length - offset);
+		if(!readAt(offset, block, size)) {
+			return false;
+		}
+		const char *newline = (const char *)memchr(block, '\n', size);
+		line.append(block, newline ? newline - block : size);
+		offset += size;
+		if(newline || offset >= length) {
+			return true;
+		}
+	}
+}
+
+bool FileVerseStore::readLine(uint64_t offset, Arena &arena, std::string_view &line) {
+	if(fd < 0 || offset >= length) {
+		return false;
+	}
+
+	// Read straight into the arena, with room for a longer line each time the line does not fit.
+	for(size_t room = lineBlock;; room *= 4) {
+		size_t size = std::min<uint64_t>(room, length - offset);
+		char *text = (char *)arena.allocate(size, 1);
+		if(!readAt(offset, text, size)) {
+			return false;
+		}
+		const char *newline = (const char *)memchr(text, '\n', size);
+		if(newline || size == length - offset) {
+			line = std::string_view(text, newline ? newline - text : size);
+			return true;
+		}
+	}
+}
+
+size_t FileVerseStore::memoryUsage() {
+	// The file's text lives in the page cache, not the heap.
+	return sizeof(FileVerseStore) + chunkStart.capacity() * sizeof(uint64_t);
+}
+
+size_t FileVerseStore::chunkCount() {
+	return chunkStart.size() - 1;
+}
+
+VerseStore::Chunk FileVerseStore::getChunk(size_t chunk, std::string &buffer) {
+	Chunk result;
+	result.offset = chunkStart[chunk];
+	buffer.resize(chunkStart[chunk + 1] - chunkStart[chunk]);
+	result.text = buffer.data();
+	// A file shortened since it was opened has no lines left to scan.
+	result.length = readAt(result.offset, &buffer[0], buffer.size()) ? buffer.size() : 0;
+	return result;
+}
+
+void FileVerseStore::prefetch(uint64_t offset, size_t length) {
+	if(fd < 0 || offset >= this->length) {
+		return;
+	}
+	posix_fadvise(fd, offset, std::min<uint64_t>(length, this->length - offset), POSIX_FADV_WILLNEED);
+}
+
+const size_t CompressedVerseStore::defaultBlockSize;
+const size_t CompressedVerseStore::defaultCachedBlocks;
+
+CompressedVerseStore::CompressedVerseStore(istream &in, size_t blockSize, size_t cachedBlocks)
+		: isValid(true), compressedBytes(0), cachedBlocks(std::max<size_t>(cachedBlocks, 1)), decompressCount(0) {
+	std::string block, line;
+	uint64_t position = 0;
+
+	blockStart.push_back(0);
+	for(;;) {
+		bool more = (bool)getline(in, line);
+		if(more) {
+			block += line;
+			block += '\n';
+		}
+
+		// Finish the block once it is big enough, or at the end of the text.
+		if((block.size() >= blockSize || !more) && !block.empty()) {
+			uLongf size = compressBound(block.size());
+			std::string compressed(size, '\0');
+			if(compress2((Bytef *)&compressed[0], &size, (const Bytef *)block.data(), block.size(), Z_DEFAULT_COMPRESSION) != Z_OK) {
+				isValid = false;
+				return;
+			}
+			compressed.resize(size);
+			compressed.shrink_to_fit();
+			compressedBytes += size;
+
+			position += block.size();
+			blocks.push_back(std::move(compressed));
+			blockStart.push_back(position);
+			block.clear();
+		}
+
+		if(!more) {
+			break;
+		}
+	}
+}
+
+const std::string &CompressedVerseStore::getBlock(size_t block) {
+	for(std::list<CachedBlock>::iterator it = cache.begin(); it != cache.end(); ++it) {
+		if(it->block == block) {
+			// Hot block, mark as most recently used.
+			cache.splice(cache.begin(), cache, it);
+			return cache.front().text;
+		}
+	}
+
+	// Cold block, decompress it in place of the least recently used one, into that one's memory.
+	if(cache.size() >= cachedBlocks && !cache.empty()) {
+		cache.splice(cache.begin(), cache, std::prev(cache.end()));
+	}
+	else {
+		cache.push_front(CachedBlock());
+	}
+	CachedBlock &cached = cache.front();
+	cached.block = block;
+
+	uLongf size = blockStart[block + 1] - blockStart[block];
+	cached.text.resize(size);
+	if(uncompress((Bytef *)&cached.text[0], &size, (const Bytef *)blocks[block].data(), blocks[block].size()) != Z_OK) {
+		cached.text.clear();
+	}
+	decompressCount++;
+	return cached.text;
+}
+
+bool CompressedVerseStore::readLine(uint64_t offset, std::string &line) {
+	if(blocks.empty() || offset >= blockStart.back()) {
+		return false;
+	}
+
+	// Find the block containing the offset.
+	size_t block = std::upper_bound(blockStart.begin(), blockStart.end(), offset) - blockStart.begin() - 1;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const std::string &text = getBlock(block);
+
+	// Lines never cross blocks, so the line ends at the next newline in this block.
+	size_t start = offset - blockStart[block];
+	if(start >= text.size()) {
+		return false;
+	}
+	size_t end = text.find('\n', start);
+	line.assign(text, start, (end == std::string::npos ? text.size() : end) - start);
+	return true;
+}
+
+bool CompressedVerseStore::readLine(uint64_t offset, Arena &arena, std::string_view &line) {
+	if(blocks.empty() || offset >= blockStart.back()) {
+		return false;
+	}
+	size_t block = std::upper_bound(blockStart.begin(), blockStart.end(), offset) - blockStart.begin() - 1;
+
+	// The block may leave the cache once the mutex is released, so the line is copied out.
+	std::lock_guard<std::mutex> lock(mutex);
+	const std::string &text = getBlock(block);
+	size_t start = offset - blockStart[block];
+	if(start >= text.size()) {
+		return false;
+	}
+	size_t end = text.find('\n', start);
+	line = arena.copy(std::string_view(text).substr(start, (end == std::string::npos ? text.size() : end) - start));
+	return true;
+}
+
+void CompressedVerseStore::prefetch(uint64_t offset, size_t length) {
+	if(blocks.empty() || offset >= blockStart.back() || length == 0) {
+		return;
+	}
+
+	// Leave room in the cache for the blocks other readers are using.
+	size_t first = std::upper_bound(blockStart.begin(), blockStart.end(), offset) - blockStart.begin() - 1;
+	size_t last = std::upper_bound(blockStart.begin(), blockStart.end(), offset + length - 1) - blockStart.begin() - 1;
+	last = std::min(last, std::min(blocks.size() - 1, first + std::max<size_t>(cachedBlocks / 2, 1) - 1));
+
+	// Later blocks first, so the block being read now ends up most recently used.
+	std::lock_guard<std::mutex> lock(mutex);
+	for(size_t block = last + 1; block-- > first;) {
+		getBlock(block);
+	}
+}
+
+size_t CompressedVerseStore::chunkCount() {
+	return blocks.size();
+}
+
+VerseStore::Chunk CompressedVerseStore::getChunk(size_t chunk, std::string &buffer) {
+	// Decompress into the caller's buffer, leaving the cache of hot blocks alone.
+	uLongf size = blockStart[chunk + 1] - blockStart[chunk];
+	buffer.resize(size);
+	if(uncompress((Bytef *)&buffer[0], &size, (const Bytef *)blocks[chunk].data(), blocks[chunk].size()) != Z_OK) {
+		size = 0;
+	}
+
+	Chunk result;
+	result.offset = blockStart[chunk];
+	result.text = buffer.data();
+	result.length = size;
+	return result;
+}
+
+size_t CompressedVerseStore::memoryUsage() {
+	std::lock_guard<std::mutex> lock(mutex);
+
+	size_t bytes = sizeof(CompressedVerseStore) + blockStart.capacity() * sizeof(uint64_t) + blocks.capacity() * sizeof(std::string);
+	for(const std::string &block : blocks) {
+		bytes += block.capacity();
+	}
+	for(const CachedBlock &cached : cache) {
+		bytes += sizeof(CachedBlock) + cached.text.capacity();
+	}
+	return bytes;
+}
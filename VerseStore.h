@@ -0,0 +1,136 @@
+// Class VerseStore
+// Computer Science, MVNU
+//
+// A VerseStore holds the text of a Bible version and reads back the line
+// starting at a particular offset into the version's file.
+// The text can also be walked in chunks of whole lines, for scanning.
+//    * FileVerseStore       - keeps the file open and reads lines from it on demand (pread),
+//                             leaving the text to the kernel's page cache
+//    * CompressedVerseStore - keeps the text in memory, compressed in independent
+//                             blocks, with recently used blocks cached decompressed
+
+#ifndef VerseStore_H
+#define VerseStore_H
+
+#include "Arena.h"
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+class VerseStore {
+ public:
+   virtual ~VerseStore() {}
+
+   // Read the line starting at offset (without its newline). Returns false if it could not be read.
+   virtual bool readLine(uint64_t offset, std::string &line) = 0;
+
+   // Read the same line as a view, valid until the arena is reset: into the store's own text
+   // where it keeps the text as it is, or else into a copy in the arena.
+   virtual bool readLine(uint64_t offset, Arena &arena, std::string_view &line) = 0;
+
+   // Estimate the memory used by the store, in bytes.
+   virtual size_t memoryUsage() = 0;
+
+   // A contiguous piece of the text, starting and ending on line boundaries.
+   struct Chunk {
+      uint64_t offset;	// Offset of the first byte in the file.
+      const char *text;
+      size_t length;
+   };
+
+   // Number of chunks the text is divided into.
+   virtual size_t chunkCount() = 0;
+
+   // Get a chunk of the text. The chunk may point into buffer, and is valid until the
+   // buffer changes (or, for chunks that do not use it, as long as the store exists).
+   virtual Chunk getChunk(size_t chunk, std::string &buffer) = 0;
+
+   // Ready the length bytes of text from offset ahead of need, so lines read from it soon are fast.
+   // Only a hint: the text may not stay ready.
+   virtual void prefetch(uint64_t offset, size_t length) {}
+};
+
+class FileVerseStore : public VerseStore {
+ public:
+   // Approximate size of a chunk of the file.
+   static const size_t chunkSize = 1024 * 1024;
+
+   // Bytes read at a time while looking for the end of a line.
+   static const size_t lineBlock = 512;
+
+   FileVerseStore(const std::string &path);
+   ~FileVerseStore();
+
+   bool valid() { return fd >= 0; }
+   bool readLine(uint64_t offset, std::string &line);
+   bool readLine(uint64_t offset, Arena &arena, std::string_view &line);
+   size_t memoryUsage();
+   size_t chunkCount();
+   Chunk getChunk(size_t chunk, std::string &buffer);
+
+   // Ask the kernel to read the text in (POSIX_FADV_WILLNEED), without waiting for it.
+   void prefetch(uint64_t offset, size_t length);
+
+ private:
+   // The file is read, not mapped: a file rewritten in place then shows its new bytes (until the
+   // version is reloaded) or reads short, where a mapping would fault past a shortened end.
+   int fd;				// The open file, or -1 if it could not be opened.
+   uint64_t length;	// Its size when opened.
+   std::vector<uint64_t> chunkStart;	// Offset of each chunk's first byte; the last entry is the length.
+
+   // Read size bytes at offset into data. Returns false if they could not all be read (as when the
+   // file has been shortened since it was opened).
+   bool readAt(uint64_t offset, char *data, size_t size);
+};
+
+class CompressedVerseStore : public VerseStore {
+ public:
+   // Default uncompressed size of a block, and number of blocks kept decompressed.
+   static const size_t defaultBlockSize = 16 * 1024;
+   static const size_t defaultCachedBlocks = 16;
+
+   // Read and compress the whole of an open stream, in blocks of about blockSize bytes ending on line boundaries.
+   CompressedVerseStore(istream &in, size_t blockSize = defaultBlockSize, size_t cachedBlocks = defaultCachedBlocks);
+
+   bool valid() { return isValid; }
+   bool readLine(uint64_t offset, std::string &line);
+   bool readLine(uint64_t offset, Arena &arena, std::string_view &line);
+   size_t memoryUsage();
+   size_t chunkCount();
+   Chunk getChunk(size_t chunk, std::string &buffer);
+
+   // Decompress the blocks into the cache, filling at most half of it.
+   void prefetch(uint64_t offset, size_t length);
+
+   // Compressed and uncompressed sizes of the stored text, in bytes.
+   size_t compressedSize() { return compressedBytes; }
+   size_t uncompressedSize() { return blockStart.empty() ? 0 : blockStart.back(); }
+
+   // Number of block decompressions so far.
+   unsigned long decompressions() { return decompressCount; }
+
+ private:
+   struct CachedBlock {
+      size_t block;
+      std::string text;
+   };
+
+   bool isValid;
+   std::vector<std::string> blocks;	// Compressed blocks.
+   std::vector<uint64_t> blockStart;	// Offset of each block's first byte; the last entry is the total size.
+   size_t compressedBytes;
+
+   std::mutex mutex;
+   std::list<CachedBlock> cache;	// Decompressed blocks, most recently used first.
+   size_t cachedBlocks;
+   unsigned long decompressCount;
+
+   // Get a block's text, decompressing it if it is not cached. Must hold the mutex.
+   const std::string &getBlock(size_t block);
+};
+
+#endif //VerseStore_H
@@ -0,0 +1,113 @@
+// Versification class function definitions
+// Computer Science, MVNU
+
+#include "Versification.h"
+#include <algorithm>
+#include <list>
+#include <mutex>
+using namespace std;
+
+// Tables currently used by some version.
+static std::list<std::weak_ptr<const Versification>> sharedTables;
+static std::mutex sharedTablesMutex;
+
+const size_t Versification::npos;
+
+Versification::Versification(std::vector<Ref> sortedRefs) : refs(std::move(sortedRefs)) {
+	// Record where each book starts, with books missing from the table starting where the next book does.
+	Ref::book_id lastBook = refs.empty() ? 0 : std::max<Ref::book_id>(refs.back().getBook(), 0);
+	bookStart.assign(lastBook + 2, 0);
+
+	size_t ordinal = 0;
+	for(Ref::book_id book = 0; book <= lastBook + 1; book++) {
+		while(ordinal < refs.size() && refs[ordinal].getBook() < book) {
+			ordinal++;
+		}
+		bookStart[book] = ordinal;
+	}
+}
+
+size_t Versification::bookBegin(Ref::book_id book) const {
+	if(book < 0) {
+		return 0;
+	}
+	return (size_t)book < bookStart.size() ? bookStart[book] : refs.size();
+}
+
+size_t Versification::bookEnd(Ref::book_id book) const {
+	return bookBegin(book + 1);
+}
+
+size_t Versification::find(Ref ref) const {
+	size_t begin = bookBegin(ref.getBook()), end = bookEnd(ref.getBook());
+
+	// Search only within the book.
+	std::vector<Ref>::const_iterator it = std::lower_bound(refs.begin() + begin, refs.begin() + end, ref);
+	if(it != refs.begin() + end && *it == ref) {
+		return it - refs.begin();
+	}
+	return npos;
+}
+
+size_t Versification::upperBound(const Ref &ref) const {
+	return std::upper_bound(refs.begin(), refs.end(), ref) - refs.begin();
+}
+
+size_t Versification::lowerBound(const Ref &ref) const {
+	return std::lower_bound(refs.begin(), refs.end(), ref) - refs.begin();
+}
+
+size_t Versification::memoryUsage() const {
+	return sizeof(Versification) + refs.capacity() * sizeof(Ref) + bookStart.capacity() * sizeof(uint32_t);
+}
+
+// Count the references in one sorted list but not the other.
+static size_t countDifferences(const std::vector<Ref> &a, const Versification &b) {
+	size_t i = 0, j = 0, differences = 0;
+	while(i < a.size() && j < b.size()) {
+		if(a[i] < b.at(j)) {
+			differences++;
+			i++;
+		}
+		else if(b.at(j) < a[i]) {
+			differences++;
+			j++;
+		}
+		else {
+			i++;
+			j++;
+		}
+	}
+	return differences + (a.size() - i) + (b.size() - j);
+}
+
+std::shared_ptr<const Versification> Versification::share(const std::vector<Ref> &refs) {
+	// Tables within 5% of the references are close enough to share.
+	size_t allowed = std::max<size_t>(refs.size() / 20, 16);
+
+	std::lock_guard<std::mutex> lock(sharedTablesMutex);
+
+	std::shared_ptr<const Versification> best;
+	size_t bestDifferences = allowed + 1;
+	for(std::list<std::weak_ptr<const Versification>>::iterator it = sharedTables.begin(); it != sharedTables.end();) {
+		std::shared_ptr<const Versification> table = it->lock();
+		if(!table) {
+			// No version uses this table any more.
+			it = sharedTables.erase(it);
+			continue;
+		}
+
+		size_t differences = countDifferences(refs, *table);
+		if(differences < bestDifferences) {
+			best = table;
+			bestDifferences = differences;
+		}
+		++it;
+	}
+
+	if(!best) {
+		best = std::make_shared<const Versification>(refs);
+		sharedTables.push_back(best);
+	}
+	return best;
+}
@@ -0,0 +1,59 @@
+// Class Versification
+// Computer Science, MVNU
+//
+// A Versification is the ordered set of references making up a Bible,
+// numbering each reference with an ordinal from 0.
+// Most versions share (nearly) the same references, so versions share
+// Versification tables through share() and only store what differs.
+
+#ifndef Versification_H
+#define Versification_H
+
+#include "Ref.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Versification {
+ public:
+   // Ordinal returned when a reference is not in the table.
+   static const size_t npos = (size_t)-1;
+
+   // Construct from references in sorted order, without duplicates.
+   Versification(std::vector<Ref> refs);
+
+   // Find a shared table for a set of sorted, unique references, registering a new one if
+   // none of the tables in use is close enough. A version using the returned table keeps
+   // the references the table lacks as its own exceptions.
+   static std::shared_ptr<const Versification> share(const std::vector<Ref> &refs);
+
+   // Number of references in the table.
+   size_t size() const { return refs.size(); }
+
+   // The reference with a particular ordinal.
+   const Ref &at(size_t ordinal) const { return refs[ordinal]; }
+
+   // Get the ordinal of a reference, or npos if it is not in the table.
+   size_t find(Ref ref) const;
+
+   // Ordinal of the first reference greater than ref (size() if none).
+   size_t upperBound(const Ref &ref) const;
+
+   // Ordinal of the first reference not less than ref (size() if none).
+   size_t lowerBound(const Ref &ref) const;
+
+   // Ordinal range [bookBegin, bookEnd) of a book's references.
+   size_t bookBegin(Ref::book_id book) const;
+   size_t bookEnd(Ref::book_id book) const;
+
+   // Estimate the memory used by the table, in bytes.
+   size_t memoryUsage() const;
+
+ private:
+   std::vector<Ref> refs;
+
+   // First ordinal of each book, indexed by book number (one past the last book is the end).
+   std::vector<uint32_t> bookStart;
+};
+
+#endif //Versification_H
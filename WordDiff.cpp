@@ -0,0 +1,125 @@
+// WordDiff class function definitions
+// Computer Science, MVNU
+
+#include "WordDiff.h"
+#include <algorithm>
+using namespace std;
+
+// Id of a word of the second text that the first text lacks.
+static const uint32_t noId = UINT32_MAX;
+
+// Split text into its space-separated words.
+static void splitWords(std::string_view text, std::vector<std::string_view> &words) {
+	words.clear();
+	std::string_view::size_type start = 0;
+	while((start = text.find_first_not_of(' ', start)) != std::string_view::npos) {
+		std::string_view::size_type end = std::min(text.find(' ', start), text.size());
+		words.push_back(text.substr(start, end - start));
+		start = end;
+	}
+}
+
+void WordDiff::compute(std::string_view from, std::string_view to) {
+	splitWords(from, fromWords);
+	splitWords(to, toWords);
+
+	// Number the first text's distinct words; the second text's other words can never match.
+	ids.clear();
+	fromIds.clear();
+	for(std::string_view word : fromWords) {
+		fromIds.push_back(ids.emplace(word, ids.size()).first->second);
+	}
+	toIds.clear();
+	for(std::string_view word : toWords) {
+		std::unordered_map<std::string_view, uint32_t>::const_iterator it = ids.find(word);
+		toIds.push_back(it == ids.end() ? noId : it->second);
+	}
+
+	blocks = (fromWords.size() + 63) / 64;
+	matches.assign(ids.size() * blocks, 0);
+	for(size_t i = 0; i < fromIds.size(); i++) {
+		matches[fromIds[i] * blocks + i / 64] |= uint64_t(1) << (i % 64);
+	}
+
+	// Hyyro: V' = (V + (V & M)) | (V & ~M), with the addition carried across blocks.
+	rows.assign((toWords.size() + 1) * blocks, ~uint64_t(0));
+	for(size_t j = 0; blocks > 0 && j < toIds.size(); j++) {
+		const uint64_t *previous = &rows[j * blocks];
+		uint64_t *current = &rows[(j + 1) * blocks];
+		uint64_t carry = 0;
+		for(size_t w = 0; w < blocks; w++) {
+			uint64_t match = toIds[j] == noId ? 0 : matches[toIds[j] * blocks + w];
+			uint64_t v = previous[w], u = v & match;
+			uint64_t sum = v + u;
+			uint64_t carried = sum + carry;
+			carry = (sum < v) | (carried < sum);
+			current[w] = carried | (v & ~match);
+		}
+	}
+}
+
+size_t WordDiff::common(size_t i, size_t j) const {
+	if(i == 0) {
+		return 0;
+	}
+	const uint64_t *row = &rows[j * blocks];
+	size_t length = 0;
+	for(size_t w = 0; w < i / 64; w++) {
+		length += 64 - __builtin_popcountll(row[w]);
+	}
+	if(i % 64) {
+		uint64_t mask = (uint64_t(1) << (i % 64)) - 1;
+		length += (i % 64) - __builtin_popcountll(row[i / 64] & mask);
+	}
+	return length;
+}
+
+size_t WordDiff::commonLength(std::string_view from, std::string_view to) {
+	compute(from, to);
+	return common(fromWords.size(), toWords.size());
+}
+
+std::vector<DiffSpan> WordDiff::diff(std::string_view from, std::string_view to) {
+	compute(from, to);
+
+	// Trace the alignment back from the end, then join runs of the same op.
+	std::vector<std::pair<DiffOp, std::string_view>> steps;
+	size_t i = fromWords.size(), j = toWords.size();
+	while(i > 0 || j > 0) {
+		if(i > 0 && j > 0 && fromIds[i - 1] == toIds[j - 1] && common(i, j) == common(i - 1, j - 1) + 1) {
+			steps.push_back(make_pair(DIFF_EQUAL, fromWords[--i]));
+			j--;
+		}
+		else if(j > 0 && (i == 0 || common(i, j - 1) >= common(i - 1, j))) {
+			steps.push_back(make_pair(DIFF_INSERT, toWords[--j]));
+		}
+		else {
+			steps.push_back(make_pair(DIFF_DELETE, fromWords[--i]));
+		}
+	}
+
+	std::vector<DiffSpan> spans;
+	for(std::vector<std::pair<DiffOp, std::string_view>>::reverse_iterator step = steps.rbegin(); step != steps.rend(); ++step) {
+		if(spans.empty() || spans.back().op != step->first) {
+			spans.push_back(DiffSpan{step->first, std::string(step->second)});
+		}
+		else {
+			spans.back().text += ' ';
+			spans.back().text += step->second;
+		}
+	}
+	return spans;
+}
+
+char WordDiff::opSymbol(DiffOp op) {
+	return op == DIFF_EQUAL ? '=' : op == DIFF_DELETE ? '-' : '+';
+}
+
+bool WordDiff::symbolOp(char symbol, DiffOp &op) {
+	switch(symbol) {
+		case '=': op = DIFF_EQUAL; return true;
+		case '-': op = DIFF_DELETE; return true;
+		case '+': op = DIFF_INSERT; return true;
+		default: return false;
+	}
+}
@@ -0,0 +1,61 @@
+// WordDiff: word-level differences between two verse texts
+// Computer Science, MVNU
+//
+// Texts are split into words at spaces and aligned along a longest common
+// subsequence of words, computed bit-parallel (Hyyro's algorithm): each word of
+// the second text updates a bit vector over the first text's words with a few
+// word-sized operations, so a verse pair usually costs one machine word per word.
+// The bit vectors are kept to trace the alignment back into equal, deleted and
+// inserted spans.
+
+#ifndef WordDiff_H
+#define WordDiff_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// What a span of words does going from the first text to the second.
+enum DiffOp { DIFF_EQUAL, DIFF_DELETE, DIFF_INSERT };
+
+// A run of words with the same DiffOp, joined by single spaces.
+struct DiffSpan {
+   DiffOp op;
+   std::string text;
+};
+
+// Diffs texts, reusing its buffers from one pair to the next; not thread-safe.
+class WordDiff {
+ public:
+   // Get the spans turning from into to, in order.
+   std::vector<DiffSpan> diff(std::string_view from, std::string_view to);
+
+   // Length, in words, of the longest common subsequence of two texts.
+   size_t commonLength(std::string_view from, std::string_view to);
+
+   // Character marking an op in the protocol ('=', '-' or '+'), and back (returns false if unknown).
+   static char opSymbol(DiffOp op);
+   static bool symbolOp(char symbol, DiffOp &op);
+
+ private:
+   // Words of the current pair, as views of the texts, and as ids shared between the texts.
+   std::vector<std::string_view> fromWords, toWords;
+   std::vector<uint32_t> fromIds, toIds;
+   std::unordered_map<std::string_view, uint32_t> ids;
+
+   // For each id, a bit mask over the first text's words marking where it occurs.
+   std::vector<uint64_t> matches;
+   // The bit vector after each word of the second text; a 0 bit counts toward the common subsequence.
+   std::vector<uint64_t> rows;
+   size_t blocks;
+
+   // Split both texts and fill in the masks and rows.
+   void compute(std::string_view from, std::string_view to);
+
+   // Length of the common subsequence of the first i words of from and the first j of to.
+   size_t common(size_t i, size_t j) const;
+};
+
+#endif //WordDiff_H
@@ -19,12 +19,16 @@
 *     refers to the actual string entered in the form's "verse" field.
 */
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <limits>
 #include <stdio.h>
 #include <string.h>
 #include <sstream>
+#include <vector>
+#include <sys/sendfile.h>
+#include <unistd.h>
 using namespace std;
 
 /* Required libraries for AJAX to function */
@@ -34,7 +38,11 @@ using namespace std;
 using namespace cgicc;
 
 #include "Bible.h"
+#include "Canon.h"
 #include "BibleLookupClient.h"
+#include "Render.h"
+#include "ResponseCache.h"
+#include "StaticPassages.h"
 
 // Including the logging system.
 #define logging
@@ -62,19 +70,64 @@ public:
 		form_iterator chapter = cgi.getElement("chapter");
 		form_iterator verse = cgi.getElement("verse");
 		form_iterator nv = cgi.getElement("num_verse");
+		form_iterator reference = cgi.getElement("reference");
+		form_iterator compare = cgi.getElement("compare");
 
 		// Get the bible version.
 		bibleVersion = inputToBibleVersion(bible, "bible version");
 
-		// Construct the Ref from the input.
-		ref = Ref(
-			inputToInteger<Ref::book_id>(book, "book", Ref::MIN_BOOK_ID, Ref::MAX_BOOK_ID),
-			inputToInteger<Ref::chapter_id>(chapter, "chapter", Ref::MIN_CHAPTER_ID, Ref::MAX_CHAPTER_ID),
-			inputToInteger<Ref::verse_id>(verse, "verse", Ref::MIN_VERSE_ID, Ref::MAX_VERSE_ID)
-		);
+		// Other versions to show side by side, comma-separated.
+		if(elementSpecified(compare)) {
+			std::string list = compare->getValue();
+			std::string::size_type start = 0;
+			while(!failed && start <= list.size()) {
+				std::string::size_type comma = std::min(list.find(',', start), list.size());
+				std::string version = list.substr(start, comma - start);
+				if(!Bible::versionExists(version)) {
+					fail("the comparison version \"" + escapeHTML(version) + "\" is not a recognized bible version");
+				}
+				// A version already shown adds no column (and the server takes no more versions than it has).
+				if(version != bibleVersion && std::find(compareVersions.begin(), compareVersions.end(), version) == compareVersions.end()) {
+					compareVersions.push_back(version);
+				}
+				start = comma + 1;
+			}
+		}
+
+		if(elementSpecified(reference)) {
+			// A free-text reference ("John 3:16-18", "1 Cor 13") gives the whole passage, parsed here without asking the server.
+			RefRange range;
+			if(!Ref::parseRange(reference->getValue(), range)) {
+				fail("the reference \"" + escapeHTML(reference->getValue()) + "\" was not understood");
+			}
+			ref = range.first;
+			last = range.last;
+			numberOfVerses = elementSpecified(nv) ? inputToInteger<int>(nv, "verse count", 1, std::numeric_limits<int>::max())
+				: std::numeric_limits<int>::max();
+		}
+		else {
+			// Construct the Ref from the input.
+			ref = Ref(
+				inputToInteger<Ref::book_id>(book, "book", Ref::MIN_BOOK_ID, Ref::MAX_BOOK_ID),
+				inputToInteger<Ref::chapter_id>(chapter, "chapter", Ref::MIN_CHAPTER_ID, Ref::MAX_CHAPTER_ID),
+				inputToInteger<Ref::verse_id>(verse, "verse", Ref::MIN_VERSE_ID, Ref::MAX_VERSE_ID)
+			);
+			last = Ref(Ref::MAX_BOOK_ID, Ref::MAX_CHAPTER_ID, Ref::MAX_VERSE_ID);
+
+			// Get the desired verse count.
+			numberOfVerses = inputToInteger<int>(nv, "verse count", 1, std::numeric_limits<int>::max());
+		}
 
-		// Get the desired verse count.
-		numberOfVerses = inputToInteger<int>(nv, "verse count", 1, std::numeric_limits<int>::max());
+		// Versions that follow the canon can have refs checked (and passages bounded) here, without a server round trip.
+		if(!failed && Bible::versionFollowsCanon(bibleVersion)) {
+			RefRange range{ref, last};
+			if(!Canon::clamp(range)) {
+				fail(Canon::explain(ref));
+			}
+			else if(elementSpecified(reference)) {
+				last = range.last;
+			}
+		}
 	}
 
 	// Check if the request processing failed.
@@ -84,16 +137,22 @@ public:
 
 	// Get the request reference. Only works after success.
 	Ref getRef() { return ref; }
+	// Get the last reference to show. Only works after success.
+	Ref getLast() { return last; }
 	// Get the desired number of verses. Only works after success.
 	int getNumberOfVerses() { return numberOfVerses; }
 	// Get the desired Bible version. Only works after success.
 	std::string getBibleVersion() { return bibleVersion; };
+	// Get the versions to show beside it (none for a plain lookup). Only works after success.
+	std::vector<std::string> getCompareVersions() { return compareVersions; }
 private:
 	// Create the Cgicc object within the Request.
 	Cgicc cgi;
 
 	std::string bibleVersion;
+	std::vector<std::string> compareVersions;
 	Ref ref;
+	Ref last;
 	int numberOfVerses;
 
 	bool failed;
@@ -179,64 +238,319 @@ private:
 static const std::string pipe_id_receive = "bible_reply";
 static const std::string pipe_id_send = "bible_request";
 
+// Directory of the compressed chapters shared by every run.
+static const std::string cacheDirectory = "/tmp/benleskey-bibleajax-cache";
+
+// Directory of the versions rendered ahead of time ("make static").
+static const std::string staticDirectory = "/tmp/benleskey-bibleajax-static";
+
+// The response body, built from HTML and compressed fragments (such as cached chapters),
+// sent in the content coding the browser accepts.
+class BibleCGIResponse {
+public:
+	BibleCGIResponse(ResponseCache::Encoding encoding) : encoding(encoding) {}
+
+	// Add HTML to the body.
+	void add(const std::string &html) { pending += html; }
+
+	// Add part of a file, start through end, to the body. Without compression it is sent straight from the file.
+	void add(int fd, uint64_t start, uint64_t end) {
+		if(encoding == ResponseCache::IDENTITY) {
+			pieces.push_back(Piece{"", fd, start, end});
+			pieces.back().before.swap(pending);
+			return;
+		}
+		size_t size = pending.size();
+		pending.resize(size + (end - start));
+		if(pread(fd, &pending[size], end - start, start) != (ssize_t)(end - start)) {
+			pending.resize(size);
+		}
+	}
+
+	// Add a compressed fragment to the body.
+	void add(const ResponseCache::Fragment &fragment) {
+		if(encoding == ResponseCache::IDENTITY) {
+			ResponseCache::inflate(fragment, pending);
+			return;
+		}
+		flush();
+		fragments.push_back(fragment);
+	}
+
+	// Check if the body is compressed.
+	bool compressed() { return encoding != ResponseCache::IDENTITY; }
+
+	// Send the CGI headers and the body.
+	void send() {
+		std::string body;
+		uint64_t length = 0;
+		if(encoding == ResponseCache::IDENTITY) {
+			body.swap(pending);
+			for(const Piece &piece : pieces) {
+				length += piece.before.size() + (piece.end - piece.start);
+			}
+		}
+		else {
+			flush();
+			body = ResponseCache::encode(fragments, encoding);
+		}
+
+		// Plain text, we are only rendering part of a page.
+		cout << "Content-Type: text/plain\n";
+		if(encoding != ResponseCache::IDENTITY) {
+			cout << "Content-Encoding: " << ResponseCache::encodingName(encoding) << "\n";
+		}
+		cout << "Vary: Accept-Encoding\n" << "Content-Length: " << length + body.size() << "\n\n";
+		for(const Piece &piece : pieces) {
+			cout.write(piece.before.data(), piece.before.size());
+			cout.flush();
+			sendFile(piece);
+		}
+		cout.write(body.data(), body.size());
+		cout.flush();
+	}
+private:
+	ResponseCache::Encoding encoding;
+	std::string pending;	// HTML not yet compressed (all of the body, without compression).
+	std::vector<ResponseCache::Fragment> fragments;
+
+	// Text followed by part of a file, in a body sent without compression.
+	struct Piece {
+		std::string before;
+		int fd;
+		uint64_t start, end;
+	};
+	std::vector<Piece> pieces;
+
+	// Copy part of a file to the standard output, in the kernel if it can.
+	static void sendFile(const Piece &piece) {
+		off_t offset = piece.start;
+		while((uint64_t)offset < piece.end) {
+			ssize_t sent = sendfile(STDOUT_FILENO, piece.fd, &offset, piece.end - offset);
+			if(sent > 0) {
+				continue;
+			}
+			// Not possible to this output: copy it through a buffer instead.
+			char buffer[64 * 1024];
+			ssize_t got = pread(piece.fd, buffer, std::min<uint64_t>(sizeof(buffer), piece.end - offset), offset);
+			if(got <= 0 || write(STDOUT_FILENO, buffer, got) != got) {
+				return;
+			}
+			offset += got;
+		}
+	}
+
+	// Compress the pending HTML into a fragment of its own.
+	void flush() {
+		if(!pending.empty()) {
+			fragments.push_back(ResponseCache::compress(pending));
+			pending.clear();
+		}
+	}
+};
+
+// Render a whole chapter, first through last, as a plain lookup shows it. Returns false if a verse could not be read.
+// Sets stamp to that of the text it was rendered from, or "" if that changed while rendering (a version reloading).
+static bool renderChapter(BibleLookupClient &client, const Ref &first, const Ref &last, std::string &html, std::string &stamp) {
+	LookupResult before, after;
+	stamp = client.stamp(before);
+	renderChapterHeading(first, html);
+	LookupResult result = SUCCESS;
+	for(Ref ref = first; result == SUCCESS && !(last < ref); ref = client.next(ref, result)) {
+		Verse verse = client.lookup(ref, result);
+		if(result != SUCCESS) {
+			return false;
+		}
+		renderVerse(verse, html);
+	}
+	if(before != SUCCESS || client.stamp(after) != stamp || after != SUCCESS) {
+		stamp.clear();
+	}
+	return true;
+}
+
+// Show a passage rendered ahead of time, split into spans by chapter. Nothing is looked up: without
+// compression it is a heading and one span of the file; compressed, whole chapters come from the cache.
+static void displayStatic(StaticPassages &passages, const std::vector<StaticPassages::Span> &spans,
+		BibleCGIRequest &request, BibleCGIResponse &response) {
+	std::string heading;
+	if(!response.compressed()) {
+		renderChapterHeading(spans.front().first, heading);
+		response.add(heading);
+		response.add(passages.getFd(), spans.front().start, spans.back().end);
+		return;
+	}
+
+	ResponseCache cache(cacheDirectory);
+	std::string versionFile = Bible::getVersionFile(request.getBibleVersion());
+	for(const StaticPassages::Span &span : spans) {
+		ResponseCache::Fragment fragment;
+		if(span.whole && cache.chapter(request.getBibleVersion(), versionFile, span.first, [&](std::string &html, std::string &stamp) {
+					stamp = passages.getStamp();
+					return passages.read(span.heading, span.end, html);
+				}, fragment)) {
+			response.add(fragment);
+			continue;
+		}
+		heading.clear();
+		renderChapterHeading(span.first, heading);
+		response.add(heading);
+		response.add(passages.getFd(), span.start, span.end);
+	}
+}
+
+// Show a passage in several versions side by side, one table per chapter, fetched in parallel by the server.
+static void displayParallel(BibleLookupClient &client, BibleCGIRequest &request, std::ostream &out) {
+	std::vector<std::string> versions = request.getCompareVersions();
+	versions.insert(versions.begin(), request.getBibleVersion());
+
+	// Stay within the first book, and ask again from where a reply cut off.
+	Ref first = request.getRef();
+	Ref last = std::min(request.getLast(), Ref(first.getBook(), Ref::MAX_CHAPTER_ID, Ref::MAX_VERSE_ID));
+	int remaining = request.getNumberOfVerses();
+	int currentChapter = -1;
+	LookupResult result = SUCCESS;
+	while(remaining > 0 && !(last < first)) {
+		std::vector<BibleLookupClient::ParallelRow> rows = client.parallel(versions, first, last, result);
+		if(result != SUCCESS || rows.empty()) {
+			break;
+		}
+		for(size_t i = 0; i < rows.size() && remaining > 0; i++, remaining--) {
+			if(rows[i].ref.getChapter() != currentChapter) {
+				if(currentChapter != -1) {
+					out << "</table>" << endl;
+				}
+				currentChapter = rows[i].ref.getChapter();
+				out << "<h2>" << rows[i].ref.getBookName() << " " << currentChapter << "</h2>" << endl << "<table><tr><th></th>";
+				for(const std::string &version : versions) {
+					out << "<th>" << version << "</th>";
+				}
+				out << "</tr>" << endl;
+			}
+			out << "<tr><td><em>" << rows[i].ref.getVerse() << ".</em></td>";
+			for(const std::string &text : rows[i].texts) {
+				out << "<td>" << text << "</td>";
+			}
+			out << "</tr>" << endl;
+		}
+
+		Ref end = rows.back().ref;
+		first = end.getVerse() < Ref::MAX_VERSE_ID ? Ref(end.getBook(), end.getChapter(), end.getVerse() + 1)
+			: Ref(end.getBook(), end.getChapter() + 1, Ref::MIN_VERSE_ID);
+	}
+	if(currentChapter != -1) {
+		out << "</table>" << endl;
+	}
+	else {
+		out << "Lookup error: <em>" << Bible::error(result) << "</em>" << endl;
+	}
+}
+
 int main() {
 	// Begin logging.
 	#ifdef logging
 		logFile.open(logFilename.c_str(),ios::out);
 	#endif
 
-	// Send the required CGI content type header.
-	// Plain text, we are only rendering part of a page.
-	cout << "Content-Type: text/plain\n\n";
+	// Answer in the best content coding the browser accepts; the CGI headers go out with the body.
+	BibleCGIResponse response(ResponseCache::negotiate(getenv("HTTP_ACCEPT_ENCODING")));
 
 	// Construct the request wrapper (it will create the Cgicc instance).
 	BibleCGIRequest request;
 
 	if(request.getFailed()) {
 		// Output initial input error message upon failure.
-		cout << "<p>Input error: <em>" << request.getErrorMessage() << "</em></p>";
+		response.add("<p>Input error: <em>" + request.getErrorMessage() + "</em></p>");
 		log("request itself was invalid: " + request.getErrorMessage());
 	}
 	else {
+		// A passage rendered ahead of time is served from the file, without the server.
+		StaticPassages passages(staticDirectory, request.getBibleVersion(), Bible::getVersionFile(request.getBibleVersion()));
+		std::vector<StaticPassages::Span> spans;
+		if(request.getCompareVersions().empty()
+				&& passages.passage(request.getRef(), request.getLast(), request.getNumberOfVerses(), spans)) {
+			log("Request for " + request.getRef().toString() + " with " + std::to_string(request.getNumberOfVerses()) + " verse(s), version: " + request.getBibleVersion() + ", rendered ahead of time");
+			displayStatic(passages, spans, request, response);
+			response.send();
+			return 0;
+		}
+
 		// Construct the client for requesting.
 		BibleLookupClient client(pipe_id_send, pipe_id_receive, request.getBibleVersion());
 
 		log("Initial request for " + request.getRef().toString() + " with " + std::to_string(request.getNumberOfVerses()) + " verse(s), version: " + request.getBibleVersion());
 
+		// Side-by-side versions come in one request per passage rather than verse by verse.
+		if(!request.getCompareVersions().empty()) {
+			std::stringstream html;
+			displayParallel(client, request, html);
+			response.add(html.str());
+			response.send();
+			log("Request fulfilled.");
+			return 0;
+		}
+
 		// Look up the first verse.
 		LookupResult result;
 		Verse verse = client.lookup(request.getRef(), result);
 
 		if(result == SUCCESS) {
 			// Successful lookup, continue for all verses.
+			ResponseCache cache(cacheDirectory);
+			std::string versionFile = Bible::getVersionFile(request.getBibleVersion());
 
 			// Current chapter being displayed, default to -1 to indicate display has not started.
 			int currentChapter = -1;
+			int remaining = request.getNumberOfVerses();
+			Ref ref = verse.getRef();
+			bool haveVerse = true;
 			// Loop through possible verses until the end is reached (end of desired verses, end of initial book, or end of Bible).
-			for(int i = 0; i < request.getNumberOfVerses() && verse.getRef().getBook() == request.getRef().getBook() && result == SUCCESS; i++) {
-				log("Got reply for " + verse.getRef().toString());
-				// New chapter, print header.
-				if(verse.getRef().getChapter() != currentChapter) {
-					// Update current chapter to the next.
-					currentChapter = verse.getRef().getChapter();
-					cout << "<h2>" << verse.getRef().getBookName() << " " << verse.getRef().getChapter() << "</h2>" << endl;
+			while(remaining > 0 && result == SUCCESS && ref.getBook() == request.getRef().getBook() && !(request.getLast() < ref)) {
+				// New chapter: all of it comes from the cache (without looking up its verses) if the passage covers it.
+				if(ref.getChapter() != currentChapter) {
+					currentChapter = ref.getChapter();
+					Ref first, last;
+					LookupResult bounds;
+					size_t count = client.chapterBounds(ref, first, last, bounds);
+					ResponseCache::Fragment fragment;
+					if(bounds == SUCCESS && ref == first && (size_t)remaining >= count && !(request.getLast() < last)
+							&& cache.chapter(request.getBibleVersion(), versionFile, first, [&](std::string &html, std::string &stamp) {
+								return renderChapter(client, first, last, html, stamp);
+							}, fragment)) {
+						log("Whole chapter " + first.toString() + " from the cache");
+						response.add(fragment);
+						remaining -= count;
+						ref = client.nextChapter(ref, result);
+						haveVerse = false;
+						continue;
+					}
+
+					// Part of a chapter, print header.
+					std::string heading;
+					renderChapterHeading(ref, heading);
+					response.add(heading);
 				}
 
+				// Look up the verse, unless it is already in hand.
+				if(!haveVerse) {
+					log("Requesting " + ref.toString());
+					verse = client.lookup(ref, result);
+					if(result != SUCCESS) {
+						break;
+					}
+				}
+				log("Got reply for " + verse.getRef().toString());
+
 				// Output verse.
-				cout << "<p><em>" << verse.getRef().getVerse() << ".</em> " << verse.getVerse() << "</p>" << endl;
+				std::string html;
+				renderVerse(verse, html);
+				response.add(html);
+				remaining--;
 
 				// Find the next ref.
 				log("Finding next ref...");
-				Ref nextRef = client.next(verse.getRef(), result);
-
-				// If there is another verse, look it up for the next iteration.
-				if(result == SUCCESS) {
-					log("Got next ref, now requesting " + nextRef.toString());
-					verse = client.lookup(nextRef, result);
-				}
-				else {
-					log("No next ref.");
-				}
+				ref = client.next(ref, result);
+				haveVerse = false;
 			}
 
 			log("Request fulfilled.");
@@ -244,18 +558,22 @@ int main() {
 		else {
 			log("Request failed, server said: " +  Bible::error(result));
 			// Failed lookup, output error message.
-			cout << "Lookup error: <em>" << Bible::error(result);
+			std::stringstream html;
+			html << "Lookup error: <em>" << Bible::error(result);
 			switch(result) {
 				case NO_CHAPTER:
-					cout << " in " << request.getRef().getBookName();
+					html << " in " << request.getRef().getBookName();
 					break;
 				case NO_VERSE:
-					cout << " in " << request.getRef().getBookName() << " " << request.getRef().getChapter();
+					html << " in " << request.getRef().getBookName() << " " << request.getRef().getChapter();
 					break;
 				default:
 					break;
 			}
-			cout << "</em>" << endl;
+			html << "</em>" << endl;
+			response.add(html.str());
 		}
 	}
+
+	response.send();
 }
@@ -0,0 +1,741 @@
+/*
+ * biblebench.cpp: Benchmarks for Bible indexing, storage and lookup.
+ * Author: Benjamin Leskey
+ *
+ * Runs against the versions in a manifest (such as one written by biblegen),
+ * so results can be reproduced at any scale without the class Bibles.
+ * Each benchmark configuration runs in its own process so that memory
+ * measurements are not disturbed by earlier configurations.
+ */
+
+#include "Arena.h"
+#include "Bible.h"
+#include "BibleCache.h"
+#include "Protocol.h"
+#include "ReadAhead.h"
+#include "Ref.h"
+#include "RequestHandler.h"
+#include "RequestQueue.h"
+#include "TextScan.h"
+#include "WordDiff.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+/* Benchmark settings. */
+struct Settings {
+	long lookups = 100000;
+	unsigned seed = 3004;
+};
+
+typedef std::chrono::steady_clock Clock;
+
+/* Heap allocations made by this thread, counted by the replacement operator new below (for the alloc benchmark). */
+static thread_local unsigned long heapAllocations = 0;
+
+void *operator new(size_t size) {
+	heapAllocations++;
+	void *memory = malloc(size ? size : 1);
+	if(!memory) {
+		throw std::bad_alloc();
+	}
+	return memory;
+}
+
+void operator delete(void *memory) noexcept {
+	free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept {
+	free(memory);
+}
+
+/* Microseconds elapsed since a starting time. */
+static double elapsedMicroseconds(Clock::time_point start) {
+	return std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+}
+
+/* Current resident set size, in bytes. */
+static size_t residentBytes() {
+	std::ifstream statm("/proc/self/statm");
+	size_t total = 0, resident = 0;
+	statm >> total >> resident;
+	return resident * sysconf(_SC_PAGESIZE);
+}
+
+static double megabytes(size_t bytes) {
+	return bytes / (1024.0 * 1024.0);
+}
+
+/* Run a function in a child process, so each configuration starts from a clean heap. */
+static void isolated(const std::function<void()> &run) {
+	std::cout << std::flush;
+	pid_t child = fork();
+	if(child == 0) {
+		run();
+		std::cout << std::flush;
+		_exit(EXIT_SUCCESS);
+	}
+	else if(child > 0) {
+		waitpid(child, NULL, 0);
+	}
+}
+
+/* Collect every Ref in a Bible by walking it with next. */
+static std::vector<Ref> allRefs(Bible &bible) {
+	std::vector<Ref> refs;
+
+	/* The walk starts from the first verse of the first book present. */
+	for(Ref::book_id book = Ref::MIN_BOOK_ID; book <= Ref::MAX_BOOK_ID && refs.empty(); book++) {
+		Ref ref(book, Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID);
+		LookupResult status;
+		bible.lookup(ref, status);
+		while(status == SUCCESS) {
+			refs.push_back(ref);
+			ref = bible.next(ref, status);
+		}
+	}
+	return refs;
+}
+
+/* Print latency percentiles for a set of samples in microseconds. */
+static void printLatency(std::vector<double> &samples) {
+	std::sort(samples.begin(), samples.end());
+	double total = 0;
+	for(double sample : samples) {
+		total += sample;
+	}
+	std::cout << std::fixed << std::setprecision(2)
+		<< " mean " << total / samples.size() << " us"
+		<< ", p50 " << samples[samples.size() / 2] << " us"
+		<< ", p99 " << samples[samples.size() * 99 / 100] << " us";
+}
+
+/*
+ * Storage benchmark: memory and random lookup latency of each text storage mode.
+ * All versions are loaded at once, as the server would hold them.
+ */
+static void benchmarkStorage(const Settings &settings) {
+	struct Mode {
+		StorageMode mode;
+		const char *name;
+	};
+	const Mode modes[] = {{STORAGE_FILE, "file"}, {STORAGE_COMPRESSED, "compressed"}};
+
+	std::cout << "== storage: RSS vs lookup latency (" << settings.lookups << " random lookups)" << std::endl;
+	for(const Mode &mode : modes) {
+		isolated([&]() {
+			size_t before = residentBytes();
+			Clock::time_point start = Clock::now();
+
+			std::vector<std::unique_ptr<Bible>> bibles;
+			size_t estimated = 0;
+			for(const std::string &version : Bible::getVersionList()) {
+				bibles.emplace_back(new Bible(Bible::getVersionFile(version), mode.mode));
+				estimated += bibles.back()->memoryUsage();
+			}
+			double loadMs = elapsedMicroseconds(start) / 1000;
+			size_t rss = residentBytes() - before;
+
+			/* Random lookups across versions. */
+			std::vector<Ref> refs = allRefs(*bibles.front());
+			std::mt19937 rng(settings.seed);
+			std::vector<double> samples;
+			samples.reserve(settings.lookups);
+			for(long i = 0; i < settings.lookups; i++) {
+				Bible &bible = *bibles[rng() % bibles.size()];
+				const Ref &ref = refs[rng() % refs.size()];
+				LookupResult status;
+
+				Clock::time_point lookupStart = Clock::now();
+				bible.lookup(ref, status);
+				samples.push_back(elapsedMicroseconds(lookupStart));
+			}
+
+			std::cout << std::setw(12) << mode.name << ": load " << std::fixed << std::setprecision(0) << loadMs << " ms"
+				<< ", RSS " << std::setprecision(1) << megabytes(rss) << " MB"
+				<< " (estimated " << megabytes(estimated) << " MB),";
+			printLatency(samples);
+			std::cout << std::endl;
+		});
+	}
+}
+
+/*
+ * Scan benchmark: substring and regex scans over the raw text of every version,
+ * scalar against AVX2 and one thread against all of them.
+ */
+static void benchmarkScan(const Settings &settings) {
+	std::vector<std::shared_ptr<Bible>> bibles;
+	size_t bytes = 0;
+	for(const std::string &version : Bible::getVersionList()) {
+		bibles.push_back(std::make_shared<Bible>(Bible::getVersionFile(version)));
+		std::ifstream file(Bible::getVersionFile(version), std::ios::ate);
+		bytes += file.tellg();
+	}
+
+	/* A common word, a rarer phrase, and a needle that never matches. */
+	const std::vector<std::string> needles = {"the", "lord said", "zzqzzq"};
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> threadCounts = {1};
+	if(cores > 1) {
+		threadCounts.push_back(cores);
+	}
+	const int rounds = 5;
+
+	std::cout << "== scan: " << bibles.size() << " versions, " << std::fixed << std::setprecision(1) << megabytes(bytes) << " MB of text, "
+		<< (cpuHasAvx2() ? "AVX2 available" : "no AVX2") << ", " << cores << " threads" << std::endl;
+	for(const std::string &needle : needles) {
+		for(bool simd : {false, true}) {
+			for(unsigned threads : threadCounts) {
+				SubstringMatcher matcher(needle, simd);
+				size_t matches = 0;
+				scanBibles(bibles, matcher, threads);
+				Clock::time_point start = Clock::now();
+				for(int i = 0; i < rounds; i++) {
+					matches = 0;
+					for(const std::vector<Ref> &found : scanBibles(bibles, matcher, threads)) {
+						matches += found.size();
+					}
+				}
+				double ms = elapsedMicroseconds(start) / 1000 / rounds;
+				std::cout << std::setw(12) << ("\"" + needle + "\"") << " " << std::setw(6) << (matcher.usingSimd() ? "avx2" : "scalar")
+					<< " x" << threads << ": " << std::setprecision(2) << ms << " ms, "
+					<< std::setprecision(0) << megabytes(bytes) / (ms / 1000) << " MB/s, " << matches << " verses" << std::endl;
+			}
+		}
+	}
+
+	RegexMatcher regex("\\blord (said|spake)\\b", true);
+	for(unsigned threads : threadCounts) {
+		size_t matches = 0;
+		Clock::time_point start = Clock::now();
+		for(const std::vector<Ref> &found : scanBibles(bibles, regex, threads)) {
+			matches += found.size();
+		}
+		std::cout << std::setw(12) << "regex" << " x" << threads << ": " << std::setprecision(2) << elapsedMicroseconds(start) / 1000
+			<< " ms, " << matches << " verses" << std::endl;
+	}
+}
+
+/*
+ * Completion benchmark: latency of word and book name type-ahead,
+ * for every prefix a user would type on the way to random words.
+ */
+static void benchmarkComplete(const Settings &settings) {
+	Bible bible(Bible::getVersionFile(Bible::getVersionList().front()));
+	LookupResult status;
+
+	Clock::time_point start = Clock::now();
+	bible.buildTextIndex();
+	double buildMs = elapsedMicroseconds(start) / 1000;
+
+	/* Random words to type, taken from the text. */
+	std::vector<std::string> words;
+	bible.forEachVerse([&words](const Ref &, const std::string &text) {
+		for(const std::string &word : TextIndex::tokenize(text)) {
+			words.push_back(word);
+		}
+	});
+	std::mt19937 rng(settings.seed);
+	auto keystrokes = [&](const std::function<std::string()> &pick) {
+		std::vector<std::string> typed;
+		while((long)typed.size() < settings.lookups) {
+			std::string word = pick();
+			for(size_t length = 1; length <= word.size(); length++) {
+				typed.push_back(word.substr(0, length));
+			}
+		}
+		return typed;
+	};
+	std::vector<std::string> typedWords = keystrokes([&]() {
+		return words[rng() % words.size()];
+	});
+	std::vector<std::string> typedBooks = keystrokes([&]() {
+		return Ref(Ref::MIN_BOOK_ID + rng() % Ref::MAX_BOOK_ID, Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID).getBookName();
+	});
+
+	std::cout << "== complete: " << settings.lookups << " keystrokes each, index built in " << std::fixed << std::setprecision(0) << buildMs << " ms" << std::endl;
+	for(bool books : {false, true}) {
+		std::vector<double> samples;
+		samples.reserve(settings.lookups);
+		for(const std::string &prefix : books ? typedBooks : typedWords) {
+			Clock::time_point completeStart = Clock::now();
+			if(books) {
+				bible.completeBook(prefix, 10, status);
+			}
+			else {
+				bible.completeWord(prefix, 10, status);
+			}
+			samples.push_back(elapsedMicroseconds(completeStart));
+		}
+		std::cout << std::setw(12) << (books ? "book top-10" : "word top-10") << ":";
+		printLatency(samples);
+		std::cout << std::endl;
+	}
+}
+
+/*
+ * Parse benchmark: splitting server requests and client replies and reading their refs,
+ * with GetNextToken and Ref(string) against the allocation-free Protocol parsers.
+ */
+static void benchmarkParse(const Settings &settings) {
+	std::mt19937 rng(settings.seed);
+	std::vector<std::string> requests, replies;
+	for(long i = 0; i < settings.lookups; i++) {
+		Ref ref(1 + rng() % Ref::MAX_BOOK_ID, 1 + rng() % Ref::MAX_CHAPTER_ID, 1 + rng() % Ref::MAX_VERSE_ID);
+		requests.push_back("kjv lookup " + ref.toString());
+		replies.push_back("0 " + ref.toString() + " And God said, Let there be light: and there was light.");
+	}
+
+	/* Fold the results into a checksum so the work cannot be optimized away. */
+	long checksum = 0;
+	auto report = [&](const char *name, Clock::time_point start) {
+		std::cout << std::setw(16) << name << ": " << std::fixed << std::setprecision(1)
+			<< elapsedMicroseconds(start) * 1000 / settings.lookups << " ns per message" << std::endl;
+	};
+
+	std::cout << "== parse: " << settings.lookups << " messages" << std::endl;
+	Clock::time_point start = Clock::now();
+	for(std::string request : requests) {
+		std::string version = GetNextToken(request, " ");
+		std::string action = GetNextToken(request, " ");
+		Ref ref(GetNextToken(request, " "));
+		checksum += version.size() + action.size() + ref.getVerse();
+	}
+	report("request, tokens", start);
+
+	start = Clock::now();
+	for(const std::string &message : requests) {
+		Request request;
+		Ref ref;
+		parseRequest(message, request);
+		Ref::parse(request.argument, ref);
+		checksum += request.version.size() + request.action.size() + ref.getVerse();
+	}
+	report("request, views", start);
+
+	start = Clock::now();
+	for(std::string reply : replies) {
+		LookupResult status = static_cast<LookupResult>(atoi(GetNextToken(reply, " ").c_str()));
+		Ref ref(reply);
+		checksum += status + ref.getVerse();
+	}
+	report("reply, tokens", start);
+
+	start = Clock::now();
+	for(const std::string &message : replies) {
+		Reply reply;
+		Ref ref;
+		parseReply(message, reply);
+		Ref::parse(reply.body, ref);
+		checksum += reply.status + ref.getVerse();
+	}
+	report("reply, views", start);
+
+	std::cout << "(checksum " << checksum << ")" << std::endl;
+}
+
+/*
+ * Diff benchmark: word-level diffs of every verse the first two versions share,
+ * with the bit-parallel WordDiff against a textbook dynamic-programming LCS.
+ */
+static void benchmarkDiff(const Settings &settings) {
+	std::list<std::string> versions = Bible::getVersionList();
+	if(versions.size() < 2) {
+		std::cout << "== diff: needs two versions" << std::endl;
+		return;
+	}
+	Bible from(Bible::getVersionFile(versions.front())), to(Bible::getVersionFile(*std::next(versions.begin())));
+	std::vector<std::pair<std::string, std::string>> pairs;
+	std::vector<std::string> fromTexts;
+	std::vector<Ref> fromRefs;
+	from.forEachVerse([&](const Ref &ref, const std::string &text) {
+		fromRefs.push_back(ref);
+		fromTexts.push_back(text);
+	});
+	for(size_t i = 0; i < fromRefs.size(); i++) {
+		LookupResult status;
+		Verse verse = to.lookup(fromRefs[i], status);
+		if(status == SUCCESS) {
+			pairs.push_back(std::make_pair(fromTexts[i], verse.getVerse()));
+		}
+	}
+
+	auto split = [](const std::string &text) {
+		std::vector<std::string> words;
+		std::istringstream in(text);
+		std::string word;
+		while(in >> word) {
+			words.push_back(word);
+		}
+		return words;
+	};
+	auto report = [&](const char *name, Clock::time_point start, long common) {
+		double ms = elapsedMicroseconds(start) / 1000;
+		std::cout << std::setw(16) << name << ": " << std::fixed << std::setprecision(1) << ms << " ms, "
+			<< std::setprecision(2) << ms * 1000 / pairs.size() << " us per verse (common words " << common << ")" << std::endl;
+	};
+
+	std::cout << "== diff: " << pairs.size() << " verses of " << versions.front() << " and " << *std::next(versions.begin()) << std::endl;
+	Clock::time_point start = Clock::now();
+	long common = 0;
+	for(const auto &pair : pairs) {
+		std::vector<std::string> a = split(pair.first), b = split(pair.second);
+		std::vector<std::vector<int>> table(a.size() + 1, std::vector<int>(b.size() + 1, 0));
+		for(size_t i = 1; i <= a.size(); i++) {
+			for(size_t j = 1; j <= b.size(); j++) {
+				table[i][j] = a[i - 1] == b[j - 1] ? table[i - 1][j - 1] + 1 : std::max(table[i - 1][j], table[i][j - 1]);
+			}
+		}
+		common += table[a.size()][b.size()];
+	}
+	report("table LCS", start, common);
+
+	WordDiff differ;
+	start = Clock::now();
+	common = 0;
+	for(const auto &pair : pairs) {
+		common += differ.commonLength(pair.first, pair.second);
+	}
+	report("bit-parallel LCS", start, common);
+
+	start = Clock::now();
+	size_t spans = 0;
+	for(const auto &pair : pairs) {
+		spans += differ.diff(pair.first, pair.second).size();
+	}
+	report("spans", start, common);
+	std::cout << "(" << spans << " spans)" << std::endl;
+}
+
+/*
+ * Similarity benchmark: latency of finding the 10 verses most like a random verse
+ * over the whole version, scalar and AVX2, on one thread and on every core.
+ */
+static void benchmarkSimilar(const Settings &settings) {
+	Bible bible(Bible::getVersionFile(Bible::getVersionList().front()));
+	SimilarityIndex index;
+	std::vector<std::pair<Ref, std::string>> verses;
+	Clock::time_point start = Clock::now();
+	bible.forEachVerse([&](const Ref &ref, const std::string &text) {
+		index.addVerse(ref, text);
+		verses.push_back(std::make_pair(ref, text));
+	});
+	index.finish();
+	double buildMs = elapsedMicroseconds(start) / 1000;
+
+	std::mt19937 rng(settings.seed);
+	std::vector<size_t> queries;
+	long count = std::min(settings.lookups, 1000L);
+	for(long i = 0; i < count; i++) {
+		queries.push_back(rng() % verses.size());
+	}
+
+	std::cout << "== similar: " << count << " queries over " << index.size() << " verses, built in " << std::fixed << std::setprecision(0)
+		<< buildMs << " ms, " << std::setprecision(1) << megabytes(index.memoryUsage()) << " MB" << std::endl;
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> threadCounts = {1};
+	if(cores > 1) {
+		threadCounts.push_back(cores);
+	}
+	for(bool simd : {false, true}) {
+		if(simd && !cpuHasAvx2()) {
+			continue;
+		}
+		for(unsigned threads : threadCounts) {
+			std::vector<double> samples;
+			for(size_t query : queries) {
+				Clock::time_point queryStart = Clock::now();
+				index.similar(verses[query].second, 10, verses[query].first, threads, simd);
+				samples.push_back(elapsedMicroseconds(queryStart));
+			}
+			std::cout << std::setw(8) << (simd ? "avx2" : "scalar") << std::setw(3) << threads << " thread(s):";
+			printLatency(samples);
+			std::cout << std::endl;
+		}
+	}
+}
+
+/*
+ * Build benchmark: reading each version's references for its index, with the
+ * original getline/tellg loop against Bible::lineRefs on memchr-split chunks,
+ * checking that both find the same references at the same offsets; then the
+ * time to a first lookup and the steady-state lookup latency of each index mode.
+ */
+static void benchmarkBuild(const Settings &settings) {
+	typedef std::vector<std::pair<Ref, uint64_t>> Entries;
+	unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<unsigned> threadCounts = {1};
+	if(cores > 1) {
+		threadCounts.push_back(cores);
+	}
+
+	std::cout << "== build: index entries per version, " << cores << " threads" << std::endl;
+	for(const std::string &version : Bible::getVersionList()) {
+		std::string path = Bible::getVersionFile(version);
+
+		/* The loop Bible::buildIndex used to run. */
+		Clock::time_point start = Clock::now();
+		Entries expected;
+		std::ifstream in(path);
+		std::string buffer;
+		std::streampos position = in.tellg();
+		while(getline(in, buffer)) {
+			/* Lines whose refs are out of range are left out of the index. */
+			std::string_view text(buffer);
+			Ref ref;
+			if(!buffer.empty() && Ref::parse(text, ref)) {
+				expected.push_back(std::make_pair(ref, (uint64_t)position));
+			}
+			position = in.tellg();
+		}
+		double baseMs = elapsedMicroseconds(start) / 1000;
+		std::cout << std::setw(10) << version << " getline: " << std::fixed << std::setprecision(2) << baseMs << " ms, "
+			<< expected.size() << " lines" << std::endl;
+
+		FileVerseStore store(path);
+		for(unsigned threads : threadCounts) {
+			start = Clock::now();
+			Entries entries = Bible::lineRefs(store, threads);
+			double ms = elapsedMicroseconds(start) / 1000;
+			std::cout << std::setw(10) << version << " chunked x" << threads << ": " << ms << " ms ("
+				<< std::setprecision(1) << baseMs / ms << "x), " << (entries == expected ? "identical" : "DIFFERENT")
+				<< std::setprecision(2) << std::endl;
+		}
+
+		/* Time to the first lookup, then steady-state lookups once every book has been read. */
+		for(IndexMode indexing : {INDEX_FULL, INDEX_LAZY}) {
+			start = Clock::now();
+			Bible bible(path, STORAGE_FILE, indexing);
+			LookupResult status;
+			bible.lookup(Ref(43, 3, 16), status);
+			double firstMs = elapsedMicroseconds(start) / 1000;
+
+			std::vector<Ref> refs = allRefs(bible);
+			std::mt19937 rng(settings.seed);
+			std::vector<double> samples;
+			samples.reserve(settings.lookups);
+			for(long i = 0; i < settings.lookups && !refs.empty(); i++) {
+				const Ref &ref = refs[rng() % refs.size()];
+				Clock::time_point lookupStart = Clock::now();
+				bible.lookup(ref, status);
+				samples.push_back(elapsedMicroseconds(lookupStart));
+			}
+			std::cout << std::setw(10) << version << (indexing == INDEX_FULL ? " full" : " lazy") << " index: first lookup after "
+				<< firstMs << " ms, then";
+			if(!samples.empty()) {
+				printLatency(samples);
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+/*
+ * Read-ahead benchmark: a reader walking each version in order, one lookup at a time, with the
+ * text kept compressed. Times the lookups alone (the request path), without read-ahead and with the
+ * server's ReadAhead deciding when to read ahead between lookups (after each reply).
+ */
+static void benchmarkReadAhead(const Settings &settings) {
+	std::cout << "== readahead: sequential lookups, compressed storage" << std::endl;
+	for(const std::string &version : Bible::getVersionList()) {
+		for(bool readingAhead : {false, true}) {
+			Bible bible(Bible::getVersionFile(version), STORAGE_COMPRESSED);
+			std::vector<Ref> refs = allRefs(bible);
+			if(refs.empty()) {
+				continue;
+			}
+			refs.resize(std::min<size_t>(refs.size(), settings.lookups));
+
+			/* Start from cold blocks: walking to collect the refs read none of the text. */
+			ReadAhead reading;
+			std::vector<double> samples;
+			samples.reserve(refs.size());
+			size_t aheads = 0;
+			for(const Ref &ref : refs) {
+				LookupResult status;
+				Clock::time_point lookupStart = Clock::now();
+				bible.lookup(ref, status);
+				samples.push_back(elapsedMicroseconds(lookupStart));
+
+				if(readingAhead && reading.read("bench", version, ref)) {
+					bible.readAhead(ref);
+					aheads++;
+				}
+			}
+			std::cout << std::setw(10) << version << (readingAhead ? " read-ahead:" : " on demand: ");
+			printLatency(samples);
+			if(readingAhead) {
+				std::cout << ", " << aheads << " read-aheads";
+			}
+			std::cout << std::endl;
+		}
+	}
+}
+
+/*
+ * Allocation benchmark: heap allocations and latency per request for the server's common requests
+ * (lookup, next and prev, by a reader moving through a version), after a warm-up pass. Both sides take
+ * each request through a RequestQueue and its version from a BibleCache, as the server does; "before"
+ * then handles it as the server's workers did (a Verse and a stringstream per request), and "server"
+ * calls the server's own handleRequest, which writes into a per-worker arena.
+ */
+static void benchmarkAlloc(const Settings &settings) {
+	std::cout << "== alloc: heap allocations and latency per request, lookup/next/prev" << std::endl;
+	for(StorageMode mode : {STORAGE_FILE, STORAGE_COMPRESSED}) {
+		std::string version = Bible::getVersionList().front();
+		BibleCache bibles(1024 * 1024 * 1024, mode);
+		std::shared_ptr<Bible> bible = bibles.get(version);
+		if(!bible) {
+			continue;
+		}
+		std::vector<Ref> refs = allRefs(*bible);
+		if(refs.empty()) {
+			continue;
+		}
+		refs.resize(std::min<size_t>(refs.size(), settings.lookups));
+
+		/* Requests as a client sends them, header and all. */
+		static const char *actions[] = {"lookup", "next", "prev"};
+		std::vector<std::string> messages;
+		for(size_t i = 0; i < refs.size(); i++) {
+			messages.push_back("@d=0,r=bible_reply.1234.0 " + version + " " + actions[i % 3] + " " + refs[i].toString());
+		}
+
+		RequestQueue queue(64, 0, Bible::getVersionList());
+		RequestQueue::Pending pending;
+		Arena arena;
+		size_t checksum = 0;
+		auto run = [&](const char *name, const std::function<void(const std::string &)> &handle) {
+			/* Receive a request into the queue as the server's receiving thread does, then take and handle it as a worker. */
+			auto request = [&](const std::string &received) {
+				pending.message.assign(received);
+				Request parsed;
+				parseRequest(pending.message, parsed);
+				pending.version.assign(parsed.version);
+				pending.replyPipe.assign(parsed.replyPipe);
+				pending.deadline = RequestQueue::Clock::time_point::max();
+				pending.serial = parsed.serial;
+				queue.push(pending);
+
+				RequestQueue::Pending taken = queue.pop();
+				handle(taken.message);
+				queue.finish(taken);
+				arena.reset();
+				queue.recycle(taken);
+			};
+
+			for(const std::string &message : messages) {
+				request(message);
+			}
+			std::vector<double> samples;
+			samples.reserve(messages.size());
+			unsigned long before = heapAllocations;
+			Clock::time_point start = Clock::now();
+			for(const std::string &message : messages) {
+				Clock::time_point requestStart = Clock::now();
+				request(message);
+				samples.push_back(elapsedMicroseconds(requestStart));
+			}
+			double elapsed = elapsedMicroseconds(start);
+			std::cout << std::setw(10) << (mode == STORAGE_FILE ? "file" : "compressed") << ", " << std::setw(6) << name << ": "
+				<< std::fixed << std::setprecision(2) << (double)(heapAllocations - before) / messages.size() << " allocations, "
+				<< elapsed * 1000 / messages.size() << " ns per request,";
+			printLatency(samples);
+			std::cout << std::endl;
+		};
+
+		run("before", [&](const std::string &message) {
+			Request parsed;
+			parseRequest(message, parsed);
+			std::shared_ptr<Bible> bible = bibles.get(std::string(parsed.version));
+			Ref ref;
+			std::string_view refText = parsed.argument;
+			Ref::parse(refText, ref);
+			LookupResult result;
+			std::stringstream out;
+			if(parsed.action == "lookup") {
+				Verse verse = bible->lookup(ref, result);
+				out << result << " " << ref.toString() << " " << verse.getVerse();
+			}
+			else {
+				Ref moved = parsed.action == "next" ? bible->next(ref, result) : bible->prev(ref, result);
+				out << result << " " << moved.toString();
+			}
+			checksum += out.str().size();
+		});
+
+		run("server", [&](const std::string &message) {
+			ArenaStream out(arena);
+			handleRequest(bibles, queue, message, arena, out);
+			checksum += out.view().size();
+		});
+		std::cout << "(checksum " << checksum << ")" << std::endl;
+	}
+}
+
+static void usage(const char *program) {
+	std::cerr << "Usage: " << program << " [-n <lookups>] [-r <seed>] <manifest> [benchmark...]" << std::endl
+		<< "Benchmarks: storage build scan complete parse diff similar readahead alloc (default: all)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	Settings settings;
+
+	int option;
+	while((option = getopt(argc, argv, "n:r:")) != -1) {
+		switch(option) {
+			case 'n': settings.lookups = std::max(1L, atol(optarg)); break;
+			case 'r': settings.seed = strtoul(optarg, NULL, 10); break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	if(!Bible::loadManifest(argv[optind])) {
+		std::cerr << "Could not read Bible manifest: " << argv[optind] << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* Benchmarks by name. */
+	const std::vector<std::pair<std::string, std::function<void(const Settings &)>>> benchmarks = {
+		{"storage", benchmarkStorage},
+		{"build", benchmarkBuild},
+		{"scan", benchmarkScan},
+		{"complete", benchmarkComplete},
+		{"parse", benchmarkParse},
+		{"diff", benchmarkDiff},
+		{"similar", benchmarkSimilar},
+		{"readahead", benchmarkReadAhead},
+		{"alloc", benchmarkAlloc},
+	};
+
+	std::vector<std::string> selected(argv + optind + 1, argv + argc);
+	for(const auto &benchmark : benchmarks) {
+		if(selected.empty() || std::find(selected.begin(), selected.end(), benchmark.first) != selected.end()) {
+			benchmark.second(settings);
+		}
+	}
+	return EXIT_SUCCESS;
+}
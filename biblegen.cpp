@@ -0,0 +1,303 @@
+/*
+ * biblegen.cpp: Synthetic Bible corpus generator for scale testing.
+ * Author: Benjamin Leskey
+ *
+ * Writes one or more Bible versions in the same "book:chapter:verse text"
+ * line format as the class Bibles, plus a manifest that Bible::loadManifest
+ * (or the BIBLE_MANIFEST environment variable) can point at.
+ *
+ * All versions share one versification (optionally with some verses dropped)
+ * and similar, but not identical, verse text, like real translations.
+ * The versification is random unless -k asks for the standard canon; random
+ * corpora are marked %noncanonical in the manifest so refs are not checked
+ * against Canon.h.
+ */
+
+#include "Canon.h"
+#include "Ref.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/* Names for the first few versions, matching the class Bibles. */
+static const char *versionNames[] = {"kjv", "web", "dby", "webster", "ylt"};
+
+/* Most frequent words, used for the top of the vocabulary. */
+static const char *commonWords[] = {
+	"the", "and", "of", "to", "that", "in", "he", "shall", "unto", "for",
+	"i", "his", "a", "lord", "they", "be", "is", "him", "not", "them",
+	"it", "with", "all", "thou", "thy", "was", "god", "which", "my", "me",
+	"said", "but", "ye", "their", "have", "will", "thee", "from", "as", "are",
+	"when", "this", "out", "were", "upon", "man", "by", "you", "israel", "king",
+	"son", "up", "there", "hath", "then", "people", "came", "had", "house", "into",
+	"on", "her", "come", "one", "we", "children", "before", "your", "also", "day",
+	"land", "men", "let", "go", "against", "made", "behold", "saith", "hand", "us",
+	"earth", "city", "heaven", "father", "spirit", "word", "light", "life", "water", "beginning",
+};
+
+/* Syllables used to build the rest of the vocabulary. */
+static const char *syllables[] = {
+	"a", "ab", "ad", "ah", "am", "an", "ar", "ash", "ba", "be", "bel", "ca", "da", "dan", "e", "el",
+	"er", "ga", "ha", "he", "i", "ia", "ish", "ja", "jo", "ka", "la", "le", "ma", "me", "mi", "na",
+	"ne", "o", "on", "pa", "ra", "re", "ri", "sa", "se", "sh", "ta", "te", "th", "u", "za", "zer",
+};
+
+/* Generation settings. */
+struct Settings {
+	int versions = 5;
+	double scale = 1.0;
+	int chapters = 0;	// Chapters per book, 0 to derive from the scale.
+	int verses = 0;		// Verses per chapter, 0 to derive from the scale.
+	int words = 0;		// Mean words per verse, 0 to derive from the scale.
+	double dropRate = 0.0;	// Fraction of verses each version (after the first) lacks.
+	bool canonical = false;	// Use the standard canon's chapters and verses, scaling only verse length.
+	int vocabulary = 20000;
+	uint64_t seed = 3004;
+};
+
+/* The shape of a generated Bible: verse count for every chapter of every book. */
+typedef std::vector<std::vector<int>> Shape;
+
+/* Mix values into a 64-bit seed (splitmix64 finalizer). */
+static uint64_t mix(uint64_t x) {
+	x += 0x9e3779b97f4a7c15ULL;
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+static uint64_t verseSeed(uint64_t seed, int book, int chapter, int verse) {
+	return mix(seed ^ mix((uint64_t(book) << 32) | (uint64_t(chapter) << 16) | uint64_t(verse)));
+}
+
+/* Build the vocabulary: common words first, then syllable compounds. */
+static std::vector<std::string> buildVocabulary(const Settings &settings) {
+	std::vector<std::string> words(std::begin(commonWords), std::end(commonWords));
+	std::mt19937_64 rng(mix(settings.seed));
+	const int syllableCount = sizeof(syllables) / sizeof(syllables[0]);
+
+	while((int)words.size() < settings.vocabulary) {
+		std::string word;
+		int parts = 2 + rng() % 3;
+		for(int i = 0; i < parts; i++) {
+			word += syllables[rng() % syllableCount];
+		}
+		words.push_back(word);
+	}
+	return words;
+}
+
+/* Cumulative Zipf weights over the vocabulary, for sampling by rank. */
+static std::vector<double> buildZipf(size_t size) {
+	std::vector<double> cumulative(size);
+	double total = 0;
+	for(size_t i = 0; i < size; i++) {
+		total += 1.0 / (i + 1);
+		cumulative[i] = total;
+	}
+	for(double &c : cumulative) {
+		c /= total;
+	}
+	return cumulative;
+}
+
+/* Pick the shape of the generated Bible, scaled up within the Ref limits. */
+static Shape buildShape(const Settings &settings, double &wordsPerVerse) {
+	if(settings.canonical) {
+		Shape shape(Ref::MAX_BOOK_ID);
+		for(int b = 0; b < Ref::MAX_BOOK_ID; b++) {
+			for(int c = 1; c <= Canon::chapters(b + 1); c++) {
+				shape[b].push_back(Canon::verses(b + 1, c));
+			}
+		}
+		wordsPerVerse = std::max(settings.words ? settings.words : 24.0 * settings.scale, 1.0);
+		return shape;
+	}
+
+	std::mt19937_64 rng(mix(settings.seed + 1));
+	double multiplier = std::sqrt(std::max(settings.scale, 0.01));
+	long baseVerses = 0, totalVerses = 0;
+
+	Shape shape(Ref::MAX_BOOK_ID);
+	for(auto &book : shape) {
+		/* Real Bibles average about 18 chapters per book and 26 verses per chapter. */
+		int baseChapters = 1 + rng() % 36;
+		int chapters = settings.chapters ? settings.chapters
+			: std::min<int>(Ref::MAX_CHAPTER_ID, std::max(1L, std::lround(baseChapters * multiplier)));
+
+		for(int c = 0; c < std::max(baseChapters, chapters); c++) {
+			int base = 6 + rng() % 41;
+			if(c < baseChapters) {
+				baseVerses += base;
+			}
+			if(c < chapters) {
+				int verses = settings.verses ? settings.verses
+					: std::min<int>(Ref::MAX_VERSE_ID, std::max(1L, std::lround(base * multiplier)));
+				book.push_back(verses);
+				totalVerses += verses;
+			}
+		}
+	}
+
+	/* Make up the rest of the requested scale with longer verses. */
+	wordsPerVerse = settings.words ? settings.words : 24.0 * settings.scale * baseVerses / totalVerses;
+	wordsPerVerse = std::max(wordsPerVerse, 1.0);
+	return shape;
+}
+
+/* Generate the text of one verse for a version. */
+static void appendVerseText(std::string &out, std::mt19937_64 &base, std::mt19937_64 &variant,
+		const std::vector<std::string> &vocabulary, const std::vector<double> &zipf, double wordsPerVerse, bool original) {
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	auto pick = [&](std::mt19937_64 &rng) -> const std::string & {
+		size_t rank = std::lower_bound(zipf.begin(), zipf.end(), unit(rng)) - zipf.begin();
+		return vocabulary[std::min(rank, vocabulary.size() - 1)];
+	};
+
+	/* Verse lengths vary between half and one and a half times the mean. */
+	int count = std::max(1, (int)std::lround(wordsPerVerse * (0.5 + unit(base))));
+	for(int i = 0; i < count; i++) {
+		/* Translations share most words but reword about a quarter of them. */
+		const std::string &baseWord = pick(base);
+		bool reword = !original && unit(variant) < 0.25;
+		const std::string &word = reword ? pick(variant) : baseWord;
+
+		if(i > 0) {
+			out += (unit(base) < 0.08) ? ", " : " ";
+		}
+		out += word;
+		if(i == 0) {
+			out[out.size() - word.size()] = toupper(word[0]);
+		}
+	}
+	out += '.';
+}
+
+/* Write one version of the corpus to a file. Returns the number of verses written and sets the size in bytes. */
+static long writeVersion(const std::string &path, int version, const Settings &settings, const Shape &shape,
+		double wordsPerVerse, const std::vector<std::string> &vocabulary, const std::vector<double> &zipf, long &bytes) {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if(!out) {
+		return -1;
+	}
+
+	std::mt19937_64 versionRng(mix(settings.seed + 100 + version));
+	std::uniform_real_distribution<double> unit(0.0, 1.0);
+	std::string buffer;
+	long written = 0;
+
+	for(size_t b = 0; b < shape.size(); b++) {
+		for(size_t c = 0; c < shape[b].size(); c++) {
+			for(int v = 1; v <= shape[b][c]; v++) {
+				/* The first version is the "original" and is never missing verses. */
+				if(version > 0 && unit(versionRng) < settings.dropRate) {
+					continue;
+				}
+
+				uint64_t seed = verseSeed(settings.seed, b + 1, c + 1, v);
+				std::mt19937_64 base(seed);
+				std::mt19937_64 variant(mix(seed + version));
+
+				buffer += std::to_string(b + 1) + ":" + std::to_string(c + 1) + ":" + std::to_string(v) + " ";
+				appendVerseText(buffer, base, variant, vocabulary, zipf, wordsPerVerse, version == 0);
+				buffer += '\n';
+				written++;
+			}
+
+			/* Flush a chapter at a time. */
+			out.write(buffer.data(), buffer.size());
+			buffer.clear();
+		}
+	}
+
+	bytes = out.tellp();
+	return out ? written : -1;
+}
+
+static void usage(const char *program) {
+	std::cerr << "Usage: " << program << " [options] <output directory>" << std::endl
+		<< "  -n <count>   number of versions (default 5)" << std::endl
+		<< "  -s <scale>   size of each version as a multiple of a real Bible, e.g. 10 or 1000 (default 1)" << std::endl
+		<< "  -c <count>   chapters per book (default: derived from the scale)" << std::endl
+		<< "  -v <count>   verses per chapter (default: derived from the scale)" << std::endl
+		<< "  -w <count>   mean words per verse (default: derived from the scale)" << std::endl
+		<< "  -k           use the standard canon's books, chapters and verses (only verse length scales)" << std::endl
+		<< "  -d <rate>    fraction of verses missing from each additional version (default 0)" << std::endl
+		<< "  -V <count>   vocabulary size (default 20000)" << std::endl
+		<< "  -r <seed>    random seed (default 3004)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	Settings settings;
+
+	int option;
+	while((option = getopt(argc, argv, "n:s:c:v:w:d:kV:r:")) != -1) {
+		switch(option) {
+			case 'n': settings.versions = atoi(optarg); break;
+			case 's': settings.scale = atof(optarg); break;
+			case 'c': settings.chapters = std::min(atoi(optarg), (int)Ref::MAX_CHAPTER_ID); break;
+			case 'v': settings.verses = std::min(atoi(optarg), (int)Ref::MAX_VERSE_ID); break;
+			case 'w': settings.words = atoi(optarg); break;
+			case 'd': settings.dropRate = atof(optarg); break;
+			case 'k': settings.canonical = true; break;
+			case 'V': settings.vocabulary = std::max(atoi(optarg), (int)(sizeof(commonWords) / sizeof(commonWords[0]))); break;
+			case 'r': settings.seed = strtoull(optarg, NULL, 10); break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(optind != argc - 1 || settings.versions < 1 || settings.scale <= 0) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	std::string directory = argv[optind];
+	if(directory.back() != '/') {
+		directory += '/';
+	}
+
+	double wordsPerVerse;
+	Shape shape = buildShape(settings, wordsPerVerse);
+	std::vector<std::string> vocabulary = buildVocabulary(settings);
+	std::vector<double> zipf = buildZipf(vocabulary.size());
+
+	std::ofstream manifest(directory + "manifest");
+	if(!manifest) {
+		std::cerr << "Could not write manifest in: " << directory << std::endl;
+		return EXIT_FAILURE;
+	}
+	manifest << "# Synthetic Bible corpus written by biblegen (scale " << settings.scale << ", seed " << settings.seed << ")" << std::endl;
+	if(!settings.canonical) {
+		manifest << "%noncanonical" << std::endl;
+	}
+
+	for(int i = 0; i < settings.versions; i++) {
+		std::string name = (i < 5) ? versionNames[i] : "syn" + std::to_string(i + 1);
+		std::string file = name + "-complete";
+
+		std::cout << "Writing version " << name << "..." << std::flush;
+		long bytes = 0;
+		long verses = writeVersion(directory + file, i, settings, shape, wordsPerVerse, vocabulary, zipf, bytes);
+		if(verses < 0) {
+			std::cout << std::endl;
+			std::cerr << "Could not write version file: " << directory + file << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << " " << verses << " verses, " << bytes << " bytes" << std::endl;
+
+		manifest << name << " " << file << std::endl;
+	}
+
+	std::cout << "Manifest: " << directory << "manifest" << std::endl;
+	return EXIT_SUCCESS;
+}
@@ -4,107 +4,291 @@
  * Date: March 2021
  */
 
+#include "Arena.h"
 #include "Bible.h"
+#include "BibleCache.h"
+#include "Protocol.h"
+#include "ReadAhead.h"
 #include "Ref.h"
+#include "RequestHandler.h"
+#include "RequestQueue.h"
 #include "fifo.h"
 
-#include <sstream>
+#include <algorithm>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <csignal>
+#include <unistd.h>
 
 /* Communication pipe identifiers. */
 static const std::string pipe_id_receive = "bible_request";
 static const std::string pipe_id_send = "bible_reply";
 
+/* How long to wait for a client to be listening for its reply, and to take all of it, in milliseconds. */
+static const int replyOpenTimeout = 100;
+static const int replySendTimeout = 1000;
+
+/* How long the thread receiving requests waits to tell a client the server is busy, in milliseconds. */
+static const int busyReplyOpenTimeout = 10;
+
+/* Default worker threads, queued requests, and requests running at once for one version. */
+static const unsigned defaultWorkers = 4;
+static const size_t defaultQueueCapacity = 64;
+static const size_t defaultVersionLimit = 2;
+
+/* Default memory budget for loaded Bible versions, in megabytes. */
+static const size_t defaultBudgetMegabytes = 256;
+
+/* Write a line to the log whole, though workers log at once. The pieces are written as they are, not joined first. */
+static std::mutex logMutex;
+
+template<typename... Pieces>
+static void log(const Pieces &...pieces) {
+	std::lock_guard<std::mutex> lock(logMutex);
+	(std::cout << ... << pieces) << std::endl;
+}
+
 /*
- * Load all possible Bible versions.
- * Returns a map of version identifiers to Bible objects.
- *
- * (Uses std::shared_ptr to avoid both copying Bibles and leaking memory.)
+ * Send a reply on the request's own reply pipe, or else the shared one (one reply at a time),
+ * waiting at most openTimeout ms for the client to be listening, and never past its deadline.
+ * The pipe is reused from reply to reply, so naming it allocates nothing once warm.
  */
-std::map<std::string, std::shared_ptr<Bible>> loadAllBibles() {
-	std::map<std::string, std::shared_ptr<Bible>> bibles;
-
-	/* Try all versions. */
-	for(auto version : Bible::getVersionList()) {
-		std::cout << "Loading and indexing Bible version: " << version << std::endl;
-		bibles[version] = std::make_shared<Bible>(Bible::getVersionFile(version));
-
-		/* If the Bible was not valid, remove this version from the map. */
-		if(!bibles[version]->valid()) {
-			std::cout << "Could not open Bible version: " << version << std::endl;
-			bibles.erase(version);
+static void sendReply(Fifo &pipe_send, const RequestQueue::Pending &request, std::string_view reply, int openTimeout) {
+	static std::mutex sharedReplyMutex;
+	std::unique_lock<std::mutex> shared(sharedReplyMutex, std::defer_lock);
+	if(request.replyPipe.empty()) {
+		shared.lock();
+	}
+
+	/* A client's own pipe is only opened, never created: a client that has gone removes it. */
+	pipe_send.setname(request.replyPipe.empty() ? pipe_id_send : request.replyPipe, request.replyPipe.empty());
+	RequestQueue::Clock::time_point now = RequestQueue::Clock::now();
+	if(request.deadline < now + std::chrono::milliseconds(openTimeout)) {
+		openTimeout = std::chrono::duration_cast<std::chrono::milliseconds>(request.deadline - now).count();
+	}
+	if(openTimeout > 0 && pipe_send.openwrite(openTimeout)) {
+		if(!pipe_send.send(reply, replySendTimeout)) {
+			log("Could not send the reply; the client stopped reading");
 		}
+		pipe_send.fifoclose();
+	}
+	else {
+		log("Dropped the reply; the client stopped waiting");
 	}
+}
 
-	return bibles;
+/*
+ * Once a request is replied to, read ahead for a client moving through a version in order
+ * with lookup and next, so its next requests find the text in memory.
+ */
+static void readAheadFor(BibleCache &bibles, ReadAhead &reading, const RequestQueue::Pending &request) {
+	Request parsed;
+	if(!parseRequest(request.message, parsed) || (parsed.action != "lookup" && parsed.action != "next")) {
+		return;
+	}
+	Ref ref;
+	std::string_view refText = parsed.argument;
+	if(!Ref::parse(refText, ref) || !reading.read(request.replyPipe, request.version, ref)) {
+		return;
+	}
+	std::shared_ptr<Bible> bible = bibles.get(request.version);
+	if(bible) {
+		bible->readAhead(ref);
+	}
 }
 
-int main() {
-	/* Load all Bible versions. */
-	std::map<std::string, std::shared_ptr<Bible>> bibles = loadAllBibles();
+/*
+ * Worker thread: carry out queued requests until the server stops. A request whose
+ * deadline passes while it runs gets no reply, as its client has stopped waiting.
+ * Reads ahead for sequential readers unless reading is NULL.
+ * Each request's temporaries and reply are built in the worker's arena, freed at once
+ * when the request is done, so a warm worker serves common requests without allocating.
+ */
+static void serveRequests(BibleCache &bibles, RequestQueue &requests, ReadAhead *reading) {
+	Arena arena;
+	Fifo pipe_send;
+	for(;;) {
+		RequestQueue::Pending request = requests.pop();
+		log("Got request: ", request.message);
 
-	/* Open communication. */
-	Fifo pipe_receive(pipe_id_receive);
-	Fifo pipe_send(pipe_id_send);
+		/* The reply starts with the request's serial, so the client can tell it from a late reply to an earlier request. */
+		ArenaStream out(arena);
+		writeReplyHeader(out, request.serial);
+		LookupResult result = handleRequest(bibles, requests, request.message, arena, out);
+		requests.finish(request);
 
-	std::cout << "Opening pipes and waiting for requests..." << std::endl;
+		if(RequestQueue::Clock::now() >= request.deadline) {
+			log("Dropped the reply; the request's deadline passed while it ran");
+		}
+		else {
+			sendReply(pipe_send, request, out.view(), replyOpenTimeout);
+			log("Request complete, status: ", Bible::error(result));
 
-	for(;;) {
-		/* Get the next request. */
-		pipe_receive.openread();
-		std::string request = pipe_receive.recv();
-		pipe_receive.fifoclose();
+			if(reading) {
+				readAheadFor(bibles, *reading, request);
+			}
+		}
+		arena.reset();
+		requests.recycle(request);
+	}
+}
+
+static void usage(const char *program) {
+	std::cerr << "Usage: " << program << " [-b <budget MB>] [-z] [-i] [-l] [-s] [-W] [-A] [-t <workers>] [-q <queue>] [-c <per version>] [manifest]" << std::endl
+		<< "  -b <budget MB>  memory budget for loaded versions (default " << defaultBudgetMegabytes << ")" << std::endl
+		<< "  -z              keep verse text in memory, compressed" << std::endl
+		<< "  -i              build full-text search indexes when versions load, rather than on first search" << std::endl
+		<< "  -l              index each book of a version on first access, rather than the whole version at load" << std::endl
+		<< "  -s              publish loaded versions in shared memory, for clients to look up verses without a request" << std::endl
+		<< "  -W              do not reload versions when their files change" << std::endl
+		<< "  -A              do not read ahead for clients reading verses in order" << std::endl
+		<< "  -t <workers>    worker threads carrying out requests (default " << defaultWorkers << ")" << std::endl
+		<< "  -q <queue>      requests waiting for a worker before more are turned away busy (default " << defaultQueueCapacity << ")" << std::endl
+		<< "  -c <per version> requests for one version running at once, 0 for no limit (default " << defaultVersionLimit << ")" << std::endl;
+}
+
+int main(int argc, char **argv) {
+	size_t budgetMegabytes = defaultBudgetMegabytes;
+	StorageMode storage = STORAGE_FILE;
+	bool indexText = false;
+	IndexMode indexing = INDEX_FULL;
+	bool publishSegments = false;
+	bool watchFiles = true;
+	bool readAhead = true;
+	unsigned workerCount = defaultWorkers;
+	size_t queueCapacity = defaultQueueCapacity;
+	size_t versionLimit = defaultVersionLimit;
+
+	int option;
+	while((option = getopt(argc, argv, "b:zilsWAt:q:c:")) != -1) {
+		switch(option) {
+			case 'b':
+				budgetMegabytes = strtoul(optarg, NULL, 10);
+				break;
+			case 'z':
+				storage = STORAGE_COMPRESSED;
+				break;
+			case 'i':
+				indexText = true;
+				break;
+			case 'l':
+				indexing = INDEX_LAZY;
+				break;
+			case 's':
+				publishSegments = true;
+				break;
+			case 'W':
+				watchFiles = false;
+				break;
+			case 'A':
+				readAhead = false;
+				break;
+			case 't':
+				workerCount = std::max(1ul, strtoul(optarg, NULL, 10));
+				break;
+			case 'q':
+				queueCapacity = strtoul(optarg, NULL, 10);
+				break;
+			case 'c':
+				versionLimit = strtoul(optarg, NULL, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	/* An optional argument names a version manifest (such as one written by biblegen). */
+	if(optind < argc) {
+		if(!Bible::loadManifest(argv[optind])) {
+			std::cerr << "Could not read Bible manifest: " << argv[optind] << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	/*
+	 * Bible versions are loaded on first request and evicted when cold,
+	 * keeping the loaded versions within the memory budget.
+	 */
+	BibleCache bibles(budgetMegabytes * 1024 * 1024, storage, indexText, indexing);
+
+	/* Loaded versions can be shared read-only, so clients answer lookup, next and prev themselves. */
+	if(publishSegments) {
+		bibles.publishSegments();
+	}
 
-		std::cout << "Got request: " << request << std::endl;
+	/* Changed version files are reloaded in the background and swapped in without stalling requests. */
+	if(watchFiles && !bibles.watchFiles()) {
+		std::cerr << "Could not watch Bible version files; changes will need a restart" << std::endl;
+	}
 
-		/* Split into pieces. */
-		std::string version = GetNextToken(request, " ");
-		std::string requestType = GetNextToken(request, " ");
-		std::string refText = GetNextToken(request, " ");
+	/* Each request gets its share of the cores for its own threads, scans, index builds and similar verses. */
+	unsigned requestThreads = std::max(1u, std::thread::hardware_concurrency() / workerCount);
+	setRequestThreads(requestThreads);
+	Bible::setThreads(requestThreads);
 
-		LookupResult result;
-		Ref ref(refText);
+	/* Open communication. */
+	Fifo pipe_receive(pipe_id_receive);
 
-		std::cout << "Parsed request, now processing..." << std::endl;
+	/*
+	 * Keep the request pipe open for reading while the server runs, so clients can tell it is up
+	 * (a request pipe with no reader fails to open at once). Clients that go away must not kill it.
+	 */
+	pipe_receive.openreadnowait();
+	signal(SIGPIPE, SIG_IGN);
 
-		/* Begin writing reply. */
-		pipe_send.openwrite();
+	std::cout << "Opening pipes and waiting for requests..." << std::endl;
 
-		std::stringstream out;
+	/* Requests are carried out by a pool of workers, taking them from a bounded queue. */
+	RequestQueue requests(queueCapacity, versionLimit, Bible::getVersionList());
+	ReadAhead reading;
+	std::vector<std::thread> workers;
+	for(unsigned i = 0; i < workerCount; i++) {
+		workers.emplace_back(serveRequests, std::ref(bibles), std::ref(requests), readAhead ? &reading : NULL);
+	}
+
+	/* Requests are received into memory recycled from finished ones (see RequestQueue::push). */
+	RequestQueue::Pending request;
+	Fifo pipe_busy;
+	Arena busyArena;
+	for(;;) {
+		/* Get the next request, and queue it unless the queue is full. */
+		pipe_receive.recv(request.message);
 
-		/* First check for error conditions, then do the actual lookup. */
-		if(bibles.count(version) == 0) {
-			result = OTHER;
-			out << result;
+		/* A request longer than one atomic pipe write may be interleaved with others, so it is not trusted. */
+		if(request.message.length() + 1 > MaxRequest) {
+			log("Request too long, dropped: ", std::string_view(request.message).substr(0, 80));
+			continue;
 		}
-		else {
-			/* Access the appropriate bible. */
-			std::shared_ptr<Bible> bible = bibles[version];
 
-			/* Perform requested operation and return results. */
-			if(requestType == "lookup") {
-				Verse verse = bible->lookup(ref, result);
-				out << result << " " << ref.toString() << " " << verse.getVerse();
-			}
-			else if(requestType == "next") {
-				Ref nextRef = bible->next(ref, result);
-				out << result << " " << nextRef.toString();
-			}
-			else if(requestType == "prev") {
-				Ref prevRef = bible->prev(ref, result);
-				out << result << " " << prevRef.toString();
-			}
-			else {
-				result = OTHER;
-				out << result;
+		Request parsed;
+		parseRequest(request.message, parsed);
+		request.version.assign(parsed.version);
+		/* A similar request also runs against the version it searches, so that is charged to the limit too. */
+		if(parsed.action == "similar") {
+			std::string_view rest = parsed.rest;
+			nextToken(rest);
+			std::string_view target = nextToken(rest);
+			if(!target.empty()) {
+				request.version.append(",").append(target);
 			}
 		}
+		request.replyPipe.assign(parsed.replyPipe);
+		request.deadline = parsed.deadline == 0 ? RequestQueue::Clock::time_point::max()
+			: RequestQueue::Clock::time_point(std::chrono::milliseconds(parsed.deadline));
+		request.serial = parsed.serial;
 
-		/* Write and close. */
-		pipe_send.send(out.str());
-		pipe_send.fifoclose();
-
-		std::cout << "Request complete, status: " << Bible::error(result) << endl;
+		/* Overload is shed at once with an explicit status, rather than left to queue without bound. */
+		if(!requests.push(request)) {
+			log("Server busy, turned away request: ", request.message);
+			ArenaStream busy(busyArena);
+			writeReplyHeader(busy, request.serial);
+			busy << BUSY;
+			sendReply(pipe_busy, request, busy.view(), busyReplyOpenTimeout);
+			busyArena.reset();
+		}
 	}
 }
@@ -18,10 +18,19 @@ Fifo::Fifo(){
   fd = 0;
 }
 
-Fifo::Fifo(string name){
+Fifo::Fifo(string name, bool create){
+  fd = 0;
+  setname(name, create);
+}
+
+void Fifo::setname(const string &name, bool create){
   // create a named pipe (FIFO)
   // build the name string
-  pipename = PATH + SIG + name;
+  pipename.assign(PATH).append(SIG).append(name);
+  unread.clear();
+  if (!create) {
+    return;
+  }
 
   umask(0);
   // Create (or open) the fifo
@@ -74,13 +83,19 @@ void Fifo::fifoclose() {
 
 // Receive a message from a FIFO (named pipe)
 string Fifo::recv() {
+  string message;
+  recv(message);
+  return(message);
+}
+
+void Fifo::recv(string &message) {
   if (fd ==0) {
     cerr << "Fifo not open for read: " << pipename << endl;
-    return ("");
+    message = "";
+    return;
   }
 
   int i;
-  string message;
   bool done;
   int bytes;
   char inbuff;
@@ -98,7 +113,8 @@ string Fifo::recv() {
     // -1 means something isn't working
     if (bytes ==-1) {
       cerr << "Error - bad read on input pipe: " << pipename << endl;
-      return("");
+      message = "";
+      return;
     }
     // check if nothing was read
     if (bytes > 0) {
@@ -115,7 +131,6 @@ string Fifo::recv() {
       openread();
     }
   }
-  return(message);
 }
 
 // Send a message to a FIFO (named pipe)
@@ -142,3 +157,136 @@ void Fifo::send(string message) {
   return;
 }
 
+
+// Milliseconds left until a deadline (0 once it has passed)
+static int remaining(std::chrono::steady_clock::time_point deadline) {
+  std::chrono::steady_clock::duration left = deadline - std::chrono::steady_clock::now();
+  return left.count() > 0 ? (int)std::chrono::duration_cast<std::chrono::milliseconds>(left).count() + 1 : 0;
+}
+
+bool Fifo::openwrite(int timeout) {
+  if (fd !=0) {
+    cerr << "Fifo already opened: " << pipename << endl;
+    return false;
+  }
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  // A non-blocking open fails (ENXIO) instead of waiting when there is no reader
+  for (;;) {
+    fd = open(pipename.c_str(),O_WRONLY | O_NONBLOCK);
+    if (fd != -1) {
+      return true;
+    }
+    fd = 0;
+    if (errno != ENXIO || remaining(deadline) == 0) {
+      return false;
+    }
+    usleep(1000);
+  }
+}
+
+bool Fifo::openreadnowait() {
+  if (fd !=0) {
+    cerr << "Fifo already opened: " << pipename << endl;
+    return false;
+  }
+  fd = open(pipename.c_str(),O_RDWR);
+  if (fd == -1) {
+    fd = 0;
+    return false;
+  }
+  return true;
+}
+
+// Add the bytes of a record to message (up to MaxMess of them), skipping terminators before it.
+// Returns how many bytes were used, through the record's terminator, or -1 if the record goes on.
+static ssize_t takeRecord(const char *data, size_t length, string &message) {
+  for (size_t i = 0; i < length; i++) {
+    if (data[i] == MESSTERM && !message.empty()) {
+      return i + 1;
+    }
+    if (data[i] != MESSTERM && message.length() < MaxMess) {
+      message += data[i];
+    }
+  }
+  return -1;
+}
+
+// Receive a message, waiting at most timeout ms for all of it
+bool Fifo::recv(string &message, int timeout) {
+  message = "";
+  if (fd ==0) {
+    cerr << "Fifo not open for read: " << pipename << endl;
+    return false;
+  }
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  // Bytes already read past the last record come first
+  ssize_t used = takeRecord(unread.data(), unread.length(), message);
+  if (used >= 0) {
+    unread.erase(0, used);
+    return true;
+  }
+  unread.clear();
+
+  char buffer[4096];
+  for (;;) {
+    struct pollfd ready = {fd, POLLIN, 0};
+    int left = remaining(deadline);
+    if (left == 0 || poll(&ready, 1, left) <= 0) {
+      return false;
+    }
+    ssize_t bytes = read(fd, buffer, sizeof(buffer));
+    if (bytes == -1 && (errno == EAGAIN || errno == EINTR)) {
+      continue;
+    }
+    // The read failed
+    if (bytes <= 0) {
+      return false;
+    }
+    used = takeRecord(buffer, bytes, message);
+    if (used >= 0) {
+      unread.assign(buffer + used, bytes - used);
+      return true;
+    }
+  }
+}
+
+// Send a message, waiting at most timeout ms for room in the pipe
+bool Fifo::send(std::string_view message, int timeout) {
+  if (fd ==0) {
+    cerr << "Fifo not open for send: " << pipename << endl;
+    return false;
+  }
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout);
+
+  // The message and its terminator go in one write (atomic up to PIPE_BUF), without copying them together
+  const char terminator = MESSTERM;
+  size_t sent = 0;
+  while (sent < message.length() + 1) {
+    struct iovec parts[2];
+    int count = 0;
+    if (sent < message.length()) {
+      parts[count++] = {(void *)(message.data() + sent), message.length() - sent};
+    }
+    parts[count++] = {(void *)&terminator, 1};
+    ssize_t bytes = writev(fd, parts, count);
+    if (bytes > 0) {
+      sent += bytes;
+      continue;
+    }
+    if (bytes == -1 && errno != EAGAIN && errno != EINTR) {
+      return false;
+    }
+    struct pollfd ready = {fd, POLLOUT, 0};
+    int left = remaining(deadline);
+    if (left == 0 || poll(&ready, 1, left) <= 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void Fifo::remove() {
+  unlink(pipename.c_str());
+}
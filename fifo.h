@@ -17,6 +17,7 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <iostream>
@@ -24,10 +25,17 @@
 #include <stdio.h>
 #include <string.h>
 #include <string>
+#include <string_view>
+#include <poll.h>
+#include <sys/uio.h>
+#include <chrono>
 
 using namespace std;
 
-#define MaxMess 1000
+#define MaxMess 65536
+// Longest request, with its terminator: every client writes to the one request pipe, and
+// pipe writes are only atomic up to PIPE_BUF, so longer requests could interleave with others
+#define MaxRequest PIPE_BUF
 const string PATH  = "/tmp/";
 // SIGniture assures the pipe is unique amoung users
 const string SIG = "benleskey_";
@@ -40,17 +48,31 @@ class Fifo {
 
   int fd;   // File descriptor for pipes
   string pipename;
+  string unread;  // Bytes read past the end of the last record received with a timeout, the start of the next
 
  public:
   // create a named pipe (FIFO)
   Fifo();
-  Fifo(string);
+  Fifo(string, bool create = true);   // Without create, only an existing pipe can be opened
+  void setname(const string &name, bool create = true);  // Use another pipe (when closed), reusing the name's memory
 
   void openread();    // Start a new read transaction
   void openwrite();   // Start a new write transaction
   void fifoclose();       // Finish a transaction
 
 string recv();    // Get the next record
+  void recv(string &message);  // Get the next record into message, reusing its memory
   void send(string);    // Send a record
+
+  // Transactions bounded by timeouts (in milliseconds), for a side that must not hang
+  // on a peer that is down or wedged. Each returns false if it fails or times out.
+  bool openwrite(int timeout);  // Retries until a reader has the pipe open (at least once)
+  bool openreadnowait();        // Opens for reading without waiting for a writer. Also opens as a writer, so
+                                // reads wait for the next record rather than end when a writer closes, and
+                                // writers can tell the pipe is read for as long as it stays open
+  bool recv(string &message, int timeout);  // Waits for a whole record, keeping any bytes read past it for the next
+  bool send(std::string_view message, int timeout);
+
+  void remove();    // Delete the named pipe
 };
 #endif
@@ -0,0 +1,152 @@
+/*
+ * prerender.cpp: Render every chapter of every Bible version ahead of time.
+ * Author: Benjamin Leskey
+ *
+ * Writes each version's chapters as the HTML bibleajax shows for them, with
+ * an index of every verse (see StaticPassages.h), so the CGI can serve any
+ * passage straight from the file, without asking the lookup server.
+ * Chapters are rendered in parallel, by as many threads as there are cores
+ * unless -t says otherwise. The text never changes, so this need only be run
+ * again when a version's file does (the CGI ignores files rendered from older
+ * text).
+ */
+
+#include "Bible.h"
+#include "StaticPassages.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+/* A chapter to render: its version and its first and last verses. */
+struct Task {
+	size_t version;
+	Ref first;
+	Ref last;
+};
+
+/* List the chapters of a version, in order. */
+static void listChapters(Bible &bible, size_t version, std::vector<Task> &tasks) {
+	LookupResult status;
+	std::vector<Verse> start = bible.lookupRange(Ref(Ref::MIN_BOOK_ID, Ref::MIN_CHAPTER_ID, Ref::MIN_VERSE_ID),
+		Ref(Ref::MAX_BOOK_ID, Ref::MAX_CHAPTER_ID, Ref::MAX_VERSE_ID), 1, status);
+	if(start.empty()) {
+		return;
+	}
+
+	Ref ref = start.front().getRef();
+	while(status == SUCCESS) {
+		Ref first, last;
+		bible.chapterBounds(ref, first, last, status);
+		if(status != SUCCESS) {
+			break;
+		}
+		tasks.push_back(Task{version, first, last});
+		ref = bible.nextChapter(ref, status);
+	}
+}
+
+static void usage(const char *program) {
+	std::cerr << "Usage: " << program << " [options] <output directory> [version ...]" << std::endl
+		<< "  -t <count>   rendering threads (default: one per core)" << std::endl
+		<< "Renders every version in the manifest unless versions are named." << std::endl;
+}
+
+int main(int argc, char **argv) {
+	unsigned threads = 0;
+
+	int option;
+	while((option = getopt(argc, argv, "t:")) != -1) {
+		switch(option) {
+			case 't': threads = std::max(atoi(optarg), 1); break;
+			default:
+				usage(argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if(optind >= argc) {
+		usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+	std::string directory = argv[optind];
+
+	std::vector<std::string> versions(argv + optind + 1, argv + argc);
+	if(versions.empty()) {
+		std::list<std::string> all = Bible::getVersionList();
+		versions.assign(all.begin(), all.end());
+	}
+
+	/* Load every version and list its chapters; rendering then shares the work out chapter by chapter. */
+	std::vector<std::unique_ptr<Bible>> bibles;
+	std::vector<std::string> stamps;
+	std::vector<Task> tasks;
+	for(const std::string &version : versions) {
+		std::string file = Bible::getVersionFile(version);
+		stamps.push_back(Bible::fileStamp(file));
+		bibles.emplace_back(new Bible(file));
+		if(file.empty() || !bibles.back()->valid()) {
+			std::cerr << "Could not read version: " << version << std::endl;
+			return EXIT_FAILURE;
+		}
+		listChapters(*bibles.back(), bibles.size() - 1, tasks);
+	}
+
+	if(threads == 0) {
+		threads = std::max(1u, std::thread::hardware_concurrency());
+	}
+	threads = std::max<size_t>(1, std::min<size_t>(threads, tasks.size()));
+
+	std::vector<StaticPassages::Chapter> chapters(tasks.size());
+	std::atomic<size_t> next(0);
+	std::atomic<bool> failed(false);
+	auto work = [&]() {
+		for(size_t i; (i = next++) < tasks.size();) {
+			LookupResult status;
+			std::vector<Verse> verses = bibles[tasks[i].version]->lookupRange(tasks[i].first, tasks[i].last,
+				Ref::MAX_VERSE_ID, status);
+			if(status != SUCCESS) {
+				failed = true;
+			}
+			chapters[i] = StaticPassages::render(verses);
+		}
+	};
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; i++) {
+		workers.push_back(std::thread(work));
+	}
+	work();
+	for(std::thread &worker : workers) {
+		worker.join();
+	}
+	if(failed) {
+		std::cerr << "Could not read every chapter" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	/* Each version's chapters are together, in order, in the task list. */
+	std::vector<StaticPassages::Chapter>::iterator start = chapters.begin();
+	for(size_t v = 0; v < versions.size(); v++) {
+		std::vector<StaticPassages::Chapter>::iterator end = start;
+		size_t verses = 0;
+		while(end != chapters.end() && tasks[end - chapters.begin()].version == v) {
+			verses += end->entries.size();
+			++end;
+		}
+		std::vector<StaticPassages::Chapter> version(std::make_move_iterator(start), std::make_move_iterator(end));
+		if(!StaticPassages::write(directory, versions[v], stamps[v], version)) {
+			std::cerr << "Could not write version " << versions[v] << " in: " << directory << std::endl;
+			return EXIT_FAILURE;
+		}
+		std::cout << versions[v] << ": " << (end - start) << " chapters, " << verses << " verses" << std::endl;
+		start = end;
+	}
+	return EXIT_SUCCESS;
+}
@@ -3,11 +3,13 @@
 
 #include "Bible.h"
 #include "Ref.h"
+#include "Canon.h"
 #include "BibleLookupClient.h"
 
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
+#include <limits>
 
 /* Communication pipe identifiers. */
 static const std::string pipe_id_receive = "bible_reply";
@@ -15,12 +17,38 @@ static const std::string pipe_id_send = "bible_request";
 
 int main (int argc, char **argv) {
 	// Book, chapter, verse.
-	int b, c, v;
+	int b = 0, c = 0, v = 0;
 	// Number of verses to fetch.
 	int length = 1;
+	// Last ref to show.
+	Ref last(Ref::MAX_BOOK_ID, Ref::MAX_CHAPTER_ID, Ref::MAX_VERSE_ID);
+
+	// Arguments other than numbers are a human-readable reference, like "John 3:16-18" or "1 Cor 13".
+	std::string text;
+	bool human = false;
+	for(int i = 1; i < argc; i++) {
+		text += (i > 1 ? " " : "") + std::string(argv[i]);
+		human = human || std::string(argv[i]).find_first_not_of("0123456789") != std::string::npos;
+	}
+	if(human) {
+		RefRange range;
+		if(!Ref::parseRange(text, range)) {
+			cerr << "Error: not a reference: " << text << endl;
+			return EXIT_FAILURE;
+		}
+		b = range.first.getBook();
+		c = range.first.getChapter();
+		v = range.first.getVerse();
+		length = std::numeric_limits<int>::max();
+		// Open-ended passages stop where the canon's book or chapter ends.
+		if(Bible::versionFollowsCanon(Bible::getDefaultVersion())) {
+			Canon::clamp(range);
+		}
+		last = range.last;
+	}
 
 	// Check for too few arguments and output an approriate error message upon failure.
-	switch(argc) {
+	switch(human ? 4 : argc) {
 		case 0:
 		case 1:
 			cerr << "Error: book number is missing" << endl;
@@ -35,19 +63,27 @@ int main (int argc, char **argv) {
 			break;
 	}
 
-	// Get the ref arguments as integers.
-	b = atoi(argv[1]);
-	c = atoi(argv[2]);
-	v = atoi(argv[3]);
+	if(!human) {
+		// Get the ref arguments as integers.
+		b = atoi(argv[1]);
+		c = atoi(argv[2]);
+		v = atoi(argv[3]);
 
-	// Get the length argument if possible.
-	if(argc >= 5) {
-		length = atoi(argv[4]);
+		// Get the length argument if possible.
+		if(argc >= 5) {
+			length = atoi(argv[4]);
+		}
 	}
 
 	// Create a reference from the numbers
 	Ref ref(b, c, v);
 
+	// Refs outside the canon can be rejected without asking the server.
+	if(Bible::versionFollowsCanon(Bible::getDefaultVersion()) && !Canon::contains(ref)) {
+		cerr << "Error: " << Canon::explain(ref) << endl;
+		return EXIT_FAILURE;
+	}
+
 	// Construct the client for requesting.
 	BibleLookupClient client(pipe_id_send, pipe_id_receive, Bible::getDefaultVersion());
 
@@ -69,7 +105,7 @@ int main (int argc, char **argv) {
 			cout << " " << verse.getRef().getVerse() << ". " << verse.getVerse() << endl;
 
 			Ref nextRef = client.next(verse.getRef(), result);
-			if(nextRef.getBook() != ref.getBook()) {
+			if(nextRef.getBook() != ref.getBook() || last < nextRef) {
 				break;
 			}
 			if(result == SUCCESS) {